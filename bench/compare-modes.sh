@@ -0,0 +1,27 @@
+#!/bin/bash
+# compare latency of pool and per_core server modes at equal load
+# usage: bench/compare-modes.sh [csnet-bench options], build server and bench before
+
+#save related script dir
+P=$(cd $(dirname $0)/..; pwd)
+
+PORT=3425
+ARGS="$@"
+[ -z "$ARGS" ] && ARGS="-c 16 -n 2000 -a ping"
+
+for MODE in pool per_core; do
+    # the server reads server.cfg from the current dir first
+    DIR=$(mktemp -d)
+    sed -e "s/^mode *=.*/mode = $MODE/" -e "s/^log_disabled *=.*/log_disabled = true/" $P/cfg/server.cfg > $DIR/server.cfg
+
+    (cd $DIR && exec $P/bin/myserver -i > /dev/null 2>&1) &
+    SERVER=$!
+    sleep 1
+
+    echo ============== $MODE ===============
+    $P/bin/csnet-bench -p $PORT $ARGS
+
+    kill -TERM $SERVER
+    wait $SERVER
+    rm -rf $DIR
+done
@@ -0,0 +1,471 @@
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <climits>
+#endif
+
+#include <stdexcept>
+#include <csignal>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <filesystem>
+
+#include "clnapi.h"
+#include "histogram.h"
+
+using namespace csnet;
+using namespace csnet::shared;
+
+typedef std::chrono::steady_clock clock_type;
+
+// harness options
+struct options_t
+{
+  std::string server; // myserver binary
+  std::string cfg; // server.cfg the test config is made of
+  std::string baseline; // baseline file
+  std::string mode; // server mode, the config one if empty
+  std::string filter; // run workloads with the substring in the name only
+  double threshold = 15; // allowed regression in percent
+  bool update = false; // write results to the baseline
+};
+
+// workload request, it is called by a client thread with the request number
+typedef std::function<void(clnapi_t& clnapi, size_t n)> request_t;
+
+// defined load
+struct workload_t
+{
+  std::string name;
+  int clients;
+  long requests; // per client
+  request_t request;
+};
+
+// measured or baseline result of a workload
+struct result_t
+{
+  double throughput = 0; // req/s
+  double p99 = 0; // us
+  uint64_t errors = 0;
+};
+
+// print usage
+void usage()
+{
+  std::cout << "Usage: csnet-e2e [-s myserver] [-g server.cfg] [-b baseline] [-t percent] [-m mode] [-w workload] [-u]" << std::endl
+    << "  -s  server binary, myserver next to csnet-e2e by default" << std::endl
+    << "  -g  config the test config is made of, ../cfg/server.cfg of the binary dir by default" << std::endl
+    << "  -b  baseline file, ../bench/e2e-baseline.txt of the binary dir by default" << std::endl
+    << "  -t  fail if throughput drops or p99 grows more than the percent, 15 by default" << std::endl
+    << "  -m  server mode, pool or per_core, the config one by default" << std::endl
+    << "  -w  run workloads with the substring in the name only" << std::endl
+    << "  -u  write results to the baseline instead of comparing" << std::endl;
+}
+
+// get dir of the running binary
+std::string exe_dir()
+{
+#ifdef _WIN32
+  return ".";
+#else
+  char dest[PATH_MAX];
+  ssize_t size = ::readlink("/proc/self/exe", dest, PATH_MAX - 1);
+  if (size <= 0)
+    return ".";
+  dest[size] = 0;
+  return std::filesystem::path(dest).parent_path().string();
+#endif
+}
+
+// parse command line
+bool parse_cmd(int argc, char** args, options_t& options)
+{
+  std::string dir = exe_dir();
+  options.server = dir + "/myserver";
+  options.cfg = dir + "/../cfg/server.cfg";
+  options.baseline = dir + "/../bench/e2e-baseline.txt";
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::strcmp(args[i], "-u") == 0)
+    {
+      options.update = true;
+      continue;
+    }
+
+    if (i + 1 >= argc)
+      return false;
+
+    if (std::strcmp(args[i], "-s") == 0)
+      options.server = args[++i];
+    else if (std::strcmp(args[i], "-g") == 0)
+      options.cfg = args[++i];
+    else if (std::strcmp(args[i], "-b") == 0)
+      options.baseline = args[++i];
+    else if (std::strcmp(args[i], "-t") == 0)
+      options.threshold = std::max(std::atof(args[++i]), 0.0);
+    else if (std::strcmp(args[i], "-m") == 0)
+      options.mode = args[++i];
+    else if (std::strcmp(args[i], "-w") == 0)
+      options.filter = args[++i];
+    else
+      return false;
+  }
+
+  return true;
+}
+
+// myserver run as a child process on a free loopback port with its own config
+class server_process_t
+{
+public:
+  server_process_t(const options_t& options)
+  {
+#ifdef _WIN32
+    throw std::runtime_error("Starting the server is not supported on Windows");
+#else
+    _port = free_port();
+
+    char dir[] = "/tmp/csnet-e2e-XXXXXX";
+    if (::mkdtemp(dir) == nullptr)
+      throw std::runtime_error("Cannot create temp dir");
+    _dir = dir;
+
+    make_cfg(options);
+
+    // the server reads server.cfg from the current dir first
+    _pid = ::fork();
+    if (_pid < 0)
+      throw std::runtime_error("Cannot start the server");
+    if (_pid == 0)
+    {
+      int null = ::open("/dev/null", O_WRONLY);
+      ::dup2(null, STDOUT_FILENO);
+      ::dup2(null, STDERR_FILENO);
+      if (::chdir(_dir.c_str()) == 0)
+        ::execl(options.server.c_str(), options.server.c_str(), "-i", (char*)nullptr);
+      ::_exit(127);
+    }
+
+    wait_ready();
+#endif
+  }
+
+  // stop the server and remove its dir
+  ~server_process_t()
+  {
+#ifndef _WIN32
+    if (_pid > 0)
+    {
+      ::kill(_pid, SIGTERM);
+      ::waitpid(_pid, nullptr, 0);
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(_dir, ec);
+#endif
+  }
+
+  // get server port
+  int port() const
+  {
+    return _port;
+  }
+
+private:
+#ifndef _WIN32
+  // get a free port, the system gives it for port 0
+  static int free_port()
+  {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || ::bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || ::getsockname(fd, (sockaddr*)&addr, &len) != 0)
+    {
+      if (fd >= 0)
+        ::close(fd);
+      throw std::runtime_error("Cannot get a free port");
+    }
+    ::close(fd);
+    return ntohs(addr.sin_port);
+  }
+
+  // copy the config with the port, the mode and w/o logs
+  void make_cfg(const options_t& options)
+  {
+    std::ifstream in(options.cfg);
+    if (!in)
+      throw std::runtime_error("Cannot open config \"" + options.cfg + "\"");
+    std::ofstream out(_dir + "/server.cfg");
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+      std::string name = line.substr(0, line.find('='));
+      name.erase(name.find_last_not_of(" \t") + 1);
+      if (name == "port")
+        line = "port = " + std::to_string(_port);
+      else if (name == "metrics_port")
+        line = "metrics_port = 0";
+      else if (name == "log_disabled")
+        line = "log_disabled = true";
+      else if (name == "mode" && !options.mode.empty())
+        line = "mode = " + options.mode;
+      out << line << std::endl;
+    }
+    if (!out)
+      throw std::runtime_error("Cannot write config to \"" + _dir + "\"");
+  }
+
+  // wait until the server replies a ping
+  void wait_ready()
+  {
+    clock_type::time_point deadline = clock_type::now() + std::chrono::seconds(10);
+    while (clock_type::now() < deadline)
+    {
+      int status = 0;
+      if (::waitpid(_pid, &status, WNOHANG) == _pid)
+      {
+        _pid = 0;
+        throw std::runtime_error("The server exited with code " + std::to_string(WEXITSTATUS(status)));
+      }
+
+      try
+      {
+        clnapi_t clnapi;
+        clnapi.connect("127.0.0.1", _port, 1, 0);
+        clnapi.ping(1);
+        return;
+      }
+      catch (std::exception&)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+    }
+    throw std::runtime_error("The server does not reply on port " + std::to_string(_port));
+  }
+#endif
+
+private:
+  int _port = 0;
+  std::string _dir;
+#ifndef _WIN32
+  pid_t _pid = 0;
+#endif
+};
+
+// run the workload, each client connects per request like the server expects
+result_t run(const workload_t& workload, int port)
+{
+  std::vector<histogram_t> latency(workload.clients);
+  std::vector<uint64_t> errors(workload.clients, 0);
+
+  auto client = [&](int index)
+  {
+    clnapi_t clnapi;
+    for (long n = 0; n < workload.requests; n++)
+    {
+      clock_type::time_point begin = clock_type::now();
+      try
+      {
+        clnapi.connect("127.0.0.1", port);
+        workload.request(clnapi, (size_t)n);
+        latency[index].record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - begin).count());
+      }
+      catch (std::exception&)
+      {
+        errors[index]++;
+      }
+      clnapi.close();
+    }
+  };
+
+  clock_type::time_point start = clock_type::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < workload.clients; i++)
+    threads.emplace_back(client, i);
+  for (std::thread& thread : threads)
+    thread.join();
+  std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+  histogram_t all;
+  result_t result;
+  for (int i = 0; i < workload.clients; i++)
+  {
+    all.merge(latency[i]);
+    result.errors += errors[i];
+  }
+  result.throughput = all.count() / elapsed.count();
+  result.p99 = all.percentile(99) / 1000.0;
+  return result;
+}
+
+// read the baseline like 'workload throughput p99', '#' starts a comment
+std::map<std::string, result_t> read_baseline(const std::string& filename)
+{
+  std::map<std::string, result_t> baseline;
+  std::ifstream in(filename);
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::stringstream fields(line);
+    std::string name;
+    result_t result;
+    if (fields >> name >> result.throughput >> result.p99)
+      baseline[name] = result;
+  }
+  return baseline;
+}
+
+// write results as the baseline
+void write_baseline(const std::string& filename, const std::vector<workload_t>& workloads, const std::map<std::string, result_t>& results)
+{
+  std::ofstream out(filename, std::ios::out | std::ios::trunc);
+  out << "# csnet-e2e baseline, it is written by csnet-e2e -u" << std::endl;
+  out << "# workload throughput(req/s) p99(us)" << std::endl;
+  out << std::fixed << std::setprecision(1);
+  for (const workload_t& workload : workloads)
+  {
+    auto found = results.find(workload.name);
+    if (found != results.end())
+      out << workload.name << " " << found->second.throughput << " " << found->second.p99 << std::endl;
+  }
+  if (!out)
+    throw std::runtime_error("Cannot write baseline \"" + filename + "\"");
+}
+
+// print a compared metric, return true if it regressed more than the threshold
+bool compare(const std::string& name, const std::string& metric, double baseline, double current, bool higher_better, double threshold)
+{
+  double change = baseline > 0 ? (current - baseline) * 100 / baseline : 0;
+  bool regressed = baseline > 0 && (higher_better ? -change : change) > threshold;
+
+  std::cout << std::left << std::setw(12) << name << std::setw(8) << metric << std::right << std::fixed << std::setprecision(1)
+    << std::setw(12) << baseline << std::setw(12) << current << std::setw(9) << std::showpos << change << "%" << std::noshowpos;
+  if (baseline <= 0)
+    std::cout << "  new";
+  else if (regressed)
+    std::cout << "  REGRESSED";
+  std::cout << std::endl;
+
+  return regressed;
+}
+
+int main(int argc, char** args)
+{
+  options_t options;
+  if (!parse_cmd(argc, args, options))
+  {
+    usage();
+    return -1;
+  }
+
+  // texts are made once, so requests measure the server and the network only
+  const std::string text_1k(1024, 'e');
+  // the packet size is 16 bit, so the largest echo is a bit less than 64 KiB
+  const std::string text_63k(63 * 1024, 'e');
+  const std::vector<std::string> calcs = { "2*(3+4)-5/2", "abs(-12.5) mod 4", "sin(0.5)**2+cos(0.5)**2", "(1+2)*(3+4)*(5+6)/7" };
+
+  std::vector<workload_t> workloads =
+  {
+    { "ping", 16, 2000, [](clnapi_t& clnapi, size_t) { clnapi.ping(0x1010101010101010); } },
+    { "echo_1k", 8, 1000, [&](clnapi_t& clnapi, size_t)
+      {
+        if (clnapi.sendmsg(text_1k).size() != text_1k.size())
+          throw std::runtime_error("Wrong echo");
+      } },
+    { "echo_63k", 4, 200, [&](clnapi_t& clnapi, size_t)
+      {
+        if (clnapi.sendmsg(text_63k).size() != text_63k.size())
+          throw std::runtime_error("Wrong echo");
+      } },
+    { "calc_mix", 8, 1000, [&](clnapi_t& clnapi, size_t n) { clnapi.calculate(calcs[n % calcs.size()]); } },
+    { "execmd", 4, 50, [](clnapi_t& clnapi, size_t) { clnapi.execmd("echo csnet"); } }
+  };
+
+#ifndef _WIN32
+  std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+  std::map<std::string, result_t> results;
+  uint64_t errors = 0;
+  try
+  {
+    server_process_t server(options);
+    std::cout << "server: " << options.server << ", port: " << server.port() << std::endl;
+
+    for (const workload_t& workload : workloads)
+    {
+      if (workload.name.find(options.filter) == std::string::npos)
+        continue;
+
+      result_t result = run(workload, server.port());
+      results[workload.name] = result;
+      errors += result.errors;
+      if (result.errors)
+        std::cout << workload.name << ": " << result.errors << " errors" << std::endl;
+    }
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "Error occurred: " << e.what() << std::endl;
+    return -1;
+  }
+
+  if (options.update)
+  {
+    // keep baseline lines of workloads which are not run
+    std::map<std::string, result_t> baseline = read_baseline(options.baseline);
+    for (const auto& result : results)
+      baseline[result.first] = result.second;
+    write_baseline(options.baseline, workloads, baseline);
+    std::cout << "baseline is written to " << options.baseline << std::endl;
+    return errors ? 1 : 0;
+  }
+
+  std::map<std::string, result_t> baseline = read_baseline(options.baseline);
+
+  std::cout << std::left << std::setw(12) << "workload" << std::setw(8) << "metric" << std::right << std::setw(12) << "baseline"
+    << std::setw(12) << "current" << std::setw(10) << "change" << std::endl;
+
+  size_t regressions = 0;
+  for (const workload_t& workload : workloads)
+  {
+    auto found = results.find(workload.name);
+    if (found == results.end())
+      continue;
+
+    result_t base = baseline.count(workload.name) ? baseline[workload.name] : result_t();
+    regressions += compare(workload.name, "req/s", base.throughput, found->second.throughput, true, options.threshold);
+    regressions += compare(workload.name, "p99 us", base.p99, found->second.p99, false, options.threshold);
+  }
+
+  if (regressions)
+    std::cout << regressions << " metrics regressed by more than " << options.threshold << "%" << std::endl;
+  if (errors)
+    std::cout << errors << " requests failed" << std::endl;
+
+  return regressions || errors ? 1 : 0;
+}
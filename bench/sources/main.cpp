@@ -0,0 +1,622 @@
+#include <stdexcept>
+#include <csignal>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <algorithm>
+
+#include "clnapi.h"
+#include "histogram.h"
+
+using namespace csnet;
+using namespace csnet::shared;
+
+typedef std::chrono::steady_clock clock_type;
+
+// benchmark actions
+enum class action_t
+{
+  ping,
+  time,
+  echo,
+  calc
+};
+
+static const char* _action_names[] = { "ping", "time", "echo", "calc" };
+static constexpr size_t _ACTIONS = sizeof(_action_names) / sizeof(_action_names[0]);
+
+// benchmark options
+struct options_t
+{
+  std::string host = "127.0.0.1";
+  int port = 3425;
+  int clients = 8;
+  long requests = 0; // per client, 0 - not limited by count
+  double duration = 0; // seconds, 0 - not limited by time
+  double rate = 0; // requests per second of all clients, 0 - closed loop
+  bool persistent = false;
+  int depth = 0; // pipelined requests of a client, 0 - one request at a time
+  bool engine = false; // all clients are connections of one event engine thread
+  std::vector<int> mix = std::vector<int>(_ACTIONS, 0); // weights of actions
+};
+
+// measured results of a client or all clients
+struct results_t
+{
+  std::vector<histogram_t> latency = std::vector<histogram_t>(_ACTIONS); // ns
+  std::vector<uint64_t> errors = std::vector<uint64_t>(_ACTIONS, 0);
+  uint64_t connects = 0;
+
+  // add results of other client
+  void merge(const results_t& rhs)
+  {
+    for (size_t i = 0; i < _ACTIONS; i++)
+    {
+      latency[i].merge(rhs.latency[i]);
+      errors[i] += rhs.errors[i];
+    }
+    connects += rhs.connects;
+  }
+};
+
+// print usage
+void usage()
+{
+  std::cout << "Usage: csnet-bench [-h host] [-p port] [-c clients] [-n requests per client] [-d seconds]" << std::endl
+    << "                   [-r requests per second] [-k] [-q depth] [-e] [-a action[:weight],...]" << std::endl
+    << "  -n, -d  stop after the count of requests per client or the duration, -n 1000 if none is set" << std::endl
+    << "  -r      open loop at a fixed total rate, latency is measured from the scheduled send time" << std::endl
+    << "          so server stalls are not hidden (coordinated omission), closed loop if not set" << std::endl
+    << "  -k      keep the connection of a client between requests while the server keeps it open" << std::endl
+    << "  -q      pipeline up to 'depth' requests of a client over one kept connection by the async api" << std::endl
+    << "  -e      run all clients as connections of one event engine thread, up to 'depth' requests each," << std::endl
+    << "          so thousands of connections need no threads, closed loop only (Linux)" << std::endl
+    << "  -a      action mix of ping, time, echo and calc, like ping:70,echo:20,calc:10 (default ping)" << std::endl;
+}
+
+// parse action mix like 'ping:70,echo:30'
+bool parse_mix(const std::string& value, std::vector<int>& mix)
+{
+  std::fill(mix.begin(), mix.end(), 0);
+
+  std::stringstream items(value);
+  std::string item;
+  while (std::getline(items, item, ','))
+  {
+    size_t colon = item.find(':');
+    std::string name = item.substr(0, colon);
+    int weight = (colon == std::string::npos) ? 1 : std::atoi(item.c_str() + colon + 1);
+
+    auto found = std::find_if(std::begin(_action_names), std::end(_action_names), [&name](const char* action) { return name == action; });
+    if (found == std::end(_action_names) || weight < 0)
+      return false;
+    mix[found - std::begin(_action_names)] += weight;
+  }
+
+  for (int weight : mix)
+  {
+    if (weight > 0)
+      return true;
+  }
+  return false;
+}
+
+// parse command line
+bool parse_cmd(int argc, char** args, options_t& options)
+{
+  options.mix[(size_t)action_t::ping] = 1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::strcmp(args[i], "-k") == 0)
+    {
+      options.persistent = true;
+      continue;
+    }
+    if (std::strcmp(args[i], "-e") == 0)
+    {
+      options.engine = true;
+      continue;
+    }
+
+    if (i + 1 >= argc)
+      return false;
+
+    if (std::strcmp(args[i], "-h") == 0)
+      options.host = args[++i];
+    else if (std::strcmp(args[i], "-p") == 0)
+      options.port = std::atoi(args[++i]);
+    else if (std::strcmp(args[i], "-c") == 0)
+      options.clients = std::max(std::atoi(args[++i]), 1);
+    else if (std::strcmp(args[i], "-n") == 0)
+      options.requests = std::max(std::atol(args[++i]), 1l);
+    else if (std::strcmp(args[i], "-d") == 0)
+      options.duration = std::max(std::atof(args[++i]), 0.0);
+    else if (std::strcmp(args[i], "-r") == 0)
+      options.rate = std::max(std::atof(args[++i]), 0.0);
+    else if (std::strcmp(args[i], "-q") == 0)
+      options.depth = std::max(std::atoi(args[++i]), 1);
+    else if (std::strcmp(args[i], "-a") == 0)
+    {
+      if (!parse_mix(args[++i], options.mix))
+        return false;
+    }
+    else
+      return false;
+  }
+
+  if (options.requests == 0 && options.duration == 0)
+    options.requests = 1000;
+
+  // the engine keeps its connections and sends the next request on a reply
+  if (options.engine && options.rate > 0)
+    return false;
+
+  return true;
+}
+
+// benchmark client, it runs in its own thread
+class client_t
+{
+public:
+  client_t(const options_t& options, size_t index) : _options(options), _index(index), _random((unsigned int)index + 1)
+  {
+    for (int weight : options.mix)
+      _total_weight += weight;
+  }
+
+  // send requests up to the limits
+  void run(clock_type::time_point start)
+  {
+    clock_type::time_point deadline = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(_options.duration));
+
+    // each client keeps its share of the rate, schedules of clients are shifted
+    clock_type::duration interval = clock_type::duration::zero();
+    clock_type::time_point scheduled = start;
+    if (_options.rate > 0)
+    {
+      interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(_options.clients / _options.rate));
+      scheduled += interval * (long long)_index / _options.clients;
+    }
+
+    for (long n = 0; _options.requests == 0 || n < _options.requests; n++)
+    {
+      if (_options.rate > 0)
+      {
+        // open loop, a late request is sent at once and its latency keeps the delay
+        std::this_thread::sleep_until(scheduled);
+      }
+      else
+      {
+        scheduled = clock_type::now();
+      }
+
+      if (_options.duration > 0 && scheduled >= deadline)
+        break;
+
+      size_t action = next_action();
+      if (_options.depth > 0)
+      {
+        pipeline((action_t)action, scheduled);
+      }
+      else
+      {
+        try
+        {
+          request((action_t)action);
+          uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - scheduled).count();
+          _results.latency[action].record(ns);
+        }
+        catch (std::exception&)
+        {
+          _results.errors[action]++;
+          _connected = false;
+        }
+      }
+
+      scheduled += interval;
+    }
+
+    _clnapi.close();
+    // results are recorded by the event loop, they are whole after it is stopped
+    _async.flush();
+    _async.close();
+  }
+
+  // get measured results
+  const results_t& results() const
+  {
+    return _results;
+  }
+
+private:
+  // pick next action by the mix weights
+  size_t next_action()
+  {
+    int value = std::uniform_int_distribution<int>(0, _total_weight - 1)(_random);
+    for (size_t i = 0; i < _ACTIONS; i++)
+    {
+      value -= _options.mix[i];
+      if (value < 0)
+        return i;
+    }
+    return 0;
+  }
+
+  // do the request on the kept connection or on a new one
+  void request(action_t action)
+  {
+    if (_options.persistent && _connected)
+    {
+      // the server may close the connection after a reply, the request is repeated on a new one then
+      try
+      {
+        send(action);
+        return;
+      }
+      catch (std::exception&)
+      {
+        _connected = false;
+      }
+    }
+
+    _clnapi.close();
+    _clnapi.connect(_options.host, _options.port);
+    _connected = true;
+    _results.connects++;
+
+    send(action);
+    if (!_options.persistent)
+    {
+      _clnapi.close();
+      _connected = false;
+    }
+  }
+
+  // queue the request when the pipeline has room, its reply is recorded by the event loop
+  void pipeline(action_t action, clock_type::time_point scheduled)
+  {
+    {
+      std::unique_lock<std::mutex> lck(_mtx);
+      _room.wait(lck, [this] { return _in_flight < _options.depth; });
+      _in_flight++;
+    }
+
+    // the reply handler, it is called with the reply or with the error of the connection
+    auto reply = [this, action, scheduled](auto, std::exception_ptr error)
+    {
+      uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - scheduled).count();
+
+      // a failed connect is recorded by the client thread, so the results are locked
+      std::lock_guard<std::mutex> lck(_mtx);
+      if (error)
+        _results.errors[(size_t)action]++;
+      else
+        _results.latency[(size_t)action].record(ns);
+      _in_flight--;
+      _room.notify_one();
+    };
+
+    try
+    {
+      // a broken connection fails its pending requests, a new one is opened for next requests
+      if (!_async.connected())
+      {
+        _async.connect(_options.host, _options.port);
+        _results.connects++;
+      }
+
+      switch (action)
+      {
+      case action_t::ping:
+        _async.ping(0x1010101010101010, reply);
+        break;
+      case action_t::time:
+        _async.gettime(reply);
+        break;
+      case action_t::echo:
+        _async.sendmsg("hello, csnet", reply);
+        break;
+      case action_t::calc:
+        _async.calculate("2*(3+4)-5/2", reply);
+        break;
+      }
+    }
+    catch (std::exception&)
+    {
+      reply(0, std::current_exception());
+    }
+  }
+
+  // send the request and receive the reply
+  void send(action_t action)
+  {
+    switch (action)
+    {
+    case action_t::ping:
+      _clnapi.ping(0x1010101010101010);
+      break;
+    case action_t::time:
+      _clnapi.gettime();
+      break;
+    case action_t::echo:
+      _clnapi.sendmsg("hello, csnet");
+      break;
+    case action_t::calc:
+      _clnapi.calculate("2*(3+4)-5/2");
+      break;
+    }
+  }
+
+private:
+  const options_t& _options;
+  size_t _index;
+  std::mt19937 _random;
+  int _total_weight = 0;
+  clnapi_t _clnapi;
+  bool _connected = false;
+  results_t _results;
+  // pipelined requests
+  async_clnapi_t _async;
+  std::mutex _mtx;
+  std::condition_variable _room;
+  int _in_flight = 0;
+};
+
+#ifndef _WIN32
+// benchmark of all clients on one event engine thread, each client is a connection of the engine
+// requests are sent and recorded by the event loop, so the results are not locked
+class engine_bench_t
+{
+public:
+  engine_bench_t(const options_t& options) : _options(options), _clients(options.clients), _random(1)
+  {
+    for (int weight : options.mix)
+      _total_weight += weight;
+  }
+
+  // connect all clients and send requests up to the limits
+  void run(clock_type::time_point start)
+  {
+    _deadline = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(_options.duration));
+
+    _engine.start();
+    // the handler may run before connect() returns, so the loop keeps the id
+    for (size_t i = 0; i < _clients.size(); i++)
+      _engine.connect(_options.host, _options.port, [this, i](engine_clnapi_t::connection_id_t id, std::exception_ptr error) { connected(i, id, error); });
+
+    {
+      std::unique_lock<std::mutex> lck(_mtx);
+      _finished.wait(lck, [this] { return _done == _clients.size(); });
+    }
+    _engine.stop();
+  }
+
+  // get measured results
+  const results_t& results() const
+  {
+    return _results;
+  }
+
+private:
+  // state of a client
+  struct client_state_t
+  {
+    engine_clnapi_t::connection_id_t id = 0;
+    long sent = 0;
+    int in_flight = 0;
+    bool failed = false;
+    bool done = false;
+  };
+
+  // the client is connected, fill its pipeline
+  void connected(size_t index, engine_clnapi_t::connection_id_t id, std::exception_ptr error)
+  {
+    _clients[index].id = id;
+    if (error)
+    {
+      _results.errors[next_action()]++;
+      finish(index);
+      return;
+    }
+
+    _results.connects++;
+    for (int i = 0; i < std::max(_options.depth, 1); i++)
+      send(index);
+    if (_clients[index].in_flight == 0)
+      finish(index);
+  }
+
+  // send next request of the client if it is in the limits
+  void send(size_t index)
+  {
+    client_state_t& client = _clients[index];
+    if (client.failed || (_options.requests > 0 && client.sent >= _options.requests))
+      return;
+
+    clock_type::time_point scheduled = clock_type::now();
+    if (_options.duration > 0 && scheduled >= _deadline)
+      return;
+
+    action_t action = (action_t)next_action();
+    client.sent++;
+    client.in_flight++;
+
+    // the reply handler, a broken connection fails all requests of the client
+    auto reply = [this, index, action, scheduled](auto, std::exception_ptr error)
+    {
+      client_state_t& client = _clients[index];
+      if (error)
+      {
+        _results.errors[(size_t)action]++;
+        client.failed = true;
+      }
+      else
+      {
+        _results.latency[(size_t)action].record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - scheduled).count());
+      }
+
+      client.in_flight--;
+      send(index);
+      if (client.in_flight == 0)
+        finish(index);
+    };
+
+    switch (action)
+    {
+    case action_t::ping:
+      _engine.ping(client.id, 0x1010101010101010, reply);
+      break;
+    case action_t::time:
+      _engine.gettime(client.id, reply);
+      break;
+    case action_t::echo:
+      _engine.sendmsg(client.id, "hello, csnet", reply);
+      break;
+    case action_t::calc:
+      _engine.calculate(client.id, "2*(3+4)-5/2", reply);
+      break;
+    }
+  }
+
+  // the client has sent all its requests, close its connection
+  void finish(size_t index)
+  {
+    client_state_t& client = _clients[index];
+    if (client.done)
+      return;
+    client.done = true;
+    _engine.close(client.id);
+
+    std::lock_guard<std::mutex> lck(_mtx);
+    _done++;
+    _finished.notify_one();
+  }
+
+  // pick next action by the mix weights
+  size_t next_action()
+  {
+    int value = std::uniform_int_distribution<int>(0, _total_weight - 1)(_random);
+    for (size_t i = 0; i < _ACTIONS; i++)
+    {
+      value -= _options.mix[i];
+      if (value < 0)
+        return i;
+    }
+    return 0;
+  }
+
+private:
+  const options_t& _options;
+  std::vector<client_state_t> _clients;
+  std::mt19937 _random;
+  int _total_weight = 0;
+  clock_type::time_point _deadline;
+  engine_clnapi_t _engine;
+  results_t _results;
+  std::mutex _mtx;
+  std::condition_variable _finished;
+  size_t _done = 0;
+};
+#endif
+
+// print percentiles of the histogram in us
+void print_latency(const std::string& name, const histogram_t& latency, uint64_t errors, double elapsed)
+{
+  std::cout << std::left << std::setw(8) << name << std::right << std::setw(10) << latency.count() << std::setw(8) << errors
+    << std::setw(12) << latency.count() / elapsed << std::setw(10) << latency.percentile(50) / 1000.0
+    << std::setw(10) << latency.percentile(90) / 1000.0 << std::setw(10) << latency.percentile(99) / 1000.0
+    << std::setw(10) << latency.percentile(99.9) / 1000.0 << std::setw(10) << latency.max() / 1000.0 << std::endl;
+}
+
+int main(int argc, char** args)
+{
+  options_t options;
+  if (!parse_cmd(argc, args, options))
+  {
+    usage();
+    return -1;
+  }
+
+#ifndef _WIN32
+  // a kept connection may be closed by the server, the error is handled by the client
+  std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+  results_t total;
+  clock_type::time_point start;
+  if (options.engine)
+  {
+#ifdef _WIN32
+    std::cerr << "The event engine is supported in Linux only" << std::endl;
+    return -1;
+#else
+    // each connection takes a file
+    size_t limit = client_engine_t::raise_files_limit(options.clients);
+    if (limit < (size_t)options.clients)
+      std::cerr << "Warning: the limit of open files is " << limit << ", some connections fail" << std::endl;
+
+    engine_bench_t bench(options);
+    start = clock_type::now();
+    bench.run(start);
+    total = bench.results();
+#endif
+  }
+  else
+  {
+    std::vector<std::unique_ptr<client_t>> clients;
+    for (int i = 0; i < options.clients; i++)
+      clients.emplace_back(new client_t(options, i));
+
+    start = clock_type::now();
+
+    std::vector<std::thread> threads;
+    for (auto& client : clients)
+      threads.emplace_back(&client_t::run, client.get(), start);
+    for (std::thread& thread : threads)
+      thread.join();
+
+    for (auto& client : clients)
+      total.merge(client->results());
+  }
+
+  std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+  histogram_t all;
+  uint64_t errors = 0;
+  for (size_t i = 0; i < _ACTIONS; i++)
+  {
+    all.merge(total.latency[i]);
+    errors += total.errors[i];
+  }
+
+  std::cout << "mode: " << (options.rate > 0 ? "open loop" : "closed loop") << ", clients: " << options.clients
+    << ", connections: " << (options.engine ? "event engine" : options.depth > 0 ? "pipelined" : options.persistent ? "persistent" : "per request") << ", opened: " << total.connects << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  if (options.rate > 0)
+    std::cout << "target rate: " << options.rate << " req/s" << std::endl;
+  std::cout << "requests: " << all.count() << ", errors: " << errors << ", elapsed: " << elapsed.count() << " s" << std::endl;
+  std::cout << "throughput: " << all.count() / elapsed.count() << " req/s" << std::endl;
+
+  std::cout << std::left << std::setw(8) << "action" << std::right << std::setw(10) << "requests" << std::setw(8) << "errors"
+    << std::setw(12) << "req/s" << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us"
+    << std::setw(10) << "p99.9 us" << std::setw(10) << "max us" << std::endl;
+  for (size_t i = 0; i < _ACTIONS; i++)
+  {
+    if (options.mix[i] > 0)
+      print_latency(_action_names[i], total.latency[i], total.errors[i], elapsed.count());
+  }
+  print_latency("all", all, errors, elapsed.count());
+
+  return errors ? 1 : 0;
+}
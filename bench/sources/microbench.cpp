@@ -0,0 +1,398 @@
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <filesystem>
+
+#include "packsock.h"
+#include "logger.h"
+#include "cfgparser.h"
+#include "expression.h"
+#include "threadpool.h"
+#include "myservice.h"
+#include "memtransport.h"
+
+using namespace csnet;
+using namespace csnet::shared;
+
+typedef std::chrono::steady_clock clock_type;
+
+// bump it when benchmarks or their inputs are changed, results of different versions are not comparable
+static constexpr int _VERSION = 2;
+
+// min time of a measured batch and count of batches
+static constexpr std::chrono::milliseconds _BATCH_TIME{ 10 };
+static constexpr size_t _BATCHES = 7;
+
+// keeps results alive, so the compiler does not drop measured code
+static volatile double _sink = 0;
+
+// result of a benchmark
+struct result_t
+{
+  std::string name;
+  uint64_t iterations = 0; // per batch
+  double ns_per_op = 0; // median of batches
+  double min_ns_per_op = 0;
+  double max_ns_per_op = 0;
+};
+
+// benchmark body runs the measured operation 'iterations' times
+typedef std::function<void(uint64_t iterations)> body_t;
+
+// print usage
+void usage()
+{
+  std::cout << "Usage: csnet-microbench [-o file.json] [-f filter]" << std::endl
+    << "  -o  write results as JSON to the file, stdout if not set" << std::endl
+    << "  -f  run benchmarks with the substring in the name only" << std::endl;
+}
+
+// run the body in batches of at least _BATCH_TIME, return ns per operation
+result_t measure(const std::string& name, const body_t& body)
+{
+  // warm up and find iterations count of a batch
+  uint64_t iterations = 1;
+  for (;;)
+  {
+    clock_type::time_point begin = clock_type::now();
+    body(iterations);
+    if (clock_type::now() - begin >= _BATCH_TIME || iterations >= (1ull << 32))
+      break;
+    iterations *= 2;
+  }
+
+  std::vector<double> samples;
+  for (size_t i = 0; i < _BATCHES; i++)
+  {
+    clock_type::time_point begin = clock_type::now();
+    body(iterations);
+    std::chrono::duration<double, std::nano> elapsed = clock_type::now() - begin;
+    samples.push_back(elapsed.count() / iterations);
+  }
+  std::sort(samples.begin(), samples.end());
+
+  result_t result;
+  result.name = name;
+  result.iterations = iterations;
+  result.ns_per_op = samples[samples.size() / 2];
+  result.min_ns_per_op = samples.front();
+  result.max_ns_per_op = samples.back();
+  return result;
+}
+
+// packet_socket_t encode, send, receive and decode of a text packet over a local socket pair
+body_t packet_body(size_t text_size)
+{
+#ifdef _WIN32
+  throw std::runtime_error("socket pair is not supported");
+#else
+  int fds[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    throw std::runtime_error("Cannot create socket pair");
+
+  std::shared_ptr<packet_socket_t> writer(new packet_socket_t(fds[0]));
+  std::shared_ptr<packet_socket_t> reader(new packet_socket_t(fds[1]));
+  std::string text(text_size, 'x');
+
+  return [writer, reader, text](uint64_t iterations)
+  {
+    packet_info_t packet(packet_kind::P_BASE_KIND, packet_type::P_TEXT_TYPE, packet_code::P_ECHO_ACTION);
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+      if (!writer->send(packet, text))
+        throw std::runtime_error("Cannot send packet");
+      std::unique_ptr<packet_info_t> received(reader->receive());
+      if (!received)
+        throw std::runtime_error("Cannot receive packet");
+      _sink = received->size;
+    }
+  };
+#endif
+}
+
+// parse of a calculator request like the client sends
+body_t parse_body(const std::string& input)
+{
+  return [input](uint64_t iterations)
+  {
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+      parser_t parser(input);
+      _sink = (double)parser.parse().args.size();
+    }
+  };
+}
+
+// evaluation of a parsed calculator request
+body_t eval_body(const std::string& input)
+{
+  std::shared_ptr<expression_t> expression(new expression_t(parser_t(input).parse()));
+  return [expression](uint64_t iterations)
+  {
+    for (uint64_t i = 0; i < iterations; i++)
+      _sink = expression_t::eval(*expression);
+  };
+}
+
+// logout of a typical request line, the log file is opened by the caller
+body_t logout_body()
+{
+  return [](uint64_t iterations)
+  {
+    for (uint64_t i = 0; i < iterations; i++)
+      logger_t::instance()->logout("Request 'echo' from 127.0.0.1:52114 is served in 42 us.");
+  };
+}
+
+// write a config like server.cfg with the looked up key in the last section
+void make_cfg(const std::string& filename)
+{
+  std::ofstream out(filename, std::ios::out | std::ios::trunc);
+  const char* sections[] = { "connect", "log", "pool", "debug", "limits" };
+  for (const char* section : sections)
+  {
+    out << "[" << section << "]" << std::endl;
+    for (int i = 0; i < 8; i++)
+    {
+      out << "# a comment of the " << section << " setting " << i << std::endl;
+      out << section << "_setting_" << i << " = " << i * 100 << std::endl;
+    }
+    out << std::endl;
+  }
+  if (!out)
+    throw std::runtime_error("Cannot write config file \"" + filename + "\"");
+}
+
+// get_value of a key in the last section, the file is scanned on each call
+body_t get_value_body(const std::string& filename)
+{
+  std::shared_ptr<cfgparser_t> parser(new cfgparser_t(filename));
+  return [parser](uint64_t iterations)
+  {
+    for (uint64_t i = 0; i < iterations; i++)
+      _sink = (double)parser->get_value("limits", "limits_setting_7").size();
+  };
+}
+
+// enqueue of empty tasks while workers take them, like the accept loop does
+body_t enqueue_body(std::shared_ptr<thread_pool_t> pool)
+{
+  return [pool](uint64_t iterations)
+  {
+    for (uint64_t i = 0; i < iterations; i++)
+      pool->enqueue([]() {});
+  };
+}
+
+// enqueue of an empty task and wait for its result, it is a round trip through a worker
+body_t enqueue_get_body(std::shared_ptr<thread_pool_t> pool)
+{
+  return [pool](uint64_t iterations)
+  {
+    for (uint64_t i = 0; i < iterations; i++)
+      _sink = pool->enqueue([]() { return 1; }).get();
+  };
+}
+
+// dispatch of a request frame to the service by the in-memory transport, there are no sockets
+body_t dispatch_body(std::function<std::vector<int8_t>(const memory_transport_t&)> make)
+{
+  std::shared_ptr<myservice_t> service(new myservice_t());
+  std::shared_ptr<dispatcher_t> dispatcher(new dispatcher_t(*service));
+  std::shared_ptr<memory_transport_t> transport(new memory_transport_t(*dispatcher));
+  std::vector<int8_t> frame = make(*transport);
+
+  return [service, dispatcher, transport, frame](uint64_t iterations)
+  {
+    for (uint64_t i = 0; i < iterations; i++)
+      _sink = (double)transport->request(frame).size();
+  };
+}
+
+// escape a string for JSON
+std::string json_string(const std::string& value)
+{
+  std::string escaped = "\"";
+  for (char c : value)
+  {
+    if (c == '"' || c == '\\')
+      escaped += '\\';
+    escaped += c;
+  }
+  return escaped + "\"";
+}
+
+// write results as JSON
+void write_json(std::ostream& out, const std::vector<result_t>& results)
+{
+  std::time_t now = std::time(nullptr);
+  char timestamp[32];
+  std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+#if defined(__clang__)
+  std::string compiler = std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+  std::string compiler = std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+  std::string compiler = "msvc " + std::to_string(_MSC_VER);
+#else
+  std::string compiler = "unknown";
+#endif
+
+  out << "{" << std::endl;
+  out << "  \"version\": " << _VERSION << "," << std::endl;
+  out << "  \"timestamp\": " << json_string(timestamp) << "," << std::endl;
+  out << "  \"compiler\": " << json_string(compiler) << "," << std::endl;
+  out << "  \"benchmarks\": [";
+  out << std::fixed << std::setprecision(2);
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const result_t& result = results[i];
+    out << (i ? "," : "") << std::endl << "    { \"name\": " << json_string(result.name)
+      << ", \"iterations\": " << result.iterations << ", \"ns_per_op\": " << result.ns_per_op
+      << ", \"min_ns_per_op\": " << result.min_ns_per_op << ", \"max_ns_per_op\": " << result.max_ns_per_op << " }";
+  }
+  out << std::endl << "  ]" << std::endl << "}" << std::endl;
+}
+
+int main(int argc, char** args)
+{
+  std::string output, filter;
+  for (int i = 1; i < argc; i++)
+  {
+    if (i + 1 < argc && std::strcmp(args[i], "-o") == 0)
+      output = args[++i];
+    else if (i + 1 < argc && std::strcmp(args[i], "-f") == 0)
+      filter = args[++i];
+    else
+    {
+      usage();
+      return -1;
+    }
+  }
+
+  // temp files are not left in the current dir
+  std::filesystem::path temp = std::filesystem::temp_directory_path();
+  std::string log_file = (temp / "csnet-microbench.log").string();
+  std::string cfg_file = (temp / "csnet-microbench.cfg").string();
+
+  const std::string calc_short = "2*(3+4)-5/2";
+  const std::string calc_long = "abs(sin(0.5)*cos(0.25)-(12.5 mod 4)**2)/(3+4*(2-1)-7/(1+1))+100";
+
+  std::vector<std::pair<std::string, std::function<body_t()>>> benchmarks =
+  {
+#ifndef _WIN32
+    { "packet/text_64", []() { return packet_body(64); } },
+    { "packet/text_1k", []() { return packet_body(1024); } },
+#endif
+    { "expression/parse_short", [&]() { return parse_body(calc_short); } },
+    { "expression/parse_long", [&]() { return parse_body(calc_long); } },
+    { "expression/eval_short", [&]() { return eval_body(calc_short); } },
+    { "expression/eval_long", [&]() { return eval_body(calc_long); } },
+    { "logger/logout", [&]()
+      {
+        logger_t::instance()->close();
+        if (!logger_t::instance()->open(log_file))
+          throw std::runtime_error("Cannot open log file \"" + log_file + "\"");
+        return logout_body();
+      } },
+    { "logger/logout_async", [&]()
+      {
+        logger_t::instance()->close();
+        if (!logger_t::instance()->open(log_file))
+          throw std::runtime_error("Cannot open log file \"" + log_file + "\"");
+        logger_t::instance()->start_async(65536, 100, 65536);
+        return logout_body();
+      } },
+    { "cfgparser/get_value", [&]() { make_cfg(cfg_file); return get_value_body(cfg_file); } },
+    { "dispatch/ping", []()
+      {
+        uint64_t data = 0x1010101010101010;
+        return dispatch_body([data](const memory_transport_t& transport) { return transport.make_frame(packet_code::P_PING_ACTION, &data, sizeof(data)); });
+      } },
+    { "dispatch/echo_1k", []()
+      {
+        return dispatch_body([](const memory_transport_t& transport) { return transport.make_frame(packet_code::P_ECHO_ACTION, std::string(1024, 'e')); });
+      } },
+    { "dispatch/calc", [&]()
+      {
+        return dispatch_body([&](const memory_transport_t& transport) { return transport.make_frame(packet_code::P_CALC_ACTION, calc_short); });
+      } },
+    { "dispatch/batch_calc_8", [&]()
+      {
+        // the batch is dispatched by this thread, it is the split and join cost of a batch
+        return dispatch_body([&](const memory_transport_t& transport)
+        {
+          std::vector<int8_t> requests;
+          for (int i = 0; i < 8; i++)
+          {
+            std::vector<int8_t> frame = transport.make_frame(packet_code::P_CALC_ACTION, calc_short);
+            requests.insert(requests.end(), frame.begin(), frame.end());
+          }
+          return transport.make_frame(packet_code::P_BATCH_ACTION, requests.data(), requests.size());
+        });
+      } },
+    { "threadpool/enqueue", []() { return enqueue_body(std::make_shared<thread_pool_t>(2)); } },
+    { "threadpool/enqueue_get", []() { return enqueue_get_body(std::make_shared<thread_pool_t>(2)); } }
+  };
+
+  std::vector<result_t> results;
+  size_t failed = 0;
+  for (const auto& benchmark : benchmarks)
+  {
+    if (benchmark.first.find(filter) == std::string::npos)
+      continue;
+
+    try
+    {
+      result_t result = measure(benchmark.first, benchmark.second());
+      results.push_back(result);
+      std::cerr << std::left << std::setw(28) << result.name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(12) << result.ns_per_op << " ns/op" << std::endl;
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << benchmark.first << " failed: " << e.what() << std::endl;
+      failed++;
+    }
+
+    logger_t::instance()->stop_async();
+    logger_t::instance()->close();
+  }
+
+  std::remove(log_file.c_str());
+  std::remove(cfg_file.c_str());
+
+  if (output.empty())
+  {
+    write_json(std::cout, results);
+  }
+  else
+  {
+    std::ofstream out(output, std::ios::out | std::ios::trunc);
+    write_json(out, results);
+    if (!out)
+    {
+      std::cerr << "Cannot write \"" << output << "\"" << std::endl;
+      return -1;
+    }
+  }
+
+  return failed ? 1 : 0;
+}
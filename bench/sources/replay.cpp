@@ -0,0 +1,261 @@
+#include <stdexcept>
+#include <csignal>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+
+#include "packsock.h"
+#include "histogram.h"
+#include "capture.h"
+
+using namespace csnet;
+using namespace csnet::shared;
+
+typedef std::chrono::steady_clock clock_type;
+
+// actions are indexed by packet_code, unknown ones share the first slot
+static const char* _action_names[] = { "unknown", "echo", "time", "execmd", "credentials", "ping", "calc", "stats", "trace", "batch" };
+static constexpr size_t _ACTIONS = sizeof(_action_names) / sizeof(_action_names[0]);
+static constexpr int _CONNECT_TIMEOUT = 3000; // time in ms to wait an answer of the server addresses
+
+// replay options
+struct options_t
+{
+  std::string host = "127.0.0.1";
+  int port = 3425;
+  int threads = 16; // connections replayed at once
+  double speed = 1; // 2 - twice faster, 0 - as fast as possible
+  std::string capture;
+};
+
+// frames of a captured connection
+struct connection_t
+{
+  uint64_t start = 0; // ns of the first frame from the capture start
+  std::vector<const capture_t::frame_t*> frames;
+};
+
+// measured results of a thread or all threads
+struct results_t
+{
+  std::vector<histogram_t> latency = std::vector<histogram_t>(_ACTIONS); // ns
+  std::vector<uint64_t> errors = std::vector<uint64_t>(_ACTIONS, 0);
+
+  // add results of other thread
+  void merge(const results_t& rhs)
+  {
+    for (size_t i = 0; i < _ACTIONS; i++)
+    {
+      latency[i].merge(rhs.latency[i]);
+      errors[i] += rhs.errors[i];
+    }
+  }
+};
+
+// print usage
+void usage()
+{
+  std::cout << "Usage: csnet-replay [-h host] [-p port] [-c connections] [-s speed] capture" << std::endl
+    << "  -c  connections replayed at once, a late connection keeps its delay in the latency (16 by default)" << std::endl
+    << "  -s  replay speed, 1 keeps captured gaps, 2 halves them, 0 sends as fast as possible" << std::endl;
+}
+
+// parse command line
+bool parse_cmd(int argc, char** args, options_t& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    if (args[i][0] != '-' && options.capture.empty())
+    {
+      options.capture = args[i];
+      continue;
+    }
+
+    if (i + 1 >= argc)
+      return false;
+
+    if (std::strcmp(args[i], "-h") == 0)
+      options.host = args[++i];
+    else if (std::strcmp(args[i], "-p") == 0)
+      options.port = std::atoi(args[++i]);
+    else if (std::strcmp(args[i], "-c") == 0)
+      options.threads = std::max(std::atoi(args[++i]), 1);
+    else if (std::strcmp(args[i], "-s") == 0)
+      options.speed = std::max(std::atof(args[++i]), 0.0);
+    else
+      return false;
+  }
+
+  return !options.capture.empty();
+}
+
+// get action slot of a frame
+size_t action_of(const capture_t::frame_t& frame)
+{
+  const packet_info_t* packet = reinterpret_cast<const packet_info_t*>(frame.data.data());
+  size_t action = (uint16_t)packet->action & ~(uint16_t)packet_code::P_RETURN_ACTION;
+  return action < _ACTIONS ? action : 0;
+}
+
+// replay connections taken by index, each one on its own socket
+void replay(const options_t& options, const std::vector<connection_t>& connections, std::atomic<size_t>& next,
+  clock_type::time_point begin, results_t& results)
+{
+  auto scheduled = [&options, begin](uint64_t time)
+  {
+    return options.speed > 0 ? begin + std::chrono::nanoseconds((int64_t)(time / options.speed)) : clock_type::now();
+  };
+
+  for (size_t index = next++; index < connections.size(); index = next++)
+  {
+    const connection_t& connection = connections[index];
+
+    packet_socket_t socket;
+    bool connected = false;
+    for (const capture_t::frame_t* frame : connection.frames)
+    {
+      size_t action = action_of(*frame);
+      clock_type::time_point at = scheduled(frame->time);
+      std::this_thread::sleep_until(at);
+
+      if (!connected)
+      {
+        connected = socket.connect(options.host, options.port, _CONNECT_TIMEOUT);
+        if (!connected)
+        {
+          // the rest of the connection is lost
+          results.errors[action]++;
+          break;
+        }
+      }
+
+      std::unique_ptr<packet_info_t> reply;
+      if (socket.send(reinterpret_cast<const packet_info_t*>(frame->data.data())))
+        reply.reset(socket.receive());
+      if (!reply)
+      {
+        results.errors[action]++;
+        break;
+      }
+      results.latency[action].record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - at).count());
+    }
+  }
+}
+
+// print percentiles of the histogram in us
+void print_latency(const std::string& name, const histogram_t& latency, uint64_t errors, double elapsed)
+{
+  std::cout << std::left << std::setw(12) << name << std::right << std::setw(10) << latency.count() << std::setw(8) << errors
+    << std::setw(12) << latency.count() / elapsed << std::setw(10) << latency.percentile(50) / 1000.0
+    << std::setw(10) << latency.percentile(90) / 1000.0 << std::setw(10) << latency.percentile(99) / 1000.0
+    << std::setw(10) << latency.percentile(99.9) / 1000.0 << std::setw(10) << latency.max() / 1000.0 << std::endl;
+}
+
+int main(int argc, char** args)
+{
+  options_t options;
+  if (!parse_cmd(argc, args, options))
+  {
+    usage();
+    return -1;
+  }
+
+#ifndef _WIN32
+  // the server may close a connection before all frames are replayed
+  std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+  std::vector<capture_t::frame_t> frames;
+  try
+  {
+    frames = capture_t::read(options.capture);
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "Error occurred: " << e.what() << std::endl;
+    return -1;
+  }
+
+  // keep connection structure, frames of a connection are replayed in order on one socket
+  std::map<uint64_t, connection_t> grouped;
+  for (const capture_t::frame_t& frame : frames)
+  {
+    connection_t& connection = grouped[frame.connection];
+    if (connection.frames.empty())
+      connection.start = frame.time;
+    connection.frames.push_back(&frame);
+  }
+
+  std::vector<connection_t> connections;
+  for (auto& connection : grouped)
+    connections.push_back(std::move(connection.second));
+  std::stable_sort(connections.begin(), connections.end(), [](const connection_t& lhs, const connection_t& rhs) { return lhs.start < rhs.start; });
+
+  if (connections.empty())
+  {
+    std::cerr << "There are no frames in the capture." << std::endl;
+    return -1;
+  }
+
+  // the first connection starts at once
+  uint64_t origin = connections.front().start;
+  for (capture_t::frame_t& frame : frames)
+    frame.time = frame.time > origin ? frame.time - origin : 0;
+
+  std::atomic<size_t> next{ 0 };
+  std::vector<results_t> results(options.threads);
+  clock_type::time_point begin = clock_type::now();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.threads; i++)
+    threads.emplace_back(replay, std::cref(options), std::cref(connections), std::ref(next), begin, std::ref(results[i]));
+  for (std::thread& thread : threads)
+    thread.join();
+
+  std::chrono::duration<double> elapsed = clock_type::now() - begin;
+
+  results_t total;
+  for (const results_t& result : results)
+    total.merge(result);
+
+  histogram_t all;
+  uint64_t errors = 0;
+  for (size_t i = 0; i < _ACTIONS; i++)
+  {
+    all.merge(total.latency[i]);
+    errors += total.errors[i];
+  }
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "capture: " << options.capture << ", connections: " << connections.size() << ", frames: " << frames.size()
+    << ", span: " << (frames.empty() ? 0 : std::max_element(frames.begin(), frames.end(),
+      [](const capture_t::frame_t& lhs, const capture_t::frame_t& rhs) { return lhs.time < rhs.time; })->time / 1e9) << " s" << std::endl;
+  if (options.speed > 0)
+    std::cout << "speed: " << options.speed << "x";
+  else
+    std::cout << "speed: max";
+  std::cout << ", connections at once: " << options.threads << std::endl;
+  std::cout << "frames: " << all.count() << ", errors: " << errors << ", elapsed: " << elapsed.count() << " s" << std::endl;
+  std::cout << "throughput: " << all.count() / elapsed.count() << " req/s" << std::endl;
+
+  std::cout << std::left << std::setw(12) << "action" << std::right << std::setw(10) << "requests" << std::setw(8) << "errors"
+    << std::setw(12) << "req/s" << std::setw(10) << "p50 us" << std::setw(10) << "p90 us" << std::setw(10) << "p99 us"
+    << std::setw(10) << "p99.9 us" << std::setw(10) << "max us" << std::endl;
+  for (size_t i = 0; i < _ACTIONS; i++)
+  {
+    if (total.latency[i].count() || total.errors[i])
+      print_latency(_action_names[i], total.latency[i], total.errors[i], elapsed.count());
+  }
+  print_latency("all", all, errors, elapsed.count());
+
+  return errors ? 1 : 0;
+}
@@ -11,6 +11,8 @@ P=$(dirname $0);
 
 $P/build-server.sh
 $P/build-client.sh
+$P/build-bench.sh
+$P/build-logdecode.sh
 
 #restore current dir
 cd $CD
@@ -0,0 +1,26 @@
+echo ============== BUILD BENCH ===============
+
+#save current dir
+CD=`pwd`
+
+#save related script dir
+P=$(dirname $0);
+
+#set the dir
+cd $P
+
+echo build bench
+
+if [ ! -d ./bench/build/ ]; then
+    mkdir ./bench/build
+fi
+
+cd ./bench/build
+cmake ..
+make
+
+#restore current dir
+cd $CD
+
+
+
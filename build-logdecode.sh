@@ -0,0 +1,26 @@
+echo ============== BUILD LOGDECODE ===============
+
+#save current dir
+CD=`pwd`
+
+#save related script dir
+P=$(dirname $0);
+
+#set the dir
+cd $P
+
+echo build logdecode
+
+if [ ! -d ./logdecode/build/ ]; then
+    mkdir ./logdecode/build
+fi
+
+cd ./logdecode/build
+cmake ..
+make
+
+#restore current dir
+cd $CD
+
+
+
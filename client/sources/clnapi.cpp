@@ -1,4 +1,5 @@
 #include "cstring"
+#include <algorithm>
 
 #include "clnapi.h"
 
@@ -7,6 +8,34 @@ namespace csnet
 
   using namespace shared;
 
+  // reply handler of the asynchronous wrappers
+  typedef std::function<void(const packet_info_t* reply, std::exception_ptr error)> reply_handler_t;
+
+  // reply handler which decodes a data reply to the value, it is zero on error
+  template <typename T>
+  static reply_handler_t decode_value(std::function<void(T result, std::exception_ptr error)> callback)
+  {
+    return [callback](const packet_info_t* reply, std::exception_ptr error)
+    {
+      T result = 0;
+      if (reply)
+      {
+        const packet_data_t* packet = static_cast<const packet_data_t*>(reply);
+        std::memcpy(&result, packet->data, std::min(sizeof(T), (size_t)packet->size_data()));
+      }
+      callback(result, error);
+    };
+  }
+
+  // reply handler which decodes a text reply, it is empty on error
+  static reply_handler_t decode_text(std::function<void(std::string result, std::exception_ptr error)> callback)
+  {
+    return [callback](const packet_info_t* reply, std::exception_ptr error)
+    {
+      callback(reply ? std::string(static_cast<const packet_text_t*>(reply)->text) : std::string(), error);
+    };
+  }
+
   clnapi_t::clnapi_t(packet_kind kind) : client_api_t(kind)
   {
   }
@@ -77,4 +106,265 @@ namespace csnet
     // receive response from server
     return receive_reply_text(packet_code::P_CALC_ACTION);
   }
+
+  // get per-action latency statistics from server
+  std::string clnapi_t::getstats() const
+  {
+    // send request to server
+    send(packet_code::P_STATS_ACTION);
+    // receive response from server
+    return receive_reply_text(packet_code::P_STATS_ACTION);
+  }
+
+  // ask server to write its request trace, get the result message
+  std::string clnapi_t::dump_trace() const
+  {
+    // send request to server
+    send(packet_code::P_TRACE_ACTION);
+    // receive response from server
+    return receive_reply_text(packet_code::P_TRACE_ACTION);
+  }
+
+  // send all calls of the batch at once and get their results in the order of calls
+  std::vector<clnapi_t::batch_result_t> clnapi_t::execute(const batch_t& batch) const
+  {
+    std::vector<batch_result_t> results(batch._calls.size());
+    if (results.empty())
+      return results;
+
+    if (sizeof(packet_info_t) + batch._requests.size() > packet_socket_t::MAX_PACKET_SIZE)
+      throw csnet_api_error("Batch is too large");
+
+    // send request to server
+    send(packet_code::P_BATCH_ACTION, batch._requests.data(), batch._requests.size());
+    // receive response from server
+    std::vector<int8_t> data;
+    receive_reply_data(packet_code::P_BATCH_ACTION, data);
+
+    // the reply data are reply packets in the order of calls
+    size_t offset = 0;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      uint16_t size = 0;
+      if (data.size() - offset >= sizeof(size))
+        std::memcpy(&size, data.data() + offset, sizeof(size));
+      if (size < sizeof(packet_info_t) || size > data.size() - offset)
+        throw csnet_api_error("Malformed batch reply");
+
+      const packet_info_t* reply = reinterpret_cast<const packet_info_t*>(data.data() + offset);
+      offset += size;
+
+      batch_result_t& result = results[i];
+      result.action = batch._calls[i].action;
+      if (reply->kind == _kind && reply->type == packet_type::P_ERROR_TYPE)
+        result.error = static_cast<const packet_error_t*>(reply)->error_text;
+      else if (reply->kind != _kind || reply->type != batch._calls[i].type || reply->action != (batch._calls[i].action | packet_code::P_RETURN_ACTION))
+        result.error = "Unknown packet";
+      else if (reply->type == packet_type::P_TEXT_TYPE)
+        result.text = static_cast<const packet_text_t*>(reply)->text;
+      else
+        std::memcpy(&result.value, static_cast<const packet_data_t*>(reply)->data, std::min(sizeof(result.value), (size_t)reply->size_data()));
+    }
+
+    return results;
+  }
+
+  /////////////////////////////////////////////////
+  // batch of calls
+  // add ping call, return index of its result
+  size_t clnapi_t::batch_t::ping(uint64_t data)
+  {
+    return add(packet_type::P_DATA_TYPE, packet_code::P_PING_ACTION, &data, sizeof(data), packet_type::P_DATA_TYPE);
+  }
+
+  // add echo call, return index of its result
+  size_t clnapi_t::batch_t::sendmsg(const std::string& msg)
+  {
+    return add(packet_type::P_TEXT_TYPE, packet_code::P_ECHO_ACTION, msg.c_str(), msg.size() + sizeof(char), packet_type::P_TEXT_TYPE);
+  }
+
+  // add get time call, return index of its result
+  size_t clnapi_t::batch_t::gettime()
+  {
+    return add(packet_type::P_NULL_TYPE, packet_code::P_TIME_ACTION, nullptr, 0, packet_type::P_DATA_TYPE);
+  }
+
+  // add execute command call, return index of its result
+  size_t clnapi_t::batch_t::execmd(const std::string& cmd)
+  {
+    return add(packet_type::P_TEXT_TYPE, packet_code::P_EXECMD_ACTION, cmd.c_str(), cmd.size() + sizeof(char), packet_type::P_TEXT_TYPE);
+  }
+
+  // add calculate call, return index of its result
+  size_t clnapi_t::batch_t::calculate(const std::string& input)
+  {
+    return add(packet_type::P_TEXT_TYPE, packet_code::P_CALC_ACTION, input.c_str(), input.size() + sizeof(char), packet_type::P_TEXT_TYPE);
+  }
+
+  // remove all calls
+  void clnapi_t::batch_t::clear()
+  {
+    _requests.clear();
+    _calls.clear();
+  }
+
+  // add a call by its request packet
+  size_t clnapi_t::batch_t::add(packet_type type, packet_code action, const void* data, size_t size, packet_type reply_type)
+  {
+    std::vector<int8_t> frame;
+    if (!packet_socket_t::encode(packet_info_t(_kind, type, action), data, size, frame))
+      throw csnet_api_error("Packet is too large");
+
+    _requests.insert(_requests.end(), frame.begin(), frame.end());
+    _calls.push_back({ reply_type, action });
+    return _calls.size() - 1;
+  }
+
+  /////////////////////////////////////////////////
+  // asynchronous client net api wrapper
+  async_clnapi_t::async_clnapi_t(packet_kind kind) : async_client_api_t(kind)
+  {
+  }
+
+  async_clnapi_t::~async_clnapi_t()
+  {
+  }
+
+  // check server connection
+  std::future<uint64_t> async_clnapi_t::ping(uint64_t data)
+  {
+    std::shared_ptr<std::promise<uint64_t>> promise = std::make_shared<std::promise<uint64_t>>();
+    std::future<uint64_t> result = promise->get_future();
+    ping(data, promise_callback(promise));
+    return result;
+  }
+
+  // check server connection
+  void async_clnapi_t::ping(uint64_t data, callback_t<uint64_t> callback)
+  {
+    request(packet_type::P_DATA_TYPE, packet_code::P_PING_ACTION, &data, sizeof(data), packet_type::P_DATA_TYPE,
+      decode_value<uint64_t>(std::move(callback)));
+  }
+
+  // send text to echo server and get echo from server
+  std::future<std::string> async_clnapi_t::sendmsg(const std::string& msg)
+  {
+    std::shared_ptr<std::promise<std::string>> promise = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> result = promise->get_future();
+    sendmsg(msg, promise_callback(promise));
+    return result;
+  }
+
+  // send text to echo server and get echo from server
+  void async_clnapi_t::sendmsg(const std::string& msg, callback_t<std::string> callback)
+  {
+    request_text(packet_code::P_ECHO_ACTION, msg, std::move(callback));
+  }
+
+  // send request to server and get current time from server
+  std::future<std::time_t> async_clnapi_t::gettime()
+  {
+    std::shared_ptr<std::promise<std::time_t>> promise = std::make_shared<std::promise<std::time_t>>();
+    std::future<std::time_t> result = promise->get_future();
+    gettime(promise_callback(promise));
+    return result;
+  }
+
+  // send request to server and get current time from server
+  void async_clnapi_t::gettime(callback_t<std::time_t> callback)
+  {
+    request(packet_type::P_NULL_TYPE, packet_code::P_TIME_ACTION, nullptr, 0, packet_type::P_DATA_TYPE,
+      decode_value<std::time_t>(std::move(callback)));
+  }
+
+  // send command to server and get command's result
+  std::future<std::string> async_clnapi_t::execmd(const std::string& cmd)
+  {
+    std::shared_ptr<std::promise<std::string>> promise = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> result = promise->get_future();
+    execmd(cmd, promise_callback(promise));
+    return result;
+  }
+
+  // send command to server and get command's result
+  void async_clnapi_t::execmd(const std::string& cmd, callback_t<std::string> callback)
+  {
+    request_text(packet_code::P_EXECMD_ACTION, cmd, std::move(callback));
+  }
+
+  // send expression to server and get expression result from server
+  std::future<std::string> async_clnapi_t::calculate(const std::string& input)
+  {
+    std::shared_ptr<std::promise<std::string>> promise = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> result = promise->get_future();
+    calculate(input, promise_callback(promise));
+    return result;
+  }
+
+  // send expression to server and get expression result from server
+  void async_clnapi_t::calculate(const std::string& input, callback_t<std::string> callback)
+  {
+    request_text(packet_code::P_CALC_ACTION, input, std::move(callback));
+  }
+
+  // request with a text reply
+  void async_clnapi_t::request_text(packet_code action, const std::string& text, callback_t<std::string> callback)
+  {
+    // the text is sent with its terminating zero
+    request(packet_type::P_TEXT_TYPE, action, text.c_str(), text.size() + sizeof(char), packet_type::P_TEXT_TYPE,
+      decode_text(std::move(callback)));
+  }
+
+#ifndef _WIN32
+  /////////////////////////////////////////////////
+  // event driven client net api wrapper
+  engine_clnapi_t::engine_clnapi_t(packet_kind kind) : client_engine_t(kind)
+  {
+  }
+
+  engine_clnapi_t::~engine_clnapi_t()
+  {
+  }
+
+  // check server connection
+  void engine_clnapi_t::ping(connection_id_t connection, uint64_t data, callback_t<uint64_t> callback)
+  {
+    request(connection, packet_type::P_DATA_TYPE, packet_code::P_PING_ACTION, &data, sizeof(data), packet_type::P_DATA_TYPE,
+      decode_value<uint64_t>(std::move(callback)));
+  }
+
+  // send text to echo server and get echo from server
+  void engine_clnapi_t::sendmsg(connection_id_t connection, const std::string& msg, callback_t<std::string> callback)
+  {
+    request_text(connection, packet_code::P_ECHO_ACTION, msg, std::move(callback));
+  }
+
+  // send request to server and get current time from server
+  void engine_clnapi_t::gettime(connection_id_t connection, callback_t<std::time_t> callback)
+  {
+    request(connection, packet_type::P_NULL_TYPE, packet_code::P_TIME_ACTION, nullptr, 0, packet_type::P_DATA_TYPE,
+      decode_value<std::time_t>(std::move(callback)));
+  }
+
+  // send command to server and get command's result
+  void engine_clnapi_t::execmd(connection_id_t connection, const std::string& cmd, callback_t<std::string> callback)
+  {
+    request_text(connection, packet_code::P_EXECMD_ACTION, cmd, std::move(callback));
+  }
+
+  // send expression to server and get expression result from server
+  void engine_clnapi_t::calculate(connection_id_t connection, const std::string& input, callback_t<std::string> callback)
+  {
+    request_text(connection, packet_code::P_CALC_ACTION, input, std::move(callback));
+  }
+
+  // request with a text reply
+  void engine_clnapi_t::request_text(connection_id_t connection, packet_code action, const std::string& text, callback_t<std::string> callback)
+  {
+    // the text is sent with its terminating zero
+    request(connection, packet_type::P_TEXT_TYPE, action, text.c_str(), text.size() + sizeof(char), packet_type::P_TEXT_TYPE,
+      decode_text(std::move(callback)));
+  }
+#endif
+
 }
@@ -1,8 +1,15 @@
 #pragma once
 
 #include <ctime>
+#include <string>
+#include <vector>
+#include <future>
+#include <memory>
+#include <functional>
 
 #include "csnet_api.h"
+#include "asyncapi.h"
+#include "clnengine.h"
 
 namespace csnet
 {
@@ -12,11 +19,76 @@ namespace csnet
   // client net api wrapper
   class clnapi_t : public shared::client_api_t
   {
+  public:
+    // result of a call of the batch
+    struct batch_result_t
+    {
+      shared::packet_code action = shared::packet_code::P_NO_ACTION;
+      std::string error; // error of the call, it is empty if the call is done
+      std::string text; // reply of sendmsg, execmd and calculate
+      uint64_t value = 0; // reply of ping and gettime
+    };
+
+    // batch of calls, they are sent in one packet and the server replies all of them in one packet
+    class batch_t
+    {
+      friend class clnapi_t;
+
+    public:
+      explicit batch_t(shared::packet_kind kind = shared::packet_kind::P_BASE_KIND) : _kind(kind)
+      {
+      }
+
+    public:
+      // add ping call, return index of its result
+      size_t ping(uint64_t data);
+      // add echo call, return index of its result
+      size_t sendmsg(const std::string& msg);
+      // add get time call, return index of its result
+      size_t gettime();
+      // add execute command call, return index of its result
+      size_t execmd(const std::string& cmd);
+      // add calculate call, return index of its result
+      size_t calculate(const std::string& input);
+      // get count of calls
+      size_t size() const
+      {
+        return _calls.size();
+      }
+      // remove all calls
+      void clear();
+
+    private:
+      // add a call by its request packet
+      size_t add(shared::packet_type type, shared::packet_code action, const void* data, size_t size, shared::packet_type reply_type);
+
+    private:
+      // expected reply of a call
+      struct call_t
+      {
+        shared::packet_type type;
+        shared::packet_code action;
+      };
+
+      shared::packet_kind _kind;
+      std::vector<int8_t> _requests; // whole request packets
+      std::vector<call_t> _calls;
+    };
+
   public:
     clnapi_t(shared::packet_kind kind = shared::packet_kind::P_BASE_KIND);
     virtual ~clnapi_t();
 
   public:
+    // make an empty batch of this api kind
+    batch_t batch() const
+    {
+      return batch_t(_kind);
+    }
+    // send all calls of the batch at once and get their results in the order of calls
+    // a failed call keeps its error in the result, throw csnet_api_error if the batch fails
+    std::vector<batch_result_t> execute(const batch_t& batch) const;
+
     // send text to echo server and get echo from server
     std::string sendmsg(const std::string& msg) const;
     // send request to server and get current time from server
@@ -27,6 +99,89 @@ namespace csnet
     void check_credentials(const std::string& login, const std::string& password) const;
     // send expression to server and get expression result from server
     std::string calculate(const std::string& input) const;
+    // get per-action latency statistics from server
+    std::string getstats() const;
+    // ask server to write its request trace, get the result message
+    std::string dump_trace() const;
+  };
+
+  // asynchronous client net api wrapper, requests are pipelined over one connection
+  // callbacks are called by the event loop thread with the result or the error
+  class async_clnapi_t : public shared::async_client_api_t
+  {
+  public:
+    // result callback
+    template <typename T>
+    using callback_t = std::function<void(T result, std::exception_ptr error)>;
+
+  public:
+    async_clnapi_t(shared::packet_kind kind = shared::packet_kind::P_BASE_KIND);
+    virtual ~async_clnapi_t();
+
+  public:
+    // check server connection
+    std::future<uint64_t> ping(uint64_t data);
+    void ping(uint64_t data, callback_t<uint64_t> callback);
+    // send text to echo server and get echo from server
+    std::future<std::string> sendmsg(const std::string& msg);
+    void sendmsg(const std::string& msg, callback_t<std::string> callback);
+    // send request to server and get current time from server
+    std::future<std::time_t> gettime();
+    void gettime(callback_t<std::time_t> callback);
+    // send command to server and get command's result
+    std::future<std::string> execmd(const std::string& cmd);
+    void execmd(const std::string& cmd, callback_t<std::string> callback);
+    // send expression to server and get expression result from server
+    std::future<std::string> calculate(const std::string& input);
+    void calculate(const std::string& input, callback_t<std::string> callback);
+
+  private:
+    // callback which sets the promise
+    template <typename T>
+    static callback_t<T> promise_callback(const std::shared_ptr<std::promise<T>>& promise)
+    {
+      return [promise](T result, std::exception_ptr error)
+      {
+        if (error)
+          promise->set_exception(error);
+        else
+          promise->set_value(std::move(result));
+      };
+    }
+    // request with a text reply
+    void request_text(shared::packet_code action, const std::string& text, callback_t<std::string> callback);
+  };
+
+#ifndef _WIN32
+  // event driven client net api wrapper, one event loop thread drives many connections
+  // callbacks are called by the event loop thread with the result or the error
+  class engine_clnapi_t : public shared::client_engine_t
+  {
+  public:
+    // result callback
+    template <typename T>
+    using callback_t = std::function<void(T result, std::exception_ptr error)>;
+
+  public:
+    engine_clnapi_t(shared::packet_kind kind = shared::packet_kind::P_BASE_KIND);
+    ~engine_clnapi_t();
+
+  public:
+    // check server connection
+    void ping(connection_id_t connection, uint64_t data, callback_t<uint64_t> callback);
+    // send text to echo server and get echo from server
+    void sendmsg(connection_id_t connection, const std::string& msg, callback_t<std::string> callback);
+    // send request to server and get current time from server
+    void gettime(connection_id_t connection, callback_t<std::time_t> callback);
+    // send command to server and get command's result
+    void execmd(connection_id_t connection, const std::string& cmd, callback_t<std::string> callback);
+    // send expression to server and get expression result from server
+    void calculate(connection_id_t connection, const std::string& input, callback_t<std::string> callback);
+
+  private:
+    // request with a text reply
+    void request_text(connection_id_t connection, shared::packet_code action, const std::string& text, callback_t<std::string> callback);
   };
+#endif
 
-}
\ No newline at end of file
+}
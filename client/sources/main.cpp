@@ -11,6 +11,8 @@
 #include <iomanip>
 #include <functional>
 #include <ctime>
+#include <algorithm>
+#include <condition_variable>
 
 #include "mysettings.h"
 #include "clnapi.h"
@@ -19,6 +21,7 @@ using namespace csnet;
 using namespace csnet::shared;
 
 static std::mutex _mtx; // locker for std::cout
+static std::unique_ptr<connection_pool_t> _pool; // warm connections of the helpers
 
 std::string time2str(std::time_t time)
 {
@@ -36,8 +39,8 @@ std::string gettime()
   try
   {
     clnapi_t clnapi;
-    clnapi.connect(mysettings_t::instance()->host(), mysettings_t::instance()->port(),
-      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt());
+    clnapi.connect(*_pool, mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
     std::time_t time = clnapi.gettime();
     return time2str(time);
   }
@@ -55,8 +58,8 @@ std::string echo(const std::string& text)
   try
   {
     clnapi_t clnapi;
-    clnapi.connect(mysettings_t::instance()->host(), mysettings_t::instance()->port(),
-      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt());
+    clnapi.connect(*_pool, mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
     return clnapi.sendmsg(text);
   }
   catch (std::exception& e)
@@ -73,8 +76,8 @@ std::string execmd(const std::string& cmd)
   try
   {
     clnapi_t clnapi;
-    clnapi.connect(mysettings_t::instance()->host(), mysettings_t::instance()->port(),
-      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt());
+    clnapi.connect(*_pool, mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
     return clnapi.execmd(cmd);
   }
   catch (std::exception& e)
@@ -91,8 +94,8 @@ std::string ping()
   try
   {
     clnapi_t clnapi;
-    clnapi.connect(mysettings_t::instance()->host(), mysettings_t::instance()->port(),
-      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt());
+    clnapi.connect(*_pool, mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
     uint64_t result = clnapi.ping(0x1010101010101010);
 
     std::string ret = "Ping is ";
@@ -113,8 +116,8 @@ std::string check_credentials(const std::string& login, const std::string& passw
   try
   {
     clnapi_t clnapi;
-    clnapi.connect(mysettings_t::instance()->host(), mysettings_t::instance()->port(),
-      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt());
+    clnapi.connect(*_pool, mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
 
     clnapi.check_credentials(login, password);
     return "It is OK!";
@@ -133,8 +136,8 @@ std::string calculate(const std::string& input)
   try
   {
     clnapi_t clnapi;
-    clnapi.connect(mysettings_t::instance()->host(), mysettings_t::instance()->port(),
-      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt());
+    clnapi.connect(*_pool, mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
     return clnapi.calculate(input);
   }
   catch (std::exception& e)
@@ -145,6 +148,147 @@ std::string calculate(const std::string& input)
   }
 }
 
+// get per-action latency statistics from server
+std::string getstats()
+{
+  try
+  {
+    clnapi_t clnapi;
+    clnapi.connect(*_pool, mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
+    return std::string("\n") + clnapi.getstats();
+  }
+  catch (std::exception& e)
+  {
+    std::stringstream ret;
+    ret << "Error occurred: " << e.what() << std::endl;
+    return ret.str();
+  }
+}
+
+// ask server to write its request trace
+std::string dump_trace()
+{
+  try
+  {
+    clnapi_t clnapi;
+    clnapi.connect(*_pool, mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
+    return clnapi.dump_trace();
+  }
+  catch (std::exception& e)
+  {
+    std::stringstream ret;
+    ret << "Error occurred: " << e.what() << std::endl;
+    return ret.str();
+  }
+}
+
+// send ping, time request and expressions to server in one batch
+std::string batch(const std::string& input)
+{
+  try
+  {
+    clnapi_t clnapi;
+    clnapi.connect(*_pool, mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+      mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
+
+    clnapi_t::batch_t batch = clnapi.batch();
+    batch.ping(0x1010101010101010);
+    batch.gettime();
+    std::stringstream expressions(input);
+    std::string expression;
+    while (std::getline(expressions, expression, ';'))
+    {
+      if (!expression.empty())
+        batch.calculate(expression);
+    }
+
+    // results are in the order of calls
+    std::vector<clnapi_t::batch_result_t> results = clnapi.execute(batch);
+    std::stringstream ret;
+    ret << "Ping is " << ((results[0].error.empty() && 0x1010101010101010 == results[0].value) ? "OK" : "failed");
+    ret << ", time: " << (results[1].error.empty() ? time2str((std::time_t)results[1].value) : results[1].error);
+    for (size_t i = 2; i < results.size(); i++)
+      ret << ", " << (results[i].error.empty() ? results[i].text : "error: " + results[i].error);
+    return ret.str();
+  }
+  catch (std::exception& e)
+  {
+    std::stringstream ret;
+    ret << "Error occurred: " << e.what() << std::endl;
+    return ret.str();
+  }
+}
+
+// ping server over many concurrent connections of one event engine thread
+std::string engine_ping(int count)
+{
+#ifdef _WIN32
+  return "The event engine is supported in Linux only";
+#else
+  try
+  {
+    // each connection takes a file
+    size_t limit = client_engine_t::raise_files_limit(count);
+    if (limit < (size_t)count)
+      count = (int)limit;
+
+    engine_clnapi_t engine;
+    engine.start();
+
+    std::mutex mtx;
+    std::condition_variable finished;
+    int done = 0;
+    int passed = 0;
+
+    // handlers are called by the engine thread, each connection is closed after its ping
+    auto finish = [&](engine_clnapi_t::connection_id_t connection, bool ok)
+    {
+      if (ok)
+        passed++;
+      engine.close(connection);
+      std::lock_guard<std::mutex> lck(mtx);
+      done++;
+      finished.notify_one();
+    };
+
+    for (int i = 0; i < count; i++)
+    {
+      engine.connect(mysettings_t::instance()->host(), mysettings_t::instance()->port(),
+        [&](engine_clnapi_t::connection_id_t connection, std::exception_ptr error)
+      {
+        if (error)
+        {
+          finish(connection, false);
+          return;
+        }
+        engine.ping(connection, 0x1010101010101010, [&, connection](uint64_t result, std::exception_ptr error)
+        {
+          finish(connection, !error && 0x1010101010101010 == result);
+        });
+      });
+    }
+
+    {
+      std::unique_lock<std::mutex> lck(mtx);
+      finished.wait(lck, [&] { return done == count; });
+    }
+    engine.stop();
+
+    std::stringstream ret;
+    ret << "Ping is OK over " << passed << " of " << count << " connections";
+    return ret.str();
+  }
+  catch (std::exception& e)
+  {
+    std::stringstream ret;
+    ret << "Error occurred: " << e.what() << std::endl;
+    return ret.str();
+  }
+#endif
+}
+
 // send command to server and get command's result in a thread
 template <class T, typename... Args>
 void do_in_thread(int count, T func, Args&&... args)
@@ -187,6 +331,10 @@ void help()
   std::cout << "4 - ping" << std::endl;
   std::cout << "5 - check credentials" << std::endl;
   std::cout << "6 - calculate expression" << std::endl;
+  std::cout << "7 - get server latency statistics" << std::endl;
+  std::cout << "8 - dump server request trace" << std::endl;
+  std::cout << "9 - send ping, time request and expressions in one batch" << std::endl;
+  std::cout << "c - ping over many connections of one event engine thread" << std::endl;
   std::cout << "t - set request threads count (default 1)" << std::endl;
   std::cout << "h - help screen" << std::endl;
   std::cout << "q - quit" << std::endl;
@@ -207,6 +355,21 @@ int main(int argc, char** args)
     std::cout << "host: " << mysettings_t::instance()->host() << std::endl;
     std::cout << "port: " << mysettings_t::instance()->port() << std::endl;
 
+    _pool.reset(new connection_pool_t(mysettings_t::instance()->pool_size(), mysettings_t::instance()->pool_idle_timeout()));
+    if (mysettings_t::instance()->preconnect() > 0)
+    {
+      // the server may be not started yet, the helpers connect later then
+      try
+      {
+        _pool->preconnect(mysettings_t::instance()->host(), mysettings_t::instance()->port(), mysettings_t::instance()->preconnect(),
+          mysettings_t::instance()->connect_attempts(), mysettings_t::instance()->next_attempt(), mysettings_t::instance()->connect_timeout());
+      }
+      catch (std::exception& e)
+      {
+        std::cout << "preconnect failed: " << e.what() << std::endl;
+      }
+    }
+
     help();
 
     int threads = 1;
@@ -276,6 +439,26 @@ int main(int argc, char** args)
         std::getline(std::cin, cmd);
         do_in_thread(threads, std::function<std::string(const std::string&)>(calculate), cmd);
       }
+      else if (cmd == "7") // get latency statistics
+      {
+        do_in_thread(1, std::function<std::string()>(getstats));
+      }
+      else if (cmd == "8") // dump request trace
+      {
+        do_in_thread(1, std::function<std::string()>(dump_trace));
+      }
+      else if (cmd == "9") // batch
+      {
+        std::cout << std::endl << "expressions (separated by ';'): ";
+        std::getline(std::cin, cmd);
+        do_in_thread(threads, std::function<std::string(const std::string&)>(batch), cmd);
+      }
+      else if (cmd == "c") // ping over connections of the event engine
+      {
+        std::cout << std::endl << "connections: ";
+        std::getline(std::cin, cmd);
+        do_in_thread(1, std::function<std::string(int)>(engine_ping), std::max(std::atoi(cmd.c_str()), 1));
+      }
       else
       {
         std::cout << "invalid command" << std::endl;
@@ -291,6 +474,9 @@ int main(int argc, char** args)
     std::cerr << "Error occurred: " << "unexception error." << std::endl;
   }
 
+  // close idle connections while sockets are available
+  _pool.reset();
+
 #ifdef _WIN32
   WSACleanup();
 #endif
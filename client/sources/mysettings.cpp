@@ -44,6 +44,18 @@ namespace csnet
     _connect_attempts = std::atoi(val.c_str());
     val = get_value("connect", "next_attempt");
     _next_attempt = std::atoi(val.c_str());
+    val = get_value("connect", "connect_timeout");
+    if (!val.empty())
+      _connect_timeout = std::atoi(val.c_str());
+
+    val = get_value("pool", "size");
+    if (!val.empty())
+      _pool_size = std::atoi(val.c_str());
+    val = get_value("pool", "idle_timeout");
+    if (!val.empty())
+      _pool_idle_timeout = std::atoi(val.c_str());
+    val = get_value("pool", "preconnect");
+    _preconnect = std::atoi(val.c_str());
 
     check_values();
   }
@@ -62,12 +74,26 @@ namespace csnet
     _password.clear();
     _connect_attempts = _CONNECT_ATTEMPT;
     _next_attempt = _WAIT_NEXT_CONNECT_ATTEMPT;
+    _connect_timeout = _CONNECT_TIMEOUT;
+    _pool_size = _POOL_SIZE;
+    _pool_idle_timeout = _POOL_IDLE_TIMEOUT;
+    _preconnect = 0;
   }
 
   void mysettings_t::check_values()
   {
     if (_connect_attempts == 0)
       _connect_attempts = _CONNECT_ATTEMPT;
+    if (_connect_timeout < -1)
+      _connect_timeout = _CONNECT_TIMEOUT;
+    if (_pool_size < 0)
+      _pool_size = 0;
+    if (_pool_idle_timeout <= 0)
+      _pool_idle_timeout = _POOL_IDLE_TIMEOUT;
+    if (_preconnect < 0)
+      _preconnect = 0;
+    if (_preconnect > _pool_size)
+      _preconnect = _pool_size;
   }
 
 }
@@ -14,6 +14,9 @@ namespace csnet
 
     static constexpr int _CONNECT_ATTEMPT = 5; // what is count attempt to connect if server is busy?
     static constexpr int _WAIT_NEXT_CONNECT_ATTEMPT = 100; // time in ms to wait next attempt
+    static constexpr int _CONNECT_TIMEOUT = 3000; // time in ms to wait an answer of the server addresses
+    static constexpr int _POOL_SIZE = 8; // max idle connections kept for next requests
+    static constexpr int _POOL_IDLE_TIMEOUT = 10000; // time in ms to keep an idle connection
 
   protected:
     mysettings_t(csnet::shared::settings_provider_t* provider);
@@ -61,6 +64,26 @@ namespace csnet
     {
       return _next_attempt;
     }
+    // get time in ms to wait an answer of the server addresses, -1 is to wait by the system timeout
+    int connect_timeout() const
+    {
+      return _connect_timeout;
+    }
+    // get max idle connections kept for next requests, 0 is to connect per request
+    int pool_size() const
+    {
+      return _pool_size;
+    }
+    // get time in ms to keep an idle connection
+    int pool_idle_timeout() const
+    {
+      return _pool_idle_timeout;
+    }
+    // get count of connections opened at start
+    int preconnect() const
+    {
+      return _preconnect;
+    }
 
   protected:
     // check values and correct
@@ -73,6 +96,10 @@ namespace csnet
     std::string _password;
     int _connect_attempts;
     int _next_attempt;
+    int _connect_timeout;
+    int _pool_size;
+    int _pool_idle_timeout;
+    int _preconnect;
   };
 
 }
\ No newline at end of file
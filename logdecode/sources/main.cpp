@@ -0,0 +1,102 @@
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+
+#include "binlog.h"
+
+using namespace csnet::shared;
+
+// print usage
+void usage()
+{
+  std::cout << "Usage: csnet-logdecode <binary log> [text log]" << std::endl;
+}
+
+// read next record, return false at the end of the file
+bool read_record(std::istream& in, std::string& record)
+{
+  // type and body size
+  record.resize(1 + sizeof(uint32_t));
+  if (!in.read(&record.front(), record.size()))
+  {
+    if (in.gcount() == 0)
+      return false;
+    throw std::runtime_error("the log is truncated");
+  }
+
+  // zero filled tail of a memory-mapped segment
+  if (record[0] == 0)
+    return false;
+
+  uint32_t size;
+  std::memcpy(&size, record.data() + 1, sizeof(size));
+
+  size_t pos = record.size();
+  record.resize(pos + size);
+  if (size && !in.read(&record[pos], size))
+    throw std::runtime_error("the log is truncated");
+
+  return true;
+}
+
+int main(int argc, char** args)
+{
+  if (argc < 2 || argc > 3)
+  {
+    usage();
+    return -1;
+  }
+
+  std::ifstream in(args[1], std::ios::in | std::ios::binary);
+  if (!in)
+  {
+    std::cerr << "Cannot open \"" << args[1] << "\"" << std::endl;
+    return -1;
+  }
+
+  std::ofstream file;
+  if (argc == 3)
+  {
+    file.open(args[2], std::ios::out | std::ios::trunc);
+    if (!file)
+    {
+      std::cerr << "Cannot open \"" << args[2] << "\"" << std::endl;
+      return -1;
+    }
+  }
+  std::ostream& out = (argc == 3) ? file : std::cout;
+
+  std::string magic(std::strlen(binlog_t::magic()), '\0');
+  if (!in.read(&magic.front(), magic.size()) || magic != binlog_t::magic())
+  {
+    std::cerr << "\"" << args[1] << "\" is not a binary log" << std::endl;
+    return -1;
+  }
+
+  size_t lines = 0;
+  try
+  {
+    binlog_decoder_t decoder;
+    binlog_entry_t entry;
+    std::string record;
+
+    while (read_record(in, record))
+    {
+      if (decoder.decode(record, entry))
+      {
+        out << binlog_decoder_t::to_string(entry);
+        lines++;
+      }
+    }
+  }
+  catch (std::exception& e)
+  {
+    // a crashed server leaves a partial last record
+    std::cerr << "Decoding is stopped after " << lines << " lines: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,193 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <cstdlib>
+#include <cctype>
+#include <iterator>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <set>
+#include <thread>
+
+#include "affinity.h"
+
+namespace csnet
+{
+
+#ifdef _WIN32
+  // a thread affinity mask covers cpus of one processor group only
+  static const int _MAX_CPUS = 64;
+#else
+  static const int _MAX_CPUS = CPU_SETSIZE;
+
+  // cpus the process may run on, read at startup before any thread is bound,
+  // threads inherit the mask of the thread which creates them
+  static const cpu_set_t _PROCESS_CPUS = []
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+      for (unsigned int cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); cpu++)
+        CPU_SET(cpu, &set);
+    }
+    return set;
+  }();
+#endif
+
+  // parse cpu list like '0,2,4-7' or 'node:N' (one cpu per core on numa node N)
+  // empty spec means no affinity
+  std::vector<int> affinity_t::parse(const std::string& spec)
+  {
+    std::string str;
+    std::remove_copy_if(spec.cbegin(), spec.cend(), std::back_inserter(str), [](unsigned char c) { return std::isspace(c) != 0; });
+
+    if (str.compare(0, 5, "node:") == 0)
+      return node_cpus(std::atoi(str.c_str() + 5));
+
+    return parse_list(str);
+  }
+
+  // parse list like '0,2,4-7'
+  std::vector<int> affinity_t::parse_list(const std::string& list)
+  {
+    std::vector<int> cpus;
+    std::stringstream buf(list);
+    std::string item;
+
+    while (std::getline(buf, item, ','))
+    {
+      if (item.empty())
+        continue;
+
+      size_t pos = item.find('-');
+      int first = std::atoi(item.c_str());
+      int last = (pos == std::string::npos) ? first : std::atoi(item.c_str() + pos + 1);
+
+      // cpus which cannot be bound are skipped
+      for (int cpu = std::max(first, 0); cpu <= std::min(last, _MAX_CPUS - 1); cpu++)
+        cpus.push_back(cpu);
+    }
+
+    return cpus;
+  }
+
+  // get cpu list of the numa node
+  std::vector<int> affinity_t::node_cpus(int node)
+  {
+    std::vector<int> cpus;
+
+#ifdef _WIN32
+    ULONGLONG mask = 0;
+    if (::GetNumaNodeProcessorMask((UCHAR)node, &mask))
+    {
+      for (int cpu = 0; cpu < _MAX_CPUS; cpu++)
+      {
+        if (mask & (1ull << cpu))
+          cpus.push_back(cpu);
+      }
+    }
+#else
+    std::stringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+
+    std::ifstream file(path.str());
+    std::string list;
+    if (!std::getline(file, list))
+      return cpus;
+
+    // keep only first hardware thread of each core
+    std::set<int> siblings;
+    for (int cpu : parse_list(list))
+    {
+      if (siblings.count(cpu))
+        continue;
+
+      std::stringstream topology;
+      topology << "/sys/devices/system/cpu/cpu" << cpu << "/topology/thread_siblings_list";
+
+      std::ifstream tfile(topology.str());
+      std::string tlist;
+      if (std::getline(tfile, tlist))
+      {
+        for (int sibling : parse_list(tlist))
+          siblings.insert(sibling);
+      }
+
+      cpus.push_back(cpu);
+    }
+#endif
+
+    return cpus;
+  }
+
+  // bind the calling thread to the cpu, cpu < 0 does nothing
+  bool affinity_t::bind(int cpu)
+  {
+    if (cpu < 0)
+      return true;
+    if (cpu >= _MAX_CPUS)
+      return false;
+
+#ifdef _WIN32
+    return ::SetThreadAffinityMask(::GetCurrentThread(), 1ull << cpu) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+#endif
+  }
+
+  // get cpus the process may run on
+  std::vector<int> affinity_t::available()
+  {
+    std::vector<int> cpus;
+
+#ifdef _WIN32
+    DWORD_PTR process = 0, system = 0;
+    if (::GetProcessAffinityMask(::GetCurrentProcess(), &process, &system))
+    {
+      for (int cpu = 0; cpu < (int)(sizeof(process) * 8); cpu++)
+      {
+        if (process & ((DWORD_PTR)1 << cpu))
+          cpus.push_back(cpu);
+      }
+    }
+#else
+    for (int cpu = 0; cpu < _MAX_CPUS; cpu++)
+    {
+      if (CPU_ISSET(cpu, &_PROCESS_CPUS))
+        cpus.push_back(cpu);
+    }
+#endif
+
+    return cpus;
+  }
+
+  // bind the calling thread back to the cpus the process may run on
+  bool affinity_t::unbind()
+  {
+#ifdef _WIN32
+    DWORD_PTR process = 0, system = 0;
+    return ::GetProcessAffinityMask(::GetCurrentProcess(), &process, &system) && ::SetThreadAffinityMask(::GetCurrentThread(), process) != 0;
+#else
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(_PROCESS_CPUS), &_PROCESS_CPUS) == 0;
+#endif
+  }
+
+  // convert cpu list to string like '0,1,2'
+  std::string affinity_t::to_string(const std::vector<int>& cpus)
+  {
+    std::stringstream buf;
+    for (size_t i = 0; i < cpus.size(); i++)
+      buf << (i ? "," : "") << cpus[i];
+    return buf.str();
+  }
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace csnet
+{
+
+  // cpu and numa affinity helper class
+  class affinity_t
+  {
+  public:
+    // parse cpu list like '0,2,4-7' or 'node:N' (one cpu per core on numa node N)
+    // empty spec means no affinity, cpus above 63 in Windows (one processor group) are skipped
+    static std::vector<int> parse(const std::string& spec);
+    // get cpu list of the numa node
+    static std::vector<int> node_cpus(int node);
+    // bind the calling thread to the cpu, cpu < 0 does nothing, false if the cpu cannot be bound
+    static bool bind(int cpu);
+    // get cpus the process may run on
+    static std::vector<int> available();
+    // bind the calling thread back to the cpus the process may run on, false if it cannot be bound
+    static bool unbind();
+    // get cpu for the thread index from the cpu list, -1 if list is empty
+    static int cpu_of(const std::vector<int>& cpus, size_t index)
+    {
+      return cpus.empty() ? -1 : cpus[index % cpus.size()];
+    }
+    // convert cpu list to string like '0,1,2'
+    static std::string to_string(const std::vector<int>& cpus);
+
+  private:
+    // parse list like '0,2,4-7'
+    static std::vector<int> parse_list(const std::string& list);
+  };
+
+}
@@ -0,0 +1,166 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "capture.h"
+
+namespace csnet
+{
+
+  using namespace shared;
+
+  static const char _MAGIC[8] = { 'C', 'S', 'N', 'E', 'T', 'C', 'A', 'P' };
+
+  constexpr uint8_t capture_t::VERSION;
+
+  // finish capturing
+  capture_t::~capture_t()
+  {
+    close();
+  }
+
+  // start capturing to the file, the percent of connections is sampled
+  void capture_t::open(const std::string& filename, double sample_percent)
+  {
+    std::lock_guard<std::mutex> lck(_mtx);
+    _file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!_file)
+      throw std::runtime_error("Cannot open capture file \"" + filename + "\"");
+
+    _file.write(_MAGIC, sizeof(_MAGIC));
+    _file.put((char)VERSION);
+
+    _sample = (uint64_t)(sample_percent * 100);
+    _origin = clock_t::now();
+    _enabled = true;
+  }
+
+  // finish capturing
+  void capture_t::close()
+  {
+    std::lock_guard<std::mutex> lck(_mtx);
+    _enabled = false;
+    if (_file.is_open())
+      _file.close();
+  }
+
+  // get id of a new connection, 0 - the connection is not sampled
+  uint64_t capture_t::connection()
+  {
+    if (!enabled())
+      return 0;
+
+    // every connection gets a number, so sampled ones are spread evenly
+    uint64_t number = _connections.fetch_add(1, std::memory_order_relaxed);
+    if ((number * 7919) % 10000 >= _sample)
+      return 0;
+    return number + 1;
+  }
+
+  // record a frame of the sampled connection, it is received at the time, credentials are redacted
+  void capture_t::record(uint64_t connection, clock_t::time_point time, const packet_info_t& packet)
+  {
+    if (connection == 0 || !enabled())
+      return;
+
+    // the record is made out of the lock
+    std::string record;
+    put_varint(record, connection);
+    put_varint(record, time > _origin ? (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(time - _origin).count() : 0);
+    size_t offset = record.size();
+    record.append(reinterpret_cast<const char*>(&packet), packet.size);
+    redact(&record[offset], packet.size);
+
+    std::lock_guard<std::mutex> lck(_mtx);
+    if (_file.is_open())
+      _file.write(record.data(), record.size());
+  }
+
+  // zero data of credentials requests of the frame, requests of a batch too
+  void capture_t::redact(char* frame, size_t size)
+  {
+    packet_info_t head;
+    if (size < sizeof(head))
+      return;
+    std::memcpy(&head, frame, sizeof(head));
+    if (head.size > size || head.size < sizeof(head))
+      return;
+
+    // the replayed request keeps its size and fails the check
+    if (head.action == packet_code::P_CREDENTIALS_ACTION)
+    {
+      std::memset(frame + sizeof(head), 0, head.size - sizeof(head));
+    }
+    else if (head.action == packet_code::P_BATCH_ACTION && head.type == packet_type::P_DATA_TYPE)
+    {
+      // the batch data are whole request packets
+      for (size_t offset = sizeof(head); offset + sizeof(uint16_t) <= head.size;)
+      {
+        uint16_t request_size = 0;
+        std::memcpy(&request_size, frame + offset, sizeof(request_size));
+        if (request_size < sizeof(packet_info_t) || request_size > head.size - offset)
+          break;
+        redact(frame + offset, request_size);
+        offset += request_size;
+      }
+    }
+  }
+
+  // read all frames of the file in the record order
+  std::vector<capture_t::frame_t> capture_t::read(const std::string& filename)
+  {
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    if (!in)
+      throw std::runtime_error("Cannot open capture file \"" + filename + "\"");
+
+    char magic[sizeof(_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, _MAGIC, sizeof(_MAGIC)) != 0 || in.get() != VERSION)
+      throw std::runtime_error("\"" + filename + "\" is not a capture file");
+
+    std::vector<frame_t> frames;
+    for (;;)
+    {
+      frame_t frame;
+      uint16_t size = 0;
+      if (!get_varint(in, frame.connection))
+        break;
+      // a record cut by a crash is skipped
+      if (!get_varint(in, frame.time) || !in.read(reinterpret_cast<char*>(&size), sizeof(size)) || size < sizeof(packet_info_t))
+        break;
+
+      frame.data.resize(size);
+      std::memcpy(frame.data.data(), &size, sizeof(size));
+      if (!in.read(reinterpret_cast<char*>(frame.data.data()) + sizeof(size), size - sizeof(size)))
+        break;
+      frames.push_back(std::move(frame));
+    }
+    return frames;
+  }
+
+  // append an unsigned LEB128 value
+  void capture_t::put_varint(std::string& out, uint64_t value)
+  {
+    while (value >= 0x80)
+    {
+      out.push_back((char)((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+    out.push_back((char)value);
+  }
+
+  // read an unsigned LEB128 value, false at the end of the file
+  bool capture_t::get_varint(std::istream& in, uint64_t& value)
+  {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+      int byte = in.get();
+      if (byte == std::char_traits<char>::eof())
+        return false;
+      value |= (uint64_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "packsock.h"
+
+namespace csnet
+{
+
+  // capture of incoming frames for csnet-replay
+  // the file is 'CSNETCAP' and a version byte, then records of
+  // varint connection, varint ns from the capture start and the frame as it is received
+  // data of credentials requests are zeroed, so the file keeps no logins and passwords
+  class capture_t
+  {
+  public:
+    typedef std::chrono::steady_clock clock_t;
+
+    static constexpr uint8_t VERSION = 1;
+
+    // captured frame
+    struct frame_t
+    {
+      uint64_t connection = 0; // connections are numbered from 1 in the accept order
+      uint64_t time = 0; // ns from the capture start
+      std::vector<int8_t> data; // the whole packet with its head
+    };
+
+  public:
+    capture_t() = default;
+    ~capture_t();
+    capture_t(const capture_t&) = delete;
+    capture_t& operator = (const capture_t&) = delete;
+
+  public:
+    // start capturing to the file, the percent of connections is sampled
+    // throw std::runtime_error if the file cannot be written
+    void open(const std::string& filename, double sample_percent);
+    // finish capturing
+    void close();
+    // is capturing started
+    bool enabled() const
+    {
+      return _enabled.load(std::memory_order_relaxed);
+    }
+
+    // get id of a new connection, 0 - the connection is not sampled
+    uint64_t connection();
+    // record a frame of the sampled connection, it is received at the time, credentials are redacted
+    void record(uint64_t connection, clock_t::time_point time, const shared::packet_info_t& packet);
+
+    // read all frames of the file in the record order
+    // throw std::runtime_error if the file is not a capture
+    static std::vector<frame_t> read(const std::string& filename);
+
+  private:
+    // zero data of credentials requests of the frame, requests of a batch too
+    static void redact(char* frame, size_t size);
+    // append an unsigned LEB128 value
+    static void put_varint(std::string& out, uint64_t value);
+    // read an unsigned LEB128 value, false at the end of the file
+    static bool get_varint(std::istream& in, uint64_t& value);
+
+  private:
+    std::atomic<bool> _enabled{ false };
+    std::atomic<uint64_t> _connections{ 0 };
+    uint64_t _sample = 0; // captured connections of every 10000
+    clock_t::time_point _origin;
+    std::mutex _mtx;
+    std::ofstream _file;
+  };
+
+}
@@ -38,7 +38,21 @@ namespace csnet
       return -1;
 
     if (!mysettings_t::instance()->log_disabled())
-      logger_t::instance()->open(mysettings_t::instance()->logfile());
+    {
+      logger_t::instance()->set_level(mysettings_t::instance()->log_level());
+      logger_t::instance()->set_rate_limit(mysettings_t::instance()->log_rate_limit());
+      logger_t::instance()->set_sample_percent(mysettings_t::instance()->log_sample_percent());
+      if (mysettings_t::instance()->log_segment_size() > 0)
+        logger_t::instance()->open_mapped(mysettings_t::instance()->logfile(), mysettings_t::instance()->log_binary(),
+          (size_t)mysettings_t::instance()->log_segment_size() << 20, mysettings_t::instance()->log_segments(),
+          mysettings_t::instance()->log_flush_interval());
+      else
+        logger_t::instance()->open(mysettings_t::instance()->logfile(), mysettings_t::instance()->log_binary());
+
+      if (mysettings_t::instance()->log_async())
+        logger_t::instance()->start_async(mysettings_t::instance()->log_queue_size(),
+          mysettings_t::instance()->log_flush_interval(), mysettings_t::instance()->log_flush_size());
+    }
 
     if (mysettings_t::instance()->daemon())
       LOGLINE("Server started as deamon application.");
@@ -46,7 +60,8 @@ namespace csnet
       LOGLINE("Server started as console application.");
 
     LOGLINE("Server port: " << mysettings_t::instance()->port() << ".");
-    LOGLINE("Server pool count: " << mysettings_t::instance()->pool_count() << ".");
+    LOGLINE("Server pool count: " << mysettings_t::instance()->pool_count() << " ("
+      << mysettings_t::instance()->pool_min_count() << " - " << mysettings_t::instance()->pool_max_count() << ").");
     LOGLINE("Server queue count: " << mysettings_t::instance()->queue_count() << ".");
 
     return process();
@@ -90,8 +105,13 @@ namespace csnet
 
   int daemon_t::process()
   {
-    myserver_t server(std::make_unique<myservice_t>());
-    return server.start(mysettings_t::instance()->port(), mysettings_t::instance()->pool_count(), mysettings_t::instance()->queue_count());
+    std::unique_ptr<myserver_t> server = std::make_unique<myserver_t>(std::make_unique<myservice_t>());
+    int status = server->start(mysettings_t::instance()->port(), mysettings_t::instance()->pool_count(), mysettings_t::instance()->queue_count());
+
+    // abandoned requests still use the server, main() leaves the process without destroying it
+    if (status == myserver_t::DRAIN_TIMEOUT)
+      server.release();
+    return status;
   }
 
 }
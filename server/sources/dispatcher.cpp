@@ -0,0 +1,242 @@
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "dispatcher.h"
+#include "memtransport.h"
+#include "threadpool.h"
+
+namespace csnet
+{
+
+  using namespace shared;
+
+  dispatcher_t::dispatcher_t(const service_i& handler, command_t stats, command_t trace, packet_kind kind)
+    : _handler(handler), _stats(stats), _trace(trace), _kind(kind)
+  {
+  }
+
+  // call the service by the request and send its reply, the request packet is whole
+  void dispatcher_t::dispatch(const packet_info_t& request, const reply_i& reply) const
+  {
+    if (is_packet_of(request, packet_type::P_DATA_TYPE, packet_code::P_CREDENTIALS_ACTION))
+    {
+      // it is check credentials action
+      const packet_data_t& packet_data = static_cast<const packet_data_t&>(request);
+
+      const credentials_info_t* ci = reinterpret_cast<const credentials_info_t*>(packet_data.data);
+
+      // extract params
+      std::string login(ci->data, ci->login_len);
+      std::string password(ci->data + ci->login_len, ci->password_len);
+
+      // check login and password
+      if (!_handler.check_credentials(login, password))
+        reply.send_reply(packet_data.action, (uint32_t)-1, "Invalid credentials");
+      else
+        reply.send_reply(packet_data.action); // replay OK to client
+    }
+    else if (is_packet_of(request, packet_type::P_DATA_TYPE, packet_code::P_PING_ACTION))
+    {
+      // it is ping action
+      const packet_data_t& packet_data = static_cast<const packet_data_t&>(request);
+      uint64_t result = _handler.ping(reinterpret_cast<uint64_t>(packet_data.data));
+
+      // replay pind data to client
+      reply.send_reply(packet_data.action, reinterpret_cast<int8_t*>(result), sizeof(uint64_t));
+    }
+    else if (is_packet_of(request, packet_type::P_TEXT_TYPE, packet_code::P_ECHO_ACTION))
+    {
+      // it is echo server action
+      std::string result = _handler.sendmsg(text_of(request));
+
+      // replay string to client
+      reply.send_reply(request.action, result);
+    }
+    else if (is_packet_of(request, packet_type::P_NULL_TYPE, packet_code::P_TIME_ACTION))
+    {
+      // it is gettime action
+      std::time_t now = _handler.gettime();
+
+      // replay time to client
+      reply.send_reply(packet_code::P_TIME_ACTION, reinterpret_cast<int8_t*>(&now), sizeof(now));
+    }
+    else if (is_packet_of(request, packet_type::P_TEXT_TYPE, packet_code::P_EXECMD_ACTION))
+    {
+      // it is execute cmd action
+      std::string result = _handler.execmd(text_of(request));
+
+      // replay command's result to client
+      reply.send_reply(request.action, result);
+    }
+    else if (is_packet_of(request, packet_type::P_TEXT_TYPE, packet_code::P_CALC_ACTION))
+    {
+      // it is calculate server action
+      std::string result = _handler.calculate(text_of(request));
+
+      // replay string to client
+      reply.send_reply(request.action, result);
+    }
+    else if (_stats && is_packet_of(request, packet_type::P_NULL_TYPE, packet_code::P_STATS_ACTION))
+    {
+      // it is get statistics action, replay merged histograms as text
+      reply.send_reply(packet_code::P_STATS_ACTION, _stats());
+    }
+    else if (_trace && is_packet_of(request, packet_type::P_NULL_TYPE, packet_code::P_TRACE_ACTION))
+    {
+      // it is dump trace action, replay the result
+      reply.send_reply(packet_code::P_TRACE_ACTION, _trace());
+    }
+    else if (is_packet_of(request, packet_type::P_DATA_TYPE, packet_code::P_BATCH_ACTION))
+    {
+      // it is batch action, replay the replies of its requests in one packet
+      dispatch_batch(static_cast<const packet_data_t&>(request), reply);
+    }
+    else
+    {
+      // it is unknown action
+      reply.send_reply(request.action, (uint32_t)-2, "Unknown packet");
+    }
+  }
+
+  // is the request blocking, it waits for a child process or a file or it runs a batch
+  bool dispatcher_t::is_blocking(const packet_info_t& request) const
+  {
+    return is_packet_of(request, packet_type::P_TEXT_TYPE, packet_code::P_EXECMD_ACTION)
+      || (_trace && is_packet_of(request, packet_type::P_NULL_TYPE, packet_code::P_TRACE_ACTION))
+      || is_packet_of(request, packet_type::P_DATA_TYPE, packet_code::P_BATCH_ACTION);
+  }
+
+  // call the service by each request of the batch and reply their replies in one packet
+  void dispatcher_t::dispatch_batch(const packet_data_t& batch, const reply_i& reply) const
+  {
+    // split the batch to whole request packets
+    std::vector<const packet_info_t*> requests;
+    size_t size = batch.size_data();
+    for (size_t offset = 0; offset < size;)
+    {
+      uint16_t request_size = 0;
+      if (size - offset >= sizeof(request_size))
+        std::memcpy(&request_size, batch.data + offset, sizeof(request_size));
+      if (request_size < sizeof(packet_info_t) || request_size > size - offset)
+      {
+        reply.send_reply(batch.action, (uint32_t)-2, "Malformed batch");
+        return;
+      }
+
+      requests.push_back(reinterpret_cast<const packet_info_t*>(batch.data + offset));
+      offset += request_size;
+    }
+
+    std::vector<std::vector<int8_t>> replies(requests.size());
+    run_batch(requests.size(), [&](size_t index)
+    {
+      replies[index] = dispatch_one(*requests[index]);
+    });
+
+    // the replies are in the order of the requests
+    std::vector<int8_t> data;
+    for (const std::vector<int8_t>& frame : replies)
+      data.insert(data.end(), frame.begin(), frame.end());
+
+    if (sizeof(packet_info_t) + data.size() > packet_socket_t::MAX_PACKET_SIZE)
+      reply.send_reply(batch.action, (uint32_t)-3, "Batch reply is too large");
+    else
+      reply.send_reply(batch.action, data.data(), data.size());
+  }
+
+  // call the service by a request of the batch and return its reply frame
+  std::vector<int8_t> dispatcher_t::dispatch_one(const packet_info_t& request) const
+  {
+    memory_transport_t transport(*this, _kind);
+    if (request.action == packet_code::P_BATCH_ACTION)
+    {
+      transport.send_reply(request.action, (uint32_t)-2, "Nested batch");
+      return transport.reply();
+    }
+
+    try
+    {
+      transport.request(request);
+    }
+    catch (std::exception& e)
+    {
+      // one failed request does not fail the batch
+      transport.send_reply(request.action, (uint32_t)-3, e.what());
+    }
+    return transport.reply();
+  }
+
+  // run calls of the batch, the pool of the calling thread helps if there is one
+  void dispatcher_t::run_batch(size_t count, const std::function<void(size_t)>& call) const
+  {
+    thread_pool_t* pool = thread_pool_t::current();
+    if (!pool || count < 2)
+    {
+      for (size_t i = 0; i < count; i++)
+        call(i);
+      return;
+    }
+
+    // calls are taken by index, helpers which start after all calls are taken do nothing
+    struct progress_t
+    {
+      std::atomic<size_t> next{ 0 };
+      std::atomic<size_t> done{ 0 };
+      std::mutex mtx;
+      std::condition_variable finished;
+    };
+    std::shared_ptr<progress_t> progress = std::make_shared<progress_t>();
+
+    auto work = [progress, count, &call]()
+    {
+      for (size_t i = progress->next++; i < count; i = progress->next++)
+      {
+        call(i);
+        if (++progress->done == count)
+        {
+          std::lock_guard<std::mutex> lck(progress->mtx);
+          progress->finished.notify_all();
+        }
+      }
+    };
+
+    // the calling thread takes calls too, so the batch is finished even if the pool is busy
+    try
+    {
+      size_t helpers = std::min(count - 1, pool->size());
+      for (size_t i = 0; i < helpers; i++)
+        pool->enqueue(work);
+    }
+    catch (std::exception&)
+    {
+      // the pool is stopped, the rest calls are done by this thread
+    }
+    work();
+
+    // wait for calls taken by helpers
+    std::unique_lock<std::mutex> lck(progress->mtx);
+    if (progress->done < count)
+    {
+      thread_pool_t::blocking_region_t blocking;
+      progress->finished.wait(lck, [&] { return progress->done == count; });
+    }
+  }
+
+  // get text of the text packet, it ends by the first zero or by the end of the packet
+  // a request of a batch is followed by the next one, so its text is not terminated by the frame
+  std::string dispatcher_t::text_of(const packet_info_t& request)
+  {
+    const packet_text_t& packet_text = static_cast<const packet_text_t&>(request);
+    return std::string(packet_text.text, std::find(packet_text.text, packet_text.text + request.size_data(), '\0'));
+  }
+
+  // is packet of the type
+  bool dispatcher_t::is_packet_of(const packet_info_t& packet, packet_type type, packet_code action) const
+  {
+    return packet.kind == _kind && packet.type == type && packet.action == action;
+  }
+
+}
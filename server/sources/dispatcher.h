@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "srvapi.h"
+
+namespace csnet
+{
+
+  // dispatch of a request packet to the service and its reply
+  // it does not know the transport, so it is driven by sockets or by memory
+  class dispatcher_t
+  {
+  public:
+    // server command which replies a text
+    typedef std::function<std::string()> command_t;
+
+  public:
+    // stats and trace commands are replied as unknown packets if they are not set
+    dispatcher_t(const service_i& handler, command_t stats = nullptr, command_t trace = nullptr,
+      shared::packet_kind kind = shared::packet_kind::P_BASE_KIND);
+
+    dispatcher_t(const dispatcher_t&) = delete;
+    dispatcher_t& operator = (const dispatcher_t&) = delete;
+
+  public:
+    // call the service by the request and send its reply, the request packet is whole
+    // throw if the reply cannot be sent or the service fails
+    void dispatch(const shared::packet_info_t& request, const reply_i& reply) const;
+    // is the request blocking, it waits for a child process or a file or it runs a batch
+    // event loops hand such requests off to workers
+    bool is_blocking(const shared::packet_info_t& request) const;
+
+  private:
+    // call the service by each request of the batch and reply their replies in one packet
+    // requests are called concurrently by the pool of the calling thread if there is one
+    void dispatch_batch(const shared::packet_data_t& batch, const reply_i& reply) const;
+    // call the service by a request of the batch and return its reply frame
+    std::vector<int8_t> dispatch_one(const shared::packet_info_t& request) const;
+    // run calls of the batch, the pool of the calling thread helps if there is one
+    void run_batch(size_t count, const std::function<void(size_t)>& call) const;
+    // get text of the text packet, it ends by the first zero or by the end of the packet
+    static std::string text_of(const shared::packet_info_t& request);
+    // is packet of the type
+    bool is_packet_of(const shared::packet_info_t& packet, shared::packet_type type, shared::packet_code action) const;
+
+  private:
+    const service_i& _handler;
+    command_t _stats;
+    command_t _trace;
+    shared::packet_kind _kind;
+  };
+
+}
@@ -1,14 +1,18 @@
 #include <iostream>
 #include <exception>
+#include <cstdlib>
 
 #include "daemon.h"
+#include "server.h"
+#include "logger.h"
 
 int main(int argc, char** args)
 {
+  int status = -1;
   try
   {
     csnet::daemon_t daemon(argc, args);
-    return daemon.run();
+    status = daemon.run();
   }
   catch (std::exception& e)
   {
@@ -19,5 +23,13 @@ int main(int argc, char** args)
     std::cerr << "Error occurred: " << "unexception error." << std::endl;
   }
 
-  return -1;
+  // requests abandoned by the drain timeout are still running,
+  // so the process is left without destructors of static objects they use
+  if (status == csnet::myserver_t::DRAIN_TIMEOUT)
+  {
+    csnet::shared::logger_t::instance()->close();
+    std::_Exit(status);
+  }
+
+  return status;
 }
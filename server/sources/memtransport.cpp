@@ -0,0 +1,96 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "memtransport.h"
+#include "csnet_api.h"
+
+namespace csnet
+{
+
+  using namespace shared;
+
+  memory_transport_t::memory_transport_t(const dispatcher_t& dispatcher, packet_kind kind) : _dispatcher(dispatcher), _kind(kind)
+  {
+  }
+
+  // dispatch the request frame and return the reply frame, it is valid up to the next request
+  const std::vector<int8_t>& memory_transport_t::request(const std::vector<int8_t>& frame)
+  {
+    // the same checks as the socket receiving does
+    uint16_t size = 0;
+    if (frame.size() >= sizeof(size))
+      std::memcpy(&size, frame.data(), sizeof(size));
+    if (size < sizeof(packet_info_t) || size != frame.size())
+      throw std::runtime_error("Malformed frame");
+
+    return request(*reinterpret_cast<const packet_info_t*>(frame.data()));
+  }
+
+  // dispatch the whole request packet and return the reply frame, it is valid up to the next request
+  const std::vector<int8_t>& memory_transport_t::request(const packet_info_t& packet)
+  {
+    _reply.clear();
+    _dispatcher.dispatch(packet, *this);
+    return _reply;
+  }
+
+  // make a request frame w/o data like the client sends it
+  std::vector<int8_t> memory_transport_t::make_frame(packet_code action) const
+  {
+    std::vector<int8_t> frame;
+    encode(frame, packet_type::P_NULL_TYPE, action, nullptr, 0);
+    return frame;
+  }
+
+  // make a data request frame
+  std::vector<int8_t> memory_transport_t::make_frame(packet_code action, const void* data, size_t size) const
+  {
+    std::vector<int8_t> frame;
+    encode(frame, packet_type::P_DATA_TYPE, action, data, size);
+    return frame;
+  }
+
+  // make a text request frame
+  std::vector<int8_t> memory_transport_t::make_frame(packet_code action, const std::string& text) const
+  {
+    std::vector<int8_t> frame;
+    encode(frame, packet_type::P_TEXT_TYPE, action, text.c_str(), text.size() + sizeof(char));
+    return frame;
+  }
+
+  // keep reply frame
+  void memory_transport_t::send_reply(packet_code action) const
+  {
+    encode(_reply, packet_type::P_NULL_TYPE, action | packet_code::P_RETURN_ACTION, nullptr, 0);
+  }
+
+  // keep data reply frame
+  void memory_transport_t::send_reply(packet_code action, const void* data, size_t size) const
+  {
+    encode(_reply, packet_type::P_DATA_TYPE, action | packet_code::P_RETURN_ACTION, data, size);
+  }
+
+  // keep text reply frame
+  void memory_transport_t::send_reply(packet_code action, const std::string& text) const
+  {
+    encode(_reply, packet_type::P_TEXT_TYPE, action | packet_code::P_RETURN_ACTION, text.c_str(), text.size() + sizeof(char));
+  }
+
+  // keep error reply frame
+  void memory_transport_t::send_reply(packet_code action, uint32_t error, const std::string& text) const
+  {
+    // error code and text follow the head like in packet_error_t
+    std::vector<char> data(sizeof(error) + text.size() + sizeof(char));
+    std::memcpy(data.data(), &error, sizeof(error));
+    std::memcpy(data.data() + sizeof(error), text.c_str(), text.size() + sizeof(char));
+    encode(_reply, packet_type::P_ERROR_TYPE, action | packet_code::P_RETURN_ACTION, data.data(), data.size());
+  }
+
+  // make a frame of the head and data to the buffer
+  void memory_transport_t::encode(std::vector<int8_t>& frame, packet_type type, packet_code action, const void* data, size_t size) const
+  {
+    if (!packet_socket_t::encode(packet_info_t(_kind, type, action), data, size, frame))
+      throw csnet_api_error("Packet is too large");
+  }
+
+}
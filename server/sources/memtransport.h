@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "dispatcher.h"
+
+namespace csnet
+{
+
+  // in-memory transport, it feeds whole frames to the dispatcher and keeps the reply frame
+  // there are no sockets and syscalls, so handlers and dispatch are measured or tested alone
+  class memory_transport_t : public reply_i
+  {
+  public:
+    explicit memory_transport_t(const dispatcher_t& dispatcher, shared::packet_kind kind = shared::packet_kind::P_BASE_KIND);
+
+    memory_transport_t(const memory_transport_t&) = delete;
+    memory_transport_t& operator = (const memory_transport_t&) = delete;
+
+  public:
+    // dispatch the request frame and return the reply frame, it is valid up to the next request
+    // throw std::runtime_error if the frame is malformed
+    const std::vector<int8_t>& request(const std::vector<int8_t>& frame);
+    // dispatch the whole request packet and return the reply frame, it is valid up to the next request
+    const std::vector<int8_t>& request(const shared::packet_info_t& packet);
+
+    // get the last reply frame
+    const std::vector<int8_t>& reply() const
+    {
+      return _reply;
+    }
+
+    // make a request frame w/o data like the client sends it
+    std::vector<int8_t> make_frame(shared::packet_code action) const;
+    // make a data request frame
+    std::vector<int8_t> make_frame(shared::packet_code action, const void* data, size_t size) const;
+    // make a text request frame
+    std::vector<int8_t> make_frame(shared::packet_code action, const std::string& text) const;
+
+  public:
+    // keep reply frame
+    void send_reply(shared::packet_code action) const;
+    // keep data reply frame
+    void send_reply(shared::packet_code action, const void* data, size_t size) const;
+    // keep text reply frame
+    void send_reply(shared::packet_code action, const std::string& text) const;
+    // keep error reply frame
+    void send_reply(shared::packet_code action, uint32_t error, const std::string& text) const;
+
+  private:
+    // make a frame of the head and data to the buffer
+    void encode(std::vector<int8_t>& frame, shared::packet_type type, shared::packet_code action, const void* data, size_t size) const;
+
+  private:
+    const dispatcher_t& _dispatcher;
+    shared::packet_kind _kind;
+    mutable std::vector<int8_t> _reply;
+  };
+
+}
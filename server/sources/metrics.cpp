@@ -0,0 +1,173 @@
+#include <sstream>
+#include <array>
+
+#include "metrics.h"
+#include "csnet_api.h"
+#include "logger.h"
+
+namespace csnet
+{
+
+  using namespace shared;
+
+  // upper bounds of latency buckets in seconds, +Inf is added
+  static const std::array<double, 19> _latency_bounds =
+  {
+    0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+    0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+  };
+
+  metrics_listener_t::metrics_listener_t(int port, collect_t collect) : _port(port), _collect(collect)
+  {
+  }
+
+  // stop the listener thread
+  metrics_listener_t::~metrics_listener_t()
+  {
+    stop();
+  }
+
+  // bind the port and start the listener thread, throw csnet_api_error if the port cannot be bound
+  void metrics_listener_t::start()
+  {
+    if (!_socket.create())
+      throw csnet_api_error(_socket.error_msg());
+
+    _socket.set_option(SOL_SOCKET, SO_REUSEADDR, 1);
+
+    sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (!_socket.bind((sockaddr*)&addr, sizeof(addr)) || !_socket.listen(16))
+    {
+      std::string error = _socket.error_msg();
+      _socket.close();
+      throw csnet_api_error(error);
+    }
+
+    _stop = false;
+    _thread = std::thread(&metrics_listener_t::run, this);
+  }
+
+  // stop the listener thread
+  void metrics_listener_t::stop()
+  {
+    _stop = true;
+    if (_thread.joinable())
+      _thread.join();
+    _socket.close();
+  }
+
+  // listener thread function
+  void metrics_listener_t::run()
+  {
+    LOGINFO("Metrics are served on port " << _port << ".");
+
+    while (!_stop)
+    {
+      // wake up every second to check the stop flag
+      if (_socket.read_ready(1, 0) <= 0)
+        continue;
+
+      socket_t client;
+      if (!_socket.accept(client))
+        continue;
+
+      try
+      {
+        serve(client);
+      }
+      catch (std::exception& e)
+      {
+        LOGFMT_RATE(log_level::warn, "Metrics request failed: {}", e.what());
+      }
+    }
+  }
+
+  // read a request and reply it
+  void metrics_listener_t::serve(socket_t& client)
+  {
+    // slow or idle scrapers cannot hold the thread for long
+    client.set_receive_timeout(2);
+
+    std::string request;
+    std::array<char, 1024> buf;
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+    {
+      size_t num = client.receive(buf.data(), buf.size());
+      if (num == 0 || num == (size_t)-1)
+        break;
+      request.append(buf.data(), num);
+    }
+
+    // request line 'GET /metrics HTTP/1.1'
+    std::string method, path;
+    std::stringstream line(request.substr(0, request.find("\r\n")));
+    line >> method >> path;
+    path = path.substr(0, path.find('?'));
+
+    std::string status = "200 OK";
+    std::string body;
+    if (method.empty())
+      return;
+    else if (method != "GET")
+      status = "405 Method Not Allowed";
+    else if (path != "/metrics" && path != "/")
+      status = "404 Not Found";
+    else
+      body = _collect();
+
+    std::stringstream reply;
+    reply << "HTTP/1.0 " << status << "\r\n"
+      << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+      << "Content-Length: " << body.size() << "\r\n"
+      << "Connection: close\r\n\r\n"
+      << body;
+
+    std::string data = reply.str();
+    for (size_t pos = 0; pos < data.size();)
+    {
+      size_t num = client.send(data.data() + pos, data.size() - pos);
+      if (num == 0 || num == (size_t)-1)
+        break;
+      pos += num;
+    }
+  }
+
+  // write HELP and TYPE lines of a metric
+  void metrics_listener_t::header(std::ostream& out, const std::string& name, const std::string& type, const std::string& help)
+  {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+  }
+
+  // write a sample, labels are like 'action="echo"'
+  void metrics_listener_t::sample(std::ostream& out, const std::string& name, const std::string& labels, double value)
+  {
+    out << name;
+    if (!labels.empty())
+      out << "{" << labels << "}";
+    // counters are written as integers
+    std::stringstream number;
+    number.precision(15);
+    number << value;
+    out << " " << number.str() << "\n";
+  }
+
+  // write cumulative buckets, sum and count of a histogram of ns values in seconds
+  void metrics_listener_t::histogram(std::ostream& out, const std::string& name, const std::string& labels, const histogram_t& histogram)
+  {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    for (double bound : _latency_bounds)
+    {
+      std::stringstream le;
+      le << bound;
+      sample(out, name + "_bucket", prefix + "le=\"" + le.str() + "\"", (double)histogram.count_below((uint64_t)(bound * 1e9)));
+    }
+    sample(out, name + "_bucket", prefix + "le=\"+Inf\"", (double)histogram.count());
+    sample(out, name + "_sum", labels, histogram.sum() / 1e9);
+    sample(out, name + "_count", labels, (double)histogram.count());
+  }
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "socket.h"
+#include "histogram.h"
+
+namespace csnet
+{
+
+  // minimal HTTP listener serving metrics in Prometheus text format
+  // it runs on its own thread and port, so scraping does not use request workers
+  class metrics_listener_t
+  {
+  public:
+    // make metrics text on a scrape
+    typedef std::function<std::string()> collect_t;
+
+  public:
+    metrics_listener_t(int port, collect_t collect);
+    // stop the listener thread
+    ~metrics_listener_t();
+
+    metrics_listener_t(const metrics_listener_t&) = delete;
+    metrics_listener_t& operator = (const metrics_listener_t&) = delete;
+
+  public:
+    // bind the port and start the listener thread, throw csnet_api_error if the port cannot be bound
+    void start();
+    // stop the listener thread
+    void stop();
+
+  public:
+    // write HELP and TYPE lines of a metric
+    static void header(std::ostream& out, const std::string& name, const std::string& type, const std::string& help);
+    // write a sample, labels are like 'action="echo"'
+    static void sample(std::ostream& out, const std::string& name, const std::string& labels, double value);
+    // write cumulative buckets, sum and count of a histogram of ns values in seconds
+    static void histogram(std::ostream& out, const std::string& name, const std::string& labels, const shared::histogram_t& histogram);
+
+  private:
+    // listener thread function
+    void run();
+    // read a request and reply it
+    void serve(shared::socket_t& client);
+
+  private:
+    int _port;
+    collect_t _collect;
+    shared::socket_t _socket;
+    std::thread _thread;
+    std::atomic<bool> _stop{ false };
+  };
+
+}
@@ -13,10 +13,13 @@
 #include "logger.h"
 #include "mysettings.h"
 #include "expression.h"
+#include "threadpool.h"
 
 namespace csnet
 {
 
+  using namespace shared;
+
   myservice_t::myservice_t()
   {
   }
@@ -29,14 +32,14 @@ namespace csnet
   // ping command
   uint64_t myservice_t::ping(uint64_t data) const
   {
-    LOGLINE("Ping action: " << data << ".");
+    LOGFMT_SAMPLE(log_level::trace, "Ping action: {}.", data);
     return data;
   }
 
   // check client credentials
   bool myservice_t::check_credentials(const std::string& login, const std::string& password) const
   {
-    LOGLINE("Check client credentials, login: " << login << ", password: " << password << ".");
+    LOGFMT_SAMPLE(log_level::trace, "Check client credentials, login: {}, password: {}.", login, password);
 
     return (login == mysettings_t::instance()->login() && password == mysettings_t::instance()->password());
   }
@@ -44,38 +47,38 @@ namespace csnet
   // echo server command
   std::string myservice_t::sendmsg(const std::string& msg) const
   {
-    LOGLINE("Echo server action.");
+    LOGFMT_SAMPLE(log_level::debug, "Echo server action.");
 
     std::string result(msg.size(), 0);
     // set string to upper
     std::transform(msg.cbegin(), msg.cend(), result.begin(), toupper);
 
-    LOGLINE("Echo: " << result << ".");
+    LOGFMT_SAMPLE(log_level::trace, "Echo: {}.", result);
     return result;
   }
 
   // get current time command
   std::time_t myservice_t::gettime() const
   {
-    LOGLINE("Get time action.");
+    LOGFMT_SAMPLE(log_level::debug, "Get time action.");
 
     // get current server time
     std::chrono::system_clock::time_point today = std::chrono::system_clock::now();
     std::time_t now = std::chrono::system_clock::to_time_t(today);
 
-    LOGLINE("Time: " << now << ".");
+    LOGFMT_SAMPLE(log_level::trace, "Time: {}.", now);
     return now;
   }
 
   // execute command
   std::string myservice_t::execmd(const std::string& cmd) const
   {
-    LOGLINE("Execute command: " << cmd << ".");
+    LOGFMT_SAMPLE(log_level::trace, "Execute command: {}.", cmd);
 
     // execute command and get command's result
     std::string result = exec(cmd);
 
-    LOGLINE("Command resul: " << result << ".");
+    LOGFMT_SAMPLE(log_level::trace, "Command resul: {}.", result);
     return result;
   }
 
@@ -87,6 +90,9 @@ namespace csnet
 
     try
     {
+      // the pool worker waits for the child process here
+      thread_pool_t::blocking_region_t blocking;
+
       std::array<char, 128 + 1> buffer;
       FILE* pipe = popen(cmd.c_str(), "r");
       if (!pipe)
@@ -125,7 +131,7 @@ namespace csnet
   // calculate command
   std::string myservice_t::calculate(const std::string& input) const
   {
-    LOGLINE("Calculate server action.");
+    LOGFMT_SAMPLE(log_level::debug, "Calculate server action.");
 
     std::stringstream buf;
 
@@ -133,7 +139,7 @@ namespace csnet
     {
       parser_t p(input);
       double result =  expression_t::eval(p.parse());
-      LOGLINE("Result: " << input << " = " << result << ".");
+      LOGFMT_SAMPLE(log_level::trace, "Result: {} = {}.", input, result);
       buf << result;
     }
     catch (std::exception& e) 
@@ -14,6 +14,7 @@
 
 #include "mysettings.h"
 #include "cfgparser.h"
+#include "affinity.h"
 
 namespace csnet
 {
@@ -24,6 +25,16 @@ namespace csnet
   template <> std::unique_ptr<mysettings_t, singleton<mysettings_t>::deleter> singleton<mysettings_t>::_instance = nullptr;
 
   constexpr int mysettings_t::_THREADS_ON_CORE;
+  constexpr int mysettings_t::_POOL_GROW_WAIT;
+  constexpr int mysettings_t::_POOL_IDLE_TIMEOUT;
+  constexpr int mysettings_t::_DRAIN_TIMEOUT;
+  constexpr int mysettings_t::_KEEP_ALIVE_TIMEOUT;
+  constexpr int mysettings_t::_LOG_QUEUE_SIZE;
+  constexpr int mysettings_t::_LOG_FLUSH_INTERVAL;
+  constexpr int mysettings_t::_LOG_FLUSH_SIZE;
+  constexpr int mysettings_t::_LOG_RATE_LIMIT;
+  constexpr int mysettings_t::_LOG_SEGMENTS;
+  constexpr const char* mysettings_t::_TRACE_FILE;
   const int mysettings_t::_MIN_THREAD_POOL = std::max<int>(std::thread::hardware_concurrency() * _THREADS_ON_CORE, _THREADS_ON_CORE);
 
   mysettings_t::mysettings_t(csnet::shared::settings_provider_t* provider) : settings_t(provider)
@@ -49,23 +60,91 @@ namespace csnet
   {
     std::string val = get_value("connect", "port");
     _port = std::atoi(val.c_str());
+    val = get_value("connect", "metrics_port");
+    _metrics_port = std::atoi(val.c_str());
 
     _login = get_value("connect", "login");
     _password = get_value("connect", "password");
 
+    val = get_value("behavior", "mode");
+    _mode = (val == "per_core") ? server_mode::per_core : server_mode::pool;
+
     val = get_value("behavior", "pool_count");
     _pool_count = std::atoi(val.c_str());
+    val = get_value("behavior", "pool_min_count");
+    _pool_min_count = std::atoi(val.c_str());
+    val = get_value("behavior", "pool_max_count");
+    _pool_max_count = std::atoi(val.c_str());
+    val = get_value("behavior", "pool_grow_wait");
+    _pool_grow_wait = std::atoi(val.c_str());
+    val = get_value("behavior", "pool_idle_timeout");
+    _pool_idle_timeout = std::atoi(val.c_str());
     val = get_value("behavior", "queue_count");
     _queue_count = std::atoi(val.c_str());
+    val = get_value("behavior", "drain_timeout");
+    _drain_timeout = val.empty() ? _DRAIN_TIMEOUT : std::atoi(val.c_str());
+    val = get_value("behavior", "keep_alive_timeout");
+    _keep_alive_timeout = val.empty() ? _KEEP_ALIVE_TIMEOUT : std::atoi(val.c_str());
+
+    _worker_affinity = affinity_t::parse(get_value("behavior", "worker_affinity"));
+    _io_affinity = affinity_t::parse(get_value("behavior", "io_affinity"));
 
     _logfile = get_value("debug", "logfile");
 
     val = get_value("debug", "log_disabled");
     _log_disabled = to_bool(val);
 
+    load_limits();
+
+    val = get_value("debug", "log_format");
+    _log_binary = (val == "binary");
+
+    val = get_value("debug", "log_segment_size");
+    _log_segment_size = std::atoi(val.c_str());
+    val = get_value("debug", "log_segments");
+    _log_segments = val.empty() ? _LOG_SEGMENTS : std::atoi(val.c_str());
+
+    val = get_value("debug", "trace_spans");
+    _trace_spans = std::atoi(val.c_str());
+    val = get_value("debug", "trace_file");
+    _trace_file = val.empty() ? _TRACE_FILE : val;
+
+    _capture_file = get_value("debug", "capture_file");
+    val = get_value("debug", "capture_sample_percent");
+    _capture_sample_percent = val.empty() ? 100 : std::atof(val.c_str());
+
+    val = get_value("debug", "log_async");
+    _log_async = !val.empty() && to_bool(val);
+    val = get_value("debug", "log_queue_size");
+    _log_queue_size = std::atoi(val.c_str());
+    val = get_value("debug", "log_flush_interval");
+    _log_flush_interval = std::atoi(val.c_str());
+    val = get_value("debug", "log_flush_size");
+    _log_flush_size = std::atoi(val.c_str());
+
+    check_values();
+  }
+
+  // re-read values which can be changed without restart
+  void mysettings_t::reload()
+  {
+    _provider->reload();
+
+    load_limits();
     check_values();
   }
 
+  // read log level and limits
+  void mysettings_t::load_limits()
+  {
+    _log_level = logger_t::to_level(get_value("debug", "log_level"));
+
+    std::string val = get_value("debug", "log_rate_limit");
+    _log_rate_limit = val.empty() ? _LOG_RATE_LIMIT : std::atoi(val.c_str());
+    val = get_value("debug", "log_sample_percent");
+    _log_sample_percent = val.empty() ? 100 : std::atof(val.c_str());
+  }
+
   // save settings
   void mysettings_t::save()
   {
@@ -81,9 +160,33 @@ namespace csnet
   {
     _daemon = false;
     _port = 0;
+    _metrics_port = 0;
+    _mode = server_mode::pool;
     _pool_count = _MIN_THREAD_POOL;
+    _pool_min_count = 0;
+    _pool_max_count = 0;
+    _pool_grow_wait = _POOL_GROW_WAIT;
+    _pool_idle_timeout = _POOL_IDLE_TIMEOUT;
     _queue_count = _MIN_THREAD_POOL;
+    _drain_timeout = _DRAIN_TIMEOUT;
+    _keep_alive_timeout = _KEEP_ALIVE_TIMEOUT;
+    _worker_affinity.clear();
+    _io_affinity.clear();
     _logfile.clear();
+    _log_async = false;
+    _log_binary = false;
+    _log_segment_size = 0;
+    _log_segments = _LOG_SEGMENTS;
+    _log_level = shared::log_level::info;
+    _log_rate_limit = _LOG_RATE_LIMIT;
+    _log_sample_percent = 100;
+    _log_queue_size = _LOG_QUEUE_SIZE;
+    _log_flush_interval = _LOG_FLUSH_INTERVAL;
+    _log_flush_size = _LOG_FLUSH_SIZE;
+    _trace_spans = 0;
+    _trace_file = _TRACE_FILE;
+    _capture_file.clear();
+    _capture_sample_percent = 100;
     _login.clear();
     _password.clear();
   }
@@ -101,6 +204,70 @@ namespace csnet
 
     if (_queue_count == 0)
       _queue_count = _MIN_THREAD_POOL;
+
+    // min <= pool_count <= max, zero means fixed size pool
+    if (_pool_min_count <= 0 || _pool_min_count > _pool_count)
+      _pool_min_count = _pool_count;
+
+    if (_pool_max_count < _pool_count)
+      _pool_max_count = _pool_count;
+
+    if (_pool_max_count > _MAX_THREAD_POOL)
+      _pool_max_count = _MAX_THREAD_POOL;
+
+    if (_drain_timeout < 0)
+      _drain_timeout = 0;
+
+    if (_keep_alive_timeout < 0)
+      _keep_alive_timeout = 0;
+
+    if (_log_queue_size <= 0)
+      _log_queue_size = _LOG_QUEUE_SIZE;
+
+    if (_log_flush_interval <= 0)
+      _log_flush_interval = _LOG_FLUSH_INTERVAL;
+
+    if (_log_flush_size < 0)
+      _log_flush_size = _LOG_FLUSH_SIZE;
+
+    if (_log_segment_size < 0)
+      _log_segment_size = 0;
+
+    if (_log_segments < 0)
+      _log_segments = _LOG_SEGMENTS;
+
+    if (_log_rate_limit < 0)
+      _log_rate_limit = 0;
+
+    if (_log_sample_percent < 0)
+      _log_sample_percent = 0;
+
+    if (_log_sample_percent > 100)
+      _log_sample_percent = 100;
+
+    if (_trace_spans < 0)
+      _trace_spans = 0;
+
+    if (_capture_sample_percent < 0)
+      _capture_sample_percent = 0;
+
+    if (_capture_sample_percent > 100)
+      _capture_sample_percent = 100;
+
+    if (_pool_grow_wait <= 0)
+      _pool_grow_wait = _POOL_GROW_WAIT;
+
+    if (_pool_idle_timeout <= 0)
+      _pool_idle_timeout = _POOL_IDLE_TIMEOUT;
+
+    // skip cpus the process may not run on, there may be gaps with offline cpus or a cpuset
+    std::vector<int> cpus = affinity_t::available();
+    if (!cpus.empty())
+    {
+      auto absent = [&cpus](int cpu) { return !std::binary_search(cpus.cbegin(), cpus.cend(), cpu); };
+      _worker_affinity.erase(std::remove_if(_worker_affinity.begin(), _worker_affinity.end(), absent), _worker_affinity.end());
+      _io_affinity.erase(std::remove_if(_io_affinity.begin(), _io_affinity.end(), absent), _io_affinity.end());
+    }
   }
 
 }
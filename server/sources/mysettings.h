@@ -1,11 +1,21 @@
 #pragma once
 
+#include <vector>
+
 #include "singleton.h"
 #include "settings.h"
+#include "logger.h"
 
 namespace csnet
 {
 
+  // server run mode
+  enum class server_mode
+  {
+    pool, // one acceptor thread hands connections to the thread pool
+    per_core // shared-nothing, each core owns its listener and connections
+  };
+
   // provide application settings class
   class mysettings_t : public shared::settings_t, public shared::singleton<mysettings_t>
   {
@@ -14,6 +24,16 @@ namespace csnet
     static constexpr int _THREADS_ON_CORE = 2;
     static const int _MIN_THREAD_POOL;
     static constexpr int _MAX_THREAD_POOL = 1024;
+    static constexpr int _POOL_GROW_WAIT = 50; // time in ms a task may wait before the pool grows
+    static constexpr int _POOL_IDLE_TIMEOUT = 30000; // time in ms a worker may be idle before the pool shrinks
+    static constexpr int _DRAIN_TIMEOUT = 5000; // time in ms to finish requests on exit
+    static constexpr int _KEEP_ALIVE_TIMEOUT = 30000; // time in ms an idle connection is kept after a reply
+    static constexpr int _LOG_QUEUE_SIZE = 65536; // async log queue size in lines
+    static constexpr int _LOG_FLUSH_INTERVAL = 100; // async log flush interval in ms
+    static constexpr int _LOG_FLUSH_SIZE = 65536; // async log flush size in bytes
+    static constexpr int _LOG_RATE_LIMIT = 1000; // max lines per second of a rate limited log call site
+    static constexpr int _LOG_SEGMENTS = 8; // count of kept log segment files
+    static constexpr const char* _TRACE_FILE = "csnet-trace.json"; // default request trace file
 
   protected:
     mysettings_t(csnet::shared::settings_provider_t* provider);
@@ -29,6 +49,8 @@ namespace csnet
     void save();
     // set default values
     void reset();
+    // re-read values which can be changed without restart
+    void reload();
 
   public:
     // is process daemon
@@ -45,21 +67,141 @@ namespace csnet
     {
       return _port;
     }
+    // get metrics http port, 0 - metrics are disabled
+    int metrics_port() const
+    {
+      return _metrics_port;
+    }
+    // get server run mode
+    server_mode mode() const
+    {
+      return _mode;
+    }
     // get thread pool count
     int pool_count() const
     {
       return _pool_count;
     }
+    // get min thread pool count
+    int pool_min_count() const
+    {
+      return _pool_min_count;
+    }
+    // get max thread pool count
+    int pool_max_count() const
+    {
+      return _pool_max_count;
+    }
+    // get time in ms a task may wait in the queue before the pool grows
+    int pool_grow_wait() const
+    {
+      return _pool_grow_wait;
+    }
+    // get time in ms a worker may be idle before the pool shrinks
+    int pool_idle_timeout() const
+    {
+      return _pool_idle_timeout;
+    }
+    // get time in ms to finish requests on exit
+    int drain_timeout() const
+    {
+      return _drain_timeout;
+    }
+    // get time in ms an idle connection is kept after a reply, 0 - it is closed at once
+    int keep_alive_timeout() const
+    {
+      return _keep_alive_timeout;
+    }
     // get listen queue count
     int queue_count() const
     {
       return _queue_count;
     }
+    // get cpus to bind the pool workers
+    const std::vector<int>& worker_affinity() const
+    {
+      return _worker_affinity;
+    }
+    // get cpus to bind the listener thread
+    const std::vector<int>& io_affinity() const
+    {
+      return _io_affinity;
+    }
     // get is log disabled
     bool log_disabled() const
     {
       return _log_disabled;
     }
+    // get is log written by background writer
+    bool log_async() const
+    {
+      return _log_async;
+    }
+    // get runtime log level
+    shared::log_level log_level() const
+    {
+      return _log_level;
+    }
+    // get max lines per second of a rate limited log call site, 0 - unlimited
+    int log_rate_limit() const
+    {
+      return _log_rate_limit;
+    }
+    // get percent of logged lines of a sampled log call site
+    double log_sample_percent() const
+    {
+      return _log_sample_percent;
+    }
+    // get log segment size in MB, 0 - log is a plain file
+    int log_segment_size() const
+    {
+      return _log_segment_size;
+    }
+    // get count of kept log segment files, 0 - keep all
+    int log_segments() const
+    {
+      return _log_segments;
+    }
+    // get is log written in binary format
+    bool log_binary() const
+    {
+      return _log_binary;
+    }
+    // get spans count kept per thread for request tracing, 0 - tracing is disabled
+    int trace_spans() const
+    {
+      return _trace_spans;
+    }
+    // get request trace file path
+    std::string trace_file() const
+    {
+      return _trace_file;
+    }
+    // get capture file of incoming frames, empty - capturing is disabled
+    std::string capture_file() const
+    {
+      return _capture_file;
+    }
+    // get percent of captured connections
+    double capture_sample_percent() const
+    {
+      return _capture_sample_percent;
+    }
+    // get async log queue size in lines
+    int log_queue_size() const
+    {
+      return _log_queue_size;
+    }
+    // get async log flush interval in ms
+    int log_flush_interval() const
+    {
+      return _log_flush_interval;
+    }
+    // get async log flush size in bytes
+    int log_flush_size() const
+    {
+      return _log_flush_size;
+    }
     // get logfile path
     std::string logfile() const
     {
@@ -79,14 +221,40 @@ namespace csnet
   protected:
     // check values and correct
     virtual void check_values();
+    // read log level and limits, they can be changed without restart
+    void load_limits();
 
   private:
     bool _daemon;
     int _port;
+    int _metrics_port;
+    server_mode _mode;
     int _pool_count;
+    int _pool_min_count;
+    int _pool_max_count;
+    int _pool_grow_wait;
+    int _pool_idle_timeout;
     int _queue_count;
+    int _drain_timeout;
+    int _keep_alive_timeout;
+    std::vector<int> _worker_affinity;
+    std::vector<int> _io_affinity;
     std::string _logfile;
     bool _log_disabled;
+    bool _log_async;
+    bool _log_binary;
+    int _log_segment_size;
+    int _log_segments;
+    shared::log_level _log_level;
+    int _log_rate_limit;
+    double _log_sample_percent;
+    int _log_queue_size;
+    int _trace_spans;
+    std::string _trace_file;
+    std::string _capture_file;
+    double _capture_sample_percent;
+    int _log_flush_interval;
+    int _log_flush_size;
     std::string _login;
     std::string _password;
   };
@@ -1,8 +1,24 @@
+#ifdef _WIN32
+#else
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 #include <cstring>
+#include <cstdlib>
 #include <sstream>
+#include <iomanip>
+#include <array>
+#include <map>
+#include <thread>
+#include <functional>
+#include <algorithm>
 
 #include "server.h"
 #include "threadpool.h"
+#include "affinity.h"
+#include "mysettings.h"
 #include "logger.h"
 
 namespace csnet
@@ -11,7 +27,8 @@ namespace csnet
   using namespace shared;
 
   // socket server class
-  myserver_t::myserver_t(std::unique_ptr<service_i> handler) : _handler(std::move(handler)), _signal(this, &myserver_t::onsignal)
+  myserver_t::myserver_t(std::unique_ptr<service_i> handler) : _handler(std::move(handler)),
+    _dispatcher(*_handler, [this] { return stats_text(); }, [this] { return dump_trace(); }), _signal(this, &myserver_t::onsignal)
   {
 #ifdef _WIN32
     WSADATA wsaData;
@@ -23,6 +40,11 @@ namespace csnet
   {
     stop();
 
+#ifndef _WIN32
+    if (_wakeup >= 0)
+      ::close(_wakeup);
+#endif
+
 #ifdef _WIN32
     if (_cancel == INVALID_SOCKET)
       ::closesocket(_cancel);
@@ -31,22 +53,29 @@ namespace csnet
   }
 
   // init server
-  void myserver_t::init_socket(int port, int queue_count)
+  void myserver_t::init_socket(packet_socket_t& socket, int port, int queue_count, bool reuse_port)
   {
-    if (!_socket.create())
-      throw csnet_api_error(_socket.error_msg());
+    if (!socket.create())
+      throw csnet_api_error(socket.error_msg());
 
-    _socket.set_unblocking(true);
+    socket.set_unblocking(true);
+
+    // allow to restart the server while old connections are in TIME_WAIT
+    socket.set_option(SOL_SOCKET, SO_REUSEADDR, 1);
+#ifdef SO_REUSEPORT
+    if (reuse_port && !socket.set_option(SOL_SOCKET, SO_REUSEPORT, 1))
+      throw csnet_api_error(socket.error_msg());
+#endif
 
     // init and bind socket
     sockaddr_in addr;
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     addr.sin_addr.s_addr = INADDR_ANY;
-    if (!_socket.bind((sockaddr*)&addr, sizeof(addr)))
-      throw csnet_api_error(_socket.error_msg());
+    if (!socket.bind((sockaddr*)&addr, sizeof(addr)))
+      throw csnet_api_error(socket.error_msg());
 
-    _socket.listen(queue_count);
+    socket.listen(queue_count);
   }
 
   void myserver_t::init_signal()
@@ -58,12 +87,17 @@ namespace csnet
     // need to notify select() to exit
     _cancel = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 #else
+    // wake up core loops, it is safe to write to it in a signal handler
+    _wakeup = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
     _signal.connect(SIGQUIT);
 #endif
 
     _signal.connect(SIGINT);
     _signal.connect(SIGTERM);
-    //_signal.connect(SIGHUP);
+#ifndef _WIN32
+    _signal.connect(SIGHUP);
+    _signal.connect(SIGUSR1);
+#endif
   }
 
   // signals handler
@@ -79,6 +113,7 @@ namespace csnet
     {
       // need to exit
       _finished = true;
+      wakeup();
 
 #ifdef _WIN32
       // set cancel event to exit
@@ -90,9 +125,18 @@ namespace csnet
       }
 #endif
     }
-    /*else if (signal == SIGHUP)
+#ifndef _WIN32
+    else if (signal == SIGHUP)
     {
-    }*/
+      // re-read settings out of the signal handler
+      _reload = true;
+    }
+    else if (signal == SIGUSR1)
+    {
+      // write request trace out of the signal handler
+      _dump = true;
+    }
+#endif
   }
 
   // start server
@@ -101,175 +145,1050 @@ namespace csnet
     int status = 0;
     try
     {
-      init_socket(port, queue_count);
       init_signal();
+      _tracer.set_capacity(mysettings_t::instance()->trace_spans());
+      _keep_alive = mysettings_t::instance()->keep_alive_timeout();
 
-      // init thread pool by threads number
-      thread_pool_t pool(pool_count);
+      // metrics are optional, the server works without them
+      if (mysettings_t::instance()->metrics_port() > 0)
+      {
+        try
+        {
+          _metrics = std::make_unique<metrics_listener_t>(mysettings_t::instance()->metrics_port(), [this] { return metrics(); });
+          _metrics->start();
+        }
+        catch (std::exception& e)
+        {
+          LOGWARN("Metrics listener cannot be started on port " << mysettings_t::instance()->metrics_port() << ": " << e.what());
+          _metrics.reset();
+        }
+      }
 
-      // main server loop
-      while (!is_finished())
+      // capture is optional too
+      if (!mysettings_t::instance()->capture_file().empty())
       {
-        LOGLINE("Waitnig for connection.");
+        try
+        {
+          _capture.open(mysettings_t::instance()->capture_file(), mysettings_t::instance()->capture_sample_percent());
+          LOGINFO("Incoming frames of " << mysettings_t::instance()->capture_sample_percent() << "% connections are captured to "
+            << mysettings_t::instance()->capture_file() << ".");
+        }
+        catch (std::exception& e)
+        {
+          LOGWARN("Capture cannot be started: " << e.what());
+        }
+      }
 
-        // wait socket data to read
 #ifdef _WIN32
-        int ret = _socket.read_ready(-1, 0, _cancel);
+      if (mysettings_t::instance()->mode() == server_mode::per_core)
+        LOGWARN("Per-core mode is not supported in Windows, pool mode is used.");
 #else
-        int ret = _socket.read_ready();
+      if (mysettings_t::instance()->mode() == server_mode::per_core)
+        run_per_core(port, pool_count, queue_count);
+      else
+#endif
+        run_pool(port, pool_count, queue_count);
+    }
+    catch (drain_timeout_error&)
+    {
+      // the abandoned requests are logged already
+      status = DRAIN_TIMEOUT;
+    }
+    catch (std::exception& e)
+    {
+      LOGERROR("Error occurred: " << e.what());
+      status = -1;
+    }
+    catch (...)
+    {
+      LOGERROR("Error occurred: " << "unexception error.");
+      status = -2;
+    }
+
+    if (_metrics)
+      _metrics->stop();
+    _capture.close();
+
+    return status;
+  }
+
+  // run acceptor with thread pool
+  void myserver_t::run_pool(int port, int pool_count, int queue_count)
+  {
+    init_socket(_socket, port, queue_count);
+
+    // bind the listener thread
+    int io_cpu = affinity_t::cpu_of(mysettings_t::instance()->io_affinity(), 0);
+    if (!affinity_t::bind(io_cpu))
+      LOGWARN("Listener thread cannot be bound to cpu " << io_cpu << ".");
+
+#ifndef _WIN32
+    // the listener and kept connections are waited in one epoll, workers add kept connections to it
+    // it is created before the pool, so it is closed after workers are joined
+    std::unique_ptr<int, std::function<void(int*)>> epoll(new int(::epoll_create1(EPOLL_CLOEXEC)), [this](int* fd)
+    {
+      std::lock_guard<std::mutex> lck(_kept_mtx);
+      _poll = -1;
+      if (*fd >= 0)
+        ::close(*fd);
+      delete fd;
+    });
+    if (*epoll < 0)
+      throw csnet_api_error(std::strerror(errno));
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = _socket.socket();
+    ::epoll_ctl(*epoll, EPOLL_CTL_ADD, _socket.socket(), &event);
+    event.data.fd = _wakeup;
+    ::epoll_ctl(*epoll, EPOLL_CTL_ADD, _wakeup, &event);
+    {
+      std::lock_guard<std::mutex> lck(_kept_mtx);
+      _poll = *epoll;
+    }
+    std::array<epoll_event, 64> events;
+    request_stats_t::clock_t::time_point evicted = request_stats_t::clock_t::now();
+#endif
+
+    // init thread pool by threads number
+    pool_policy_t policy;
+    policy.min_threads = mysettings_t::instance()->pool_min_count();
+    policy.max_threads = mysettings_t::instance()->pool_max_count();
+    policy.grow_wait = std::chrono::milliseconds(mysettings_t::instance()->pool_grow_wait());
+    policy.idle_timeout = std::chrono::milliseconds(mysettings_t::instance()->pool_idle_timeout());
+    // the pool is left running if the drain timeout is expired
+    std::unique_ptr<thread_pool_t> workers(new thread_pool_t(pool_count, policy, mysettings_t::instance()->worker_affinity()));
+    thread_pool_t& pool = *workers;
+
+    // log final thread-to-core map
+    std::stringstream map;
+    map << "io -> " << (io_cpu < 0 ? std::string("any") : std::to_string(io_cpu));
+    for (int i = 0; i < pool_count; i++)
+    {
+      int cpu = affinity_t::cpu_of(pool.cpus(), i);
+      map << ", worker " << i << " -> " << (cpu < 0 ? std::string("any") : std::to_string(cpu));
+    }
+    LOGLINE("Thread-to-core map: " << map.str() << ".");
+
+    {
+      std::lock_guard<std::mutex> lck(_pool_mtx);
+      _pool = &pool;
+    }
+    // the pool is not seen by metrics after leaving
+    std::unique_ptr<thread_pool_t, std::function<void(thread_pool_t*)>> unset(&pool, [this](thread_pool_t*)
+    {
+      std::lock_guard<std::mutex> lck(_pool_mtx);
+      _pool = nullptr;
+    });
+
+    // main server loop
+    while (!is_finished())
+    {
+      on_requests();
+
+      LOGFMT_RATE(log_level::trace, "Waitnig for connection.");
+
+      // wait socket data to read
+#ifdef _WIN32
+      int ret = _socket.read_ready(-1, 0, _cancel);
+      int error = _socket.error();
+#else
+      // wake up every second to evict idle kept connections
+      int ret = ::epoll_wait(*epoll, events.data(), events.size(), 1000);
+      int error = errno;
+#endif
+      if ((ret < 0 && error != EINTR) || is_finished())
+      {
+        if (is_finished())
+        {
+          LOGDEBUG("Leave the server loop.");
+          break;
+        }
+        else
+        {
+          std::stringstream buf;
+#ifdef _WIN32
+          buf << "Socket selecting failed, errno: " << _socket.error_msg();
+#else
+          buf << "Socket selecting failed, errno: " << std::strerror(error);
+#endif
+          throw std::runtime_error(buf.str());
+        }
+      }
+
+#ifdef _WIN32
+      if (ret > 0)
+        accept(pool);
+#else
+      for (int i = 0; i < ret; i++)
+      {
+        if (events[i].data.fd == _socket.socket())
+          accept(pool);
+        else if (events[i].data.fd != _wakeup) // is_finished() is checked by the loop
+          resume(pool, events[i].data.fd); // a kept connection has a next request or it is closed
+      }
+
+      // evict idle kept connections once a second
+      if (request_stats_t::clock_t::now() - evicted >= std::chrono::seconds(1))
+      {
+        std::lock_guard<std::mutex> lck(_kept_mtx);
+        evict(_kept, *epoll, false);
+        evicted = request_stats_t::clock_t::now();
+      }
+#endif
+
+      if (is_finished())
+        break;
+    }
+
+    // take connections waiting in the backlog, stop accepting
+    // and finish queued and running requests up to the deadline
+    while (accept(pool, false))
+    {
+    }
+    _socket.close();
+
+#ifndef _WIN32
+    // idle kept connections have no requests to finish
+    {
+      std::lock_guard<std::mutex> lck(_kept_mtx);
+      evict(_kept, *epoll, true);
+    }
 #endif
-        if (ret < 0 || is_finished())
+
+    LOGLINE("Draining " << pool.queued() << " queued and " << pool.active() << " running requests.");
+    if (pool.drain(std::chrono::milliseconds(mysettings_t::instance()->drain_timeout())))
+    {
+      LOGLINE("All requests are finished.");
+      pool.close(true, false);
+    }
+    else
+    {
+      LOGWARN("Drain timeout is expired, abandoned " << pool.queued() << " queued and " << pool.active() << " running requests.");
+
+      // running tasks cannot be cancelled and they use the server and the pool,
+      // so the pool is not joined and the caller leaves the process without waiting for them
+      workers.release();
+      throw drain_timeout_error("Drain timeout is expired.");
+    }
+  }
+
+#ifndef _WIN32
+  // run shared-nothing thread per core, blocking requests are run by a pool of 'pool_count' workers
+  void myserver_t::run_per_core(int port, int pool_count, int queue_count)
+  {
+    // a core per cpu from worker affinity or all cpus of the process
+    std::vector<int> cpus = mysettings_t::instance()->worker_affinity();
+    if (cpus.empty())
+      cpus = affinity_t::available();
+    if (cpus.empty())
+      cpus.push_back(0);
+
+    // log final thread-to-core map
+    std::stringstream map;
+    for (size_t i = 0; i < cpus.size(); i++)
+      map << (i ? ", " : "") << "core " << i << " -> " << cpus[i];
+    LOGLINE("Thread-to-core map: " << map.str() << ".");
+
+    // workers of blocking requests are not bound, the cores own the cpus
+    pool_policy_t policy;
+    policy.min_threads = mysettings_t::instance()->pool_min_count();
+    policy.max_threads = mysettings_t::instance()->pool_max_count();
+    policy.grow_wait = std::chrono::milliseconds(mysettings_t::instance()->pool_grow_wait());
+    policy.idle_timeout = std::chrono::milliseconds(mysettings_t::instance()->pool_idle_timeout());
+    // the pool is left running if the drain timeout is expired
+    std::unique_ptr<thread_pool_t> workers(new thread_pool_t(pool_count, policy));
+    thread_pool_t& blocking = *workers;
+
+    {
+      std::lock_guard<std::mutex> lck(_pool_mtx);
+      _pool = &blocking;
+    }
+    // the pool is not seen by metrics after leaving
+    std::unique_ptr<thread_pool_t, std::function<void(thread_pool_t*)>> unset(&blocking, [this](thread_pool_t*)
+    {
+      std::lock_guard<std::mutex> lck(_pool_mtx);
+      _pool = nullptr;
+    });
+
+    std::vector<std::thread> cores;
+    std::vector<std::exception_ptr> errors(cpus.size());
+    for (size_t i = 0; i < cpus.size(); i++)
+    {
+      cores.emplace_back([this, i, &cpus, &errors, &blocking, port, queue_count]
+      {
+        try
+        {
+          run_core(i, cpus[i], port, queue_count, blocking);
+        }
+        catch (...)
         {
-          if (is_finished())
+          // stop other cores too
+          errors[i] = std::current_exception();
+          _finished = true;
+          wakeup();
+        }
+      });
+    }
+
+    // cores wake up by the eventfd on exit only, so settings are reloaded here
+    while (!is_finished())
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      on_requests();
+    }
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mysettings_t::instance()->drain_timeout());
+
+    for (std::thread& core : cores)
+      core.join();
+
+    for (std::exception_ptr& error : errors)
+    {
+      if (error)
+        std::rethrow_exception(error);
+    }
+
+    // cores wait for their blocking requests up to the deadline, the rest ones are abandoned
+    std::chrono::steady_clock::duration left = std::max(deadline - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero());
+    if (blocking.drain(std::chrono::duration_cast<std::chrono::milliseconds>(left)))
+    {
+      blocking.close(true, false);
+    }
+    else
+    {
+      LOGWARN("Drain timeout is expired, abandoned " << blocking.queued() << " queued and " << blocking.active() << " running blocking requests.");
+
+      // running tasks cannot be cancelled and they use the server and the pool,
+      // so the pool is not joined and the caller leaves the process without waiting for them
+      workers.release();
+      throw drain_timeout_error("Drain timeout is expired.");
+    }
+  }
+
+  // one core loop, it owns its listener, connections and stats
+  void myserver_t::run_core(size_t index, int cpu, int port, int queue_count, thread_pool_t& blocking)
+  {
+    if (!affinity_t::bind(cpu))
+      LOGWARN("Core " << index << " cannot be bound to cpu " << cpu << ".");
+
+    // own listener, the kernel balances connections between cores by SO_REUSEPORT
+    packet_socket_t listener;
+    init_socket(listener, port, queue_count, true);
+
+    std::unique_ptr<int, std::function<void(int*)>> epoll(new int(::epoll_create1(EPOLL_CLOEXEC)), [](int* fd) { if (*fd >= 0) ::close(*fd); delete fd; });
+    if (*epoll < 0)
+      throw csnet_api_error(std::strerror(errno));
+
+    // workers give connections of blocking requests back by the handoff, workers finishing later close them
+    std::shared_ptr<handoff_t> handoff = std::make_shared<handoff_t>();
+    std::unique_ptr<handoff_t, std::function<void(handoff_t*)>> leave(handoff.get(), [this](handoff_t* handoff)
+    {
+      std::lock_guard<std::mutex> lck(handoff->mtx);
+      handoff->closed = true;
+      for (handoff_t::returned_t& returned : handoff->returned)
+      {
+        ::close(returned.socket);
+        _stats.record_close();
+      }
+      handoff->returned.clear();
+      if (handoff->event >= 0)
+        ::close(handoff->event);
+      handoff->event = -1;
+    });
+    handoff->event = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (handoff->event < 0)
+      throw csnet_api_error(std::strerror(errno));
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = listener.socket();
+    ::epoll_ctl(*epoll, EPOLL_CTL_ADD, listener.socket(), &event);
+    event.data.fd = _wakeup;
+    ::epoll_ctl(*epoll, EPOLL_CTL_ADD, _wakeup, &event);
+    event.data.fd = handoff->event;
+    ::epoll_ctl(*epoll, EPOLL_CTL_ADD, handoff->event, &event);
+
+    core_stats_t stats;
+    connections_t connections;
+    size_t handed = 0; // connections at workers
+    std::array<epoll_event, 64> events;
+
+    bool draining = false;
+    std::chrono::steady_clock::time_point deadline;
+    request_stats_t::clock_t::time_point evicted = request_stats_t::clock_t::now();
+
+    // count the result and keep the connection for next requests on this core, the socket is closed otherwise
+    auto finish = [&](packet_socket_t& socket, connection_t& connection, handle_result result)
+    {
+      if (result == handle_result::replied)
+        stats.requests++;
+      else if (result == handle_result::failed)
+        stats.errors++;
+
+      if (result == handle_result::replied && _keep_alive > 0 && !draining)
+      {
+        connection.kept = true;
+        connection.accepted = request_stats_t::clock_t::now();
+        socket_t::SOCKET_HANDLE hsocket = socket.detach();
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = hsocket;
+        ::epoll_ctl(*epoll, EPOLL_CTL_ADD, hsocket, &event);
+        connections.emplace(hsocket, std::move(connection));
+      }
+      else
+      {
+        _stats.record_close(); // the socket is closed on leaving the caller scope
+      }
+    };
+
+    for (;;)
+    {
+      // wake up every second to evict idle kept connections
+      int timeout = _keep_alive > 0 ? 1000 : -1;
+      if (!draining && is_finished())
+      {
+        // take connections waiting in the backlog, stop accepting
+        // and serve connected clients up to the deadline
+        draining = true;
+        deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mysettings_t::instance()->drain_timeout());
+
+        ::epoll_ctl(*epoll, EPOLL_CTL_DEL, _wakeup, nullptr);
+        ::epoll_ctl(*epoll, EPOLL_CTL_DEL, listener.socket(), nullptr);
+        accept_all(listener, *epoll, connections, stats);
+        listener.close();
+
+        // idle kept connections have no requests to finish
+        evict(connections, *epoll, true);
+
+        LOGLINE("Core " << index << " drains " << connections.size() << " connections and " << handed << " blocking requests.");
+      }
+
+      if (draining)
+      {
+        std::chrono::steady_clock::duration left = deadline - std::chrono::steady_clock::now();
+        if ((connections.empty() && !handed) || left <= std::chrono::steady_clock::duration::zero())
+          break;
+        timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(left).count() + 1;
+      }
+
+      int count = ::epoll_wait(*epoll, events.data(), events.size(), timeout);
+      if (count < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throw csnet_api_error(std::strerror(errno));
+      }
+
+      for (int i = 0; i < count; i++)
+      {
+        int fd = events[i].data.fd;
+        if (fd == _wakeup)
+        {
+          continue; // is_finished() is checked by the loop
+        }
+        else if (!draining && fd == listener.socket())
+        {
+          accept_all(listener, *epoll, connections, stats);
+        }
+        else if (fd == handoff->event)
+        {
+          // take connections of blocking requests back from workers
+          uint64_t value;
+          if (::read(fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+            throw csnet_api_error(std::strerror(errno));
+
+          std::vector<handoff_t::returned_t> returned;
           {
-            LOGLINE("Leave the server loop.");
-            break;
+            std::lock_guard<std::mutex> lck(handoff->mtx);
+            returned.swap(handoff->returned);
           }
-          else
+          for (handoff_t::returned_t& item : returned)
           {
-            std::stringstream buf;
-            buf << "Socket selecting failed, errno: " << _socket.error_msg();
-            throw std::runtime_error(buf.str());
+            handed--;
+            packet_socket_t socket(item.socket);
+            finish(socket, item.connection, item.result);
           }
         }
-        else if (ret)
+        else
         {
-          LOGLINE("Accepting socket.");
-          packet_socket_t accepted;
-          if (!_socket.accept(accepted))
-          {
-            std::stringstream buf;
-            buf << "Socket accepting failed: " << _socket.error_msg();
-            throw std::runtime_error(buf.str());
-          }
-
-          socket_t::SOCKET_HANDLE hsocket = accepted.detach();
+          // connection has a part of a request, it is read without blocking the core
+          auto found = connections.find(fd);
+          if (found == connections.end())
+            continue;
 
-          LOGLINE("Add job to pool.");
-          pool.enqueue([this, hsocket] // handle net request
+          read_result read = read_frame(fd, found->second);
+          if (read == read_result::partial)
           {
-            // thread code
-            try
+            // the request is started, the connection is not idle anymore
+            if (found->second.kept && !found->second.received.empty())
             {
-              srvapi_t srvapi;
-              srvapi.onaccept(packet_socket_t(hsocket));
-
-              LOGLINE("Recieving socket data.");
-
-              if (!srvapi.receive())
-              {
-                LOGLINE("There is no any data recieved.");
-                //LOGLINE((srvapi.error_msg().empty() ? "There is no any data recieved." : srvapi.error_msg()));
-              }
-              else if (srvapi.is_packet_of(packet_type::P_DATA_TYPE, packet_code::P_CREDENTIALS_ACTION))
-              {
-                // it is check credentials action
-                packet_data_t* packet_data = srvapi.packet<packet_data_t>();
-
-                credentials_info_t* ci = reinterpret_cast<credentials_info_t*>(packet_data->data);
-
-                // extract params
-                std::string login(ci->data, ci->login_len);
-                std::string password(ci->data + ci->login_len, ci->password_len);
-
-                // check login and password
-                if (!_handler->check_credentials(login, password))
-                  srvapi.send_reply(packet_data->action, (uint32_t)-1, "Invalid credentials");
-                else
-                  srvapi.send_reply(packet_data->action); // replay OK to client
-              }
-              else if (srvapi.is_packet_of(packet_type::P_DATA_TYPE, packet_code::P_PING_ACTION))
-              {
-                // it is ping action
-                packet_data_t* packet_data = srvapi.packet<packet_data_t>();
-                uint64_t result = _handler->ping(reinterpret_cast<uint64_t>(packet_data->data));
-
-                // replay pind data to client
-                srvapi.send_reply(packet_data->action, reinterpret_cast<int8_t*>(result), sizeof(uint64_t));
-              }
-              else if (srvapi.is_packet_of(packet_type::P_TEXT_TYPE, packet_code::P_ECHO_ACTION))
-              {
-                // it is echo server action
-                packet_text_t* packet_text = srvapi.packet<packet_text_t>();
-                std::string result = _handler->sendmsg(packet_text->text);
-
-                // replay string to client
-                srvapi.send_reply(packet_text->action, result);
-              }
-              else if (srvapi.is_packet_of(packet_type::P_NULL_TYPE, packet_code::P_TIME_ACTION))
-              {
-                // it is gettime action
-                std::time_t now = _handler->gettime();
-
-                // replay time to client
-                srvapi.send_reply(packet_code::P_TIME_ACTION, reinterpret_cast<int8_t*>(&now), sizeof(now));
-              }
-              else if (srvapi.is_packet_of(packet_type::P_TEXT_TYPE, packet_code::P_EXECMD_ACTION))
-              {
-                // it is execute cmd action
-                packet_text_t* packet_text = srvapi.packet<packet_text_t>();
-                std::string result = _handler->execmd(packet_text->text);
-
-                // replay command's result to client
-                srvapi.send_reply(packet_text->action, result);
-              }
-              else if (srvapi.is_packet_of(packet_type::P_TEXT_TYPE, packet_code::P_CALC_ACTION))
-              {
-                // it is calculate server action
-                packet_text_t* packet_text = srvapi.packet<packet_text_t>();
-                std::string result = _handler->calculate(packet_text->text);
-
-                // replay string to client
-                srvapi.send_reply(packet_text->action, result);
-              }
-              else
-              {
-                // it is unknown action
-                packet_info_t* packet = srvapi.packet<packet_info_t>();
-                srvapi.send_reply(packet->action, (uint32_t)-2, "Unknown packet");
-              }
+              renew(found->second);
+              found->second.kept = false;
             }
-            catch (std::exception& e)
-            {
-              LOGLINE("Error occurred: " << e.what());
-            }
-            catch (...)
+            continue;
+          }
+
+          ::epoll_ctl(*epoll, EPOLL_CTL_DEL, fd, nullptr);
+          connection_t connection = std::move(found->second);
+          connections.erase(found);
+          packet_socket_t socket(fd);
+          if (read != read_result::whole)
+          {
+            if (read == read_result::failed)
             {
-              LOGLINE("Error occurred: " << "unexception error.");
+              _stats.record_error();
+              stats.errors++;
             }
-          });
+            _stats.record_close();
+            continue;
+          }
+          if (connection.kept)
+            renew(connection);
+
+          // blocking requests are run by workers, the core takes their connections back after replies
+          if (_dispatcher.is_blocking(*reinterpret_cast<const packet_info_t*>(connection.received.data())))
+          {
+            hand_off(blocking, handoff, socket.detach(), std::move(connection));
+            handed++;
+            continue;
+          }
+
+          // reply it on this core
+          handle_result result = handle(socket, connection, &connection.received);
+          connection.received.clear();
+          finish(socket, connection, result);
         }
+      }
 
-        if (is_finished())
-          break;
+      // evict idle kept connections once a second
+      if (!draining && _keep_alive > 0 && request_stats_t::clock_t::now() - evicted >= std::chrono::seconds(1))
+      {
+        evict(connections, *epoll, false);
+        evicted = request_stats_t::clock_t::now();
+      }
+    }
+
+    // close connections without requests
+    for (auto& connection : connections)
+    {
+      ::close(connection.first);
+      _stats.record_close();
+    }
+
+    LOGLINE("Core " << index << " is finished, accepted: " << stats.accepted << ", requests: " << stats.requests
+      << ", errors: " << stats.errors << ", abandoned: " << connections.size() + handed << ".");
+  }
+#endif
+
+#ifndef _WIN32
+  // accept all pending connections of the core listener
+  void myserver_t::accept_all(packet_socket_t& listener, int epoll, connections_t& connections, core_stats_t& stats)
+  {
+    packet_socket_t accepted;
+    for (request_stats_t::clock_t::time_point accepting = request_stats_t::clock_t::now(); listener.accept(accepted);
+      accepting = request_stats_t::clock_t::now())
+    {
+      socket_t::SOCKET_HANDLE hsocket = accepted.detach();
+
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.fd = hsocket;
+      ::epoll_ctl(epoll, EPOLL_CTL_ADD, hsocket, &event);
+
+      connection_t connection;
+      connection.accepted = request_stats_t::clock_t::now();
+      connection.id = trace_accept(accepting, connection.accepted);
+      connection.capture = _capture.connection();
+      connections.emplace(hsocket, connection);
+      _stats.record_accept();
+      stats.accepted++;
+    }
+  }
+  // read the next request frame of a per-core connection without blocking
+  myserver_t::read_result myserver_t::read_frame(socket_t::SOCKET_HANDLE socket, connection_t& connection)
+  {
+    std::vector<int8_t>& frame = connection.received;
+    for (;;)
+    {
+      // the size field is read first, then the rest of the frame
+      size_t size = sizeof(uint16_t);
+      if (frame.size() >= sizeof(uint16_t))
+      {
+        uint16_t packet_size;
+        std::memcpy(&packet_size, frame.data(), sizeof(packet_size));
+        if (packet_size < sizeof(packet_info_t))
+        {
+          LOGFMT(log_level::debug, "Malformed packet is recieved.");
+          return read_result::failed;
+        }
+        size = packet_size;
+        if (frame.size() == size)
+          return read_result::whole;
+      }
+
+      size_t read = frame.size();
+      frame.resize(size);
+      ssize_t num = ::recv(socket, frame.data() + read, size - read, MSG_DONTWAIT);
+      frame.resize(read + std::max<ssize_t>(num, 0));
+      if (num > 0)
+        continue;
+      if (num < 0 && errno == EINTR)
+        continue;
+      if (num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return read_result::partial;
+
+      // the client closes a kept connection when it does not need it anymore
+      if (num == 0 && connection.kept && frame.empty())
+      {
+        LOGFMT_RATE(log_level::trace, "Kept connection is closed by the client.");
+        return read_result::closed;
+      }
+
+      LOGFMT(log_level::debug, "There is no any data recieved.");
+      return read_result::failed;
+    }
+  }
+
+  // run a blocking request of a per-core connection by a worker, the connection goes back to the core by the handoff
+  void myserver_t::hand_off(thread_pool_t& pool, const std::shared_ptr<handoff_t>& handoff, socket_t::SOCKET_HANDLE socket, connection_t connection)
+  {
+    pool.enqueue([this, handoff, socket, connection = std::move(connection)]() mutable
+    {
+      packet_socket_t request(socket);
+      handle_result result = handle(request, connection, &connection.received);
+      connection.received.clear();
+
+      std::lock_guard<std::mutex> lck(handoff->mtx);
+      if (handoff->closed)
+      {
+        // the core has left, the socket is closed on leaving
+        _stats.record_close();
+        return;
+      }
+      handoff->returned.push_back({ request.detach(), std::move(connection), result });
+      uint64_t value = 1;
+      if (::write(handoff->event, &value, sizeof(value)) < 0)
+        return; // the eventfd stays readable until the core reads it
+    });
+  }
+#endif
+
+  // notify waiting loops to check is_finished()
+  void myserver_t::wakeup()
+  {
+#ifndef _WIN32
+    if (_wakeup >= 0)
+    {
+      // eventfd is never read so it stays readable for every core
+      uint64_t value = 1;
+      if (::write(_wakeup, &value, sizeof(value)) < 0)
+        return;
+    }
+#endif
+  }
+
+  // accept a connection of the pool mode and queue its request, false if there is no connection
+  bool myserver_t::accept(thread_pool_t& pool, bool strict)
+  {
+    LOGFMT_RATE(log_level::trace, "Accepting socket.");
+    packet_socket_t accepted;
+    request_stats_t::clock_t::time_point accepting = request_stats_t::clock_t::now();
+    if (!_socket.accept(accepted))
+    {
+#ifndef _WIN32
+      // the listener is non-blocking, the connection may be reset before it is accepted
+      if (_socket.error() == EAGAIN || _socket.error() == EWOULDBLOCK)
+        return false;
+#endif
+      if (!strict)
+        return false;
+
+      std::stringstream buf;
+      buf << "Socket accepting failed: " << _socket.error_msg();
+      throw std::runtime_error(buf.str());
+    }
+
+    _stats.record_accept();
+
+    connection_t connection;
+    connection.accepted = request_stats_t::clock_t::now();
+    connection.id = trace_accept(accepting, connection.accepted);
+    connection.capture = _capture.connection();
+
+    LOGFMT_RATE(log_level::trace, "Add job to pool.");
+    enqueue(pool, std::move(accepted), connection);
+    return true;
+  }
+
+  // queue a request of the connection to the pool, the connection is kept after the reply
+  void myserver_t::enqueue(thread_pool_t& pool, packet_socket_t&& socket, const connection_t& connection)
+  {
+    // the socket is closed if the task is dropped from the queue or it is not kept
+    std::shared_ptr<packet_socket_t> shared(new packet_socket_t(std::move(socket)), [this](packet_socket_t* socket)
+    {
+      if (socket->socket() != socket_t::INVALID_SOCKET_HANDLE)
+        _stats.record_close();
+      delete socket;
+    });
+    pool.enqueue([this, shared, connection] // handle net request
+    {
+      // thread code
+      if (handle(*shared, connection) == handle_result::replied)
+        keep(*shared, connection);
+    });
+  }
+
+  // keep the connection of the pool mode for next requests, it is closed if keeping is off
+  void myserver_t::keep(packet_socket_t& socket, connection_t connection)
+  {
+#ifndef _WIN32
+    if (_keep_alive <= 0 || is_finished())
+      return;
+
+    // the acceptor takes it back when a next request comes
+    std::lock_guard<std::mutex> lck(_kept_mtx);
+    if (_poll < 0)
+      return;
+
+    connection.kept = true;
+    connection.accepted = request_stats_t::clock_t::now();
+    socket_t::SOCKET_HANDLE hsocket = socket.detach();
+    _kept[hsocket] = connection;
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = hsocket;
+    ::epoll_ctl(_poll, EPOLL_CTL_ADD, hsocket, &event);
+#endif
+  }
+
+#ifndef _WIN32
+  // take a kept connection with a next request from the pool mode epoll
+  void myserver_t::resume(thread_pool_t& pool, socket_t::SOCKET_HANDLE socket)
+  {
+    connection_t connection;
+    {
+      std::lock_guard<std::mutex> lck(_kept_mtx);
+      auto found = _kept.find(socket);
+      if (found == _kept.end())
+        return;
+
+      // most clients close the connection after a reply, it is closed here w/o a pool task
+      char byte;
+      ssize_t peeked = ::recv(socket, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+      if (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+
+      connection = found->second;
+      _kept.erase(found);
+      ::epoll_ctl(_poll, EPOLL_CTL_DEL, socket, nullptr);
+      if (peeked <= 0)
+      {
+        ::close(socket);
+        _stats.record_close();
+        return;
+      }
+    }
+
+    renew(connection);
+    enqueue(pool, packet_socket_t(socket), connection);
+  }
+
+  // close kept connections idle longer than keep-alive timeout, all of them if 'all' is set
+  void myserver_t::evict(connections_t& connections, int epoll, bool all)
+  {
+    request_stats_t::clock_t::time_point expired = request_stats_t::clock_t::now() - std::chrono::milliseconds(_keep_alive);
+    for (auto it = connections.begin(); it != connections.end();)
+    {
+      if (it->second.kept && (all || it->second.accepted < expired))
+      {
+        ::epoll_ctl(epoll, EPOLL_CTL_DEL, it->first, nullptr);
+        ::close(it->first);
+        _stats.record_close();
+        it = connections.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+#endif
+
+  // new request of a kept connection
+  void myserver_t::renew(connection_t& connection)
+  {
+    connection.accepted = request_stats_t::clock_t::now();
+    connection.id = _tracer.enabled() ? _tracer.next_id() : 0;
+  }
+
+  // handle one request of the socket, the socket is not closed
+  // the request is taken from 'frame' if it is read by the caller
+  myserver_t::handle_result myserver_t::handle(packet_socket_t& socket, const connection_t& connection, const std::vector<int8_t>* frame)
+  {
+    srvapi_t srvapi;
+    srvapi.onaccept(std::move(socket));
+
+    // the socket counters are of the whole connection, the request ones are their deltas
+    size_t received_before = srvapi.received_bytes();
+    size_t sent_before = srvapi.sent_bytes();
+    handle_result result = handle_result::failed;
+
+    try
+    {
+      request_stats_t::clock_t::time_point started = request_stats_t::clock_t::now();
+      if (connection.id)
+        _tracer.record(tracer_t::stage::queue, connection.id, 0, connection.accepted, started);
+
+      LOGFMT_RATE(log_level::trace, "Recieving socket data.");
+
+      if (frame ? !srvapi.receive(*frame) : !srvapi.receive())
+      {
+        // the client closes a kept connection when it does not need it anymore
+        if (connection.kept && srvapi.received_bytes() == received_before)
+        {
+          LOGFMT_RATE(log_level::trace, "Kept connection is closed by the client.");
+          socket = srvapi.release();
+          return handle_result::closed;
+        }
+
+        LOGFMT(log_level::debug, "There is no any data recieved.");
+        //LOGLINE((srvapi.error_msg().empty() ? "There is no any data recieved." : srvapi.error_msg()));
+        _stats.record_error();
+        socket = srvapi.release();
+        return handle_result::failed;
       }
 
-      // wait and close all thread tasks
-      pool.close(true, true);
+      request_stats_t::clock_t::time_point received = request_stats_t::clock_t::now();
+      packet_code action = srvapi.packet<packet_info_t>()->action;
+      if (connection.id)
+        _tracer.record(tracer_t::stage::recv, connection.id, (uint16_t)action, started, received);
+
+      // the frame is captured at the accept time, so replay keeps gaps between connections
+      _capture.record(connection.capture, connection.accepted, *srvapi.packet<packet_info_t>());
+
+      // call the service and reply by the socket
+      _dispatcher.dispatch(*srvapi.packet<packet_info_t>(), srvapi);
+
+      request_stats_t::clock_t::time_point finished = request_stats_t::clock_t::now();
+      _stats.record(action, connection.accepted, started, received, finished,
+        srvapi.received_bytes() - received_before + (frame ? frame->size() : 0), srvapi.sent_bytes() - sent_before);
+      if (connection.id)
+      {
+        _tracer.record(tracer_t::stage::handler, connection.id, (uint16_t)action, received, srvapi.reply_time());
+        _tracer.record(tracer_t::stage::send, connection.id, (uint16_t)action, srvapi.reply_time(), finished);
+      }
+      result = handle_result::replied;
     }
     catch (std::exception& e)
     {
-      LOGLINE("Error occurred: " << e.what());
-      status = -1;
+      LOGERROR("Error occurred: " << e.what());
     }
     catch (...)
     {
-      LOGLINE("Error occurred: " << "unexception error.");
-      status = -2;
+      LOGERROR("Error occurred: " << "unexception error.");
     }
 
-    return status;
+    if (result == handle_result::failed)
+      _stats.record_error();
+
+    // give the socket back, the caller keeps or closes it
+    socket = srvapi.release();
+    return result;
   }
 
+
   // stopt server
   void myserver_t::stop()
   {
   }
 
+  // re-read settings which can be changed without restart
+  void myserver_t::reload()
+  {
+    try
+    {
+      mysettings_t::instance()->reload();
+      logger_t::instance()->set_level(mysettings_t::instance()->log_level());
+      logger_t::instance()->set_rate_limit(mysettings_t::instance()->log_rate_limit());
+      logger_t::instance()->set_sample_percent(mysettings_t::instance()->log_sample_percent());
+
+      LOGINFO("Settings are reloaded, log level: " << logger_t::level_name(mysettings_t::instance()->log_level())
+        << ", rate limit: " << mysettings_t::instance()->log_rate_limit() << ", sample: " << mysettings_t::instance()->log_sample_percent() << "%.");
+    }
+    catch (std::exception& e)
+    {
+      LOGERROR("Settings reloading failed: " << e.what());
+    }
+  }
+
+  // record accept span of a new request, return its trace id, 0 - tracing is disabled
+  uint64_t myserver_t::trace_accept(tracer_t::clock_t::time_point begin, tracer_t::clock_t::time_point end)
+  {
+    if (!_tracer.enabled())
+      return 0;
+
+    uint64_t id = _tracer.next_id();
+    _tracer.record(tracer_t::stage::accept, id, 0, begin, end);
+    return id;
+  }
+
+  // write request trace to the file, return result message
+  std::string myserver_t::dump_trace()
+  {
+    std::stringstream result;
+    if (!_tracer.enabled())
+    {
+      result << "Request tracing is disabled.";
+    }
+    else
+    {
+      try
+      {
+        std::string filename = mysettings_t::instance()->trace_file();
+        size_t spans = _tracer.dump(filename);
+        result << spans << " request spans are written to \"" << filename << "\".";
+      }
+      catch (std::exception& e)
+      {
+        result << "Request trace dumping failed: " << e.what();
+      }
+    }
+
+    LOGINFO(result.str());
+    return result.str();
+  }
+
+  // run requests of signals out of the signal handler
+  void myserver_t::on_requests()
+  {
+    if (_reload.exchange(false))
+      reload();
+
+    if (_dump.exchange(false))
+      dump_trace();
+  }
+
+  // get pool counters, false if the pool mode is not running
+  bool myserver_t::pool_stats(pool_stats_t& stats)
+  {
+    std::lock_guard<std::mutex> lck(_pool_mtx);
+    if (_pool == nullptr)
+      return false;
+
+    stats = _pool->stats();
+    return true;
+  }
+
+  // make stats text of the stats request, request latency and pool counters
+  std::string myserver_t::stats_text()
+  {
+    std::stringstream buf;
+    buf << _stats.to_string();
+
+    pool_stats_t pool;
+    if (pool_stats(pool))
+    {
+      buf << std::endl << "pool: " << pool.threads << " threads, " << pool.active << " active, queue " << pool.queued
+        << " (max " << pool.max_queued << "), " << pool.tasks << " tasks" << std::endl;
+      buf << std::fixed << std::setprecision(1) << "pool wait, us: mean " << pool.wait.mean() / 1000
+        << ", p50 " << pool.wait.percentile(50) / 1000.0 << ", p99 " << pool.wait.percentile(99) / 1000.0
+        << ", max " << pool.wait.max() / 1000.0 << std::endl;
+
+      // the reply is limited by the packet size
+      const size_t shown = 64;
+      for (size_t i = 0; i < pool.workers.size() && i < shown; i++)
+      {
+        const pool_stats_t::worker_t& worker = pool.workers[i];
+        double busy = std::chrono::duration<double>(worker.busy).count();
+        double idle = std::chrono::duration<double>(worker.idle).count();
+        buf << "worker " << worker.index << ": " << worker.tasks << " tasks, busy " << std::setprecision(3) << busy
+          << " s, idle " << idle << " s (" << std::setprecision(1) << (busy + idle > 0 ? busy * 100 / (busy + idle) : 0) << "% busy)" << std::endl;
+      }
+      if (pool.workers.size() > shown)
+        buf << "... " << pool.workers.size() - shown << " workers more" << std::endl;
+    }
+
+    return buf.str();
+  }
+
+  // make metrics text of the server in Prometheus format
+  std::string myserver_t::metrics()
+  {
+    request_stats_t::snapshot_t stats = _stats.merge();
+
+    std::stringstream buf;
+    metrics_listener_t::header(buf, "csnet_connections_accepted_total", "counter", "Accepted connections.");
+    metrics_listener_t::sample(buf, "csnet_connections_accepted_total", "", (double)stats.accepted);
+    metrics_listener_t::header(buf, "csnet_connections_open", "gauge", "Open client connections, idle kept ones included.");
+    metrics_listener_t::sample(buf, "csnet_connections_open", "", (double)(stats.accepted - std::min(stats.accepted, stats.closed)));
+
+    metrics_listener_t::header(buf, "csnet_requests_total", "counter", "Served requests by action.");
+    for (size_t i = 0; i < request_stats_t::ACTIONS; i++)
+    {
+      if (stats.actions[i].total.count())
+        metrics_listener_t::sample(buf, "csnet_requests_total", std::string("action=\"") + request_stats_t::action_name(i) + "\"", (double)stats.actions[i].total.count());
+    }
+    metrics_listener_t::header(buf, "csnet_errors_total", "counter", "Connections closed without reply.");
+    metrics_listener_t::sample(buf, "csnet_errors_total", "", (double)stats.errors);
+
+    metrics_listener_t::header(buf, "csnet_received_bytes_total", "counter", "Bytes of received requests.");
+    metrics_listener_t::sample(buf, "csnet_received_bytes_total", "", (double)stats.received);
+    metrics_listener_t::header(buf, "csnet_sent_bytes_total", "counter", "Bytes of sent replies.");
+    metrics_listener_t::sample(buf, "csnet_sent_bytes_total", "", (double)stats.sent);
+
+    // counters of the pool mode
+    pool_stats_t pool;
+    if (pool_stats(pool))
+    {
+      metrics_listener_t::header(buf, "csnet_pool_queue_depth", "gauge", "Requests waiting in the pool queue.");
+      metrics_listener_t::sample(buf, "csnet_pool_queue_depth", "", (double)pool.queued);
+      metrics_listener_t::header(buf, "csnet_pool_queue_depth_max", "gauge", "Max requests waiting in the pool queue since the start.");
+      metrics_listener_t::sample(buf, "csnet_pool_queue_depth_max", "", (double)pool.max_queued);
+      metrics_listener_t::header(buf, "csnet_pool_threads", "gauge", "Pool workers.");
+      metrics_listener_t::sample(buf, "csnet_pool_threads", "", (double)pool.threads);
+      metrics_listener_t::header(buf, "csnet_pool_active_threads", "gauge", "Pool workers running a request.");
+      metrics_listener_t::sample(buf, "csnet_pool_active_threads", "", (double)pool.active);
+      metrics_listener_t::header(buf, "csnet_pool_utilization", "gauge", "Share of pool workers running a request.");
+      metrics_listener_t::sample(buf, "csnet_pool_utilization", "", pool.threads ? (double)pool.active / pool.threads : 0);
+      metrics_listener_t::header(buf, "csnet_pool_tasks_total", "counter", "Tasks executed by the pool.");
+      metrics_listener_t::sample(buf, "csnet_pool_tasks_total", "", (double)pool.tasks);
+      metrics_listener_t::header(buf, "csnet_pool_wait_seconds", "histogram", "Time from enqueue to the start of a task.");
+      metrics_listener_t::histogram(buf, "csnet_pool_wait_seconds", "", pool.wait);
+
+      metrics_listener_t::header(buf, "csnet_pool_worker_tasks_total", "counter", "Tasks executed by a worker index.");
+      for (const pool_stats_t::worker_t& worker : pool.workers)
+        metrics_listener_t::sample(buf, "csnet_pool_worker_tasks_total", "worker=\"" + std::to_string(worker.index) + "\"", (double)worker.tasks);
+      metrics_listener_t::header(buf, "csnet_pool_worker_busy_seconds_total", "counter", "Time a worker index ran tasks.");
+      for (const pool_stats_t::worker_t& worker : pool.workers)
+        metrics_listener_t::sample(buf, "csnet_pool_worker_busy_seconds_total", "worker=\"" + std::to_string(worker.index) + "\"", worker.busy.count() / 1e9);
+      metrics_listener_t::header(buf, "csnet_pool_worker_idle_seconds_total", "counter", "Time a worker index waited for tasks.");
+      for (const pool_stats_t::worker_t& worker : pool.workers)
+        metrics_listener_t::sample(buf, "csnet_pool_worker_idle_seconds_total", "worker=\"" + std::to_string(worker.index) + "\"", worker.idle.count() / 1e9);
+    }
+
+    metrics_listener_t::header(buf, "csnet_request_duration_seconds", "histogram", "Request latency by action and stage: wait (accept to handling), handler, total.");
+    for (size_t i = 0; i < request_stats_t::ACTIONS; i++)
+    {
+      const request_stats_t::action_stats_t& action = stats.actions[i];
+      if (action.total.count() == 0)
+        continue;
+
+      std::string labels = std::string("action=\"") + request_stats_t::action_name(i) + "\",stage=";
+      metrics_listener_t::histogram(buf, "csnet_request_duration_seconds", labels + "\"wait\"", action.wait);
+      metrics_listener_t::histogram(buf, "csnet_request_duration_seconds", labels + "\"handler\"", action.handler);
+      metrics_listener_t::histogram(buf, "csnet_request_duration_seconds", labels + "\"total\"", action.total);
+    }
+
+    return buf.str();
+  }
+
   // true if need to exit
   bool myserver_t::is_finished()
   {
-    LOGLINE("is_finished: " << _finished << ".");
+    LOGFMT_RATE(log_level::trace, "is_finished: {}.", _finished.load());
     return _finished;
   }
 
@@ -1,20 +1,47 @@
 #pragma once
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdexcept>
+
 #include "signals.h"
 #include "srvapi.h"
+#include "dispatcher.h"
+#include "stats.h"
+#include "metrics.h"
+#include "tracer.h"
+#include "capture.h"
+#include "threadpool.h"
 
 namespace csnet
 {
 
+  // drain timeout is expired on exit, abandoned requests still run and use the server
+  class drain_timeout_error : public std::runtime_error
+  {
+  public:
+    explicit drain_timeout_error(const std::string& msg) : std::runtime_error(msg.c_str())
+    {
+    }
+  };
+
   // socket server class
   class myserver_t //: public shared::csnet_api_t
   {
+  public:
+    // status of start() if requests are abandoned by the drain timeout
+    // they use the server, so it is not destroyed and the process is left w/o waiting for them
+    static constexpr int DRAIN_TIMEOUT = 3;
+
   public:
     myserver_t(std::unique_ptr<service_i> handler);
     virtual ~myserver_t();
 
   public:
-    // start server
+    // start server, return 0, DRAIN_TIMEOUT or a negative status of an error
     int start(int port, int pool_count, int queue_count);
     // stopt server
     void stop();
@@ -22,18 +49,149 @@ namespace csnet
     void onsignal(const shared::signal_t<myserver_t>* sender, int signal);
 
   protected:
-    void init_socket(int port, int queue_count);
+    // accepted or kept connection
+    struct connection_t
+    {
+      request_stats_t::clock_t::time_point accepted; // accept time, the time of the last reply or of the next request if it is kept
+      uint64_t id = 0; // request id of the trace, 0 - not traced
+      uint64_t capture = 0; // connection id of the capture, 0 - not captured
+      bool kept = false; // it is kept after a reply
+      std::vector<int8_t> received; // read part of the next request frame, per-core mode reads it without blocking
+    };
+    typedef std::map<shared::socket_t::SOCKET_HANDLE, connection_t> connections_t;
+
+    // per-core loop statistics, owned by the core thread
+    struct core_stats_t
+    {
+      uint64_t accepted = 0;
+      uint64_t requests = 0;
+      uint64_t errors = 0;
+    };
+
+    // result of a handled request
+    enum class handle_result
+    {
+      replied, // the connection may be kept
+      closed, // a kept connection is closed by the client
+      failed
+    };
+
+    // result of a non-blocking read of a request frame
+    enum class read_result
+    {
+      whole, // the frame is read
+      partial, // the rest of the frame is not come yet
+      closed, // a kept connection is closed by the client
+      failed
+    };
+
+#ifndef _WIN32
+    // connections given back to a core by workers of its blocking requests
+    struct handoff_t
+    {
+      // replied or failed connection
+      struct returned_t
+      {
+        shared::socket_t::SOCKET_HANDLE socket;
+        connection_t connection;
+        handle_result result;
+      };
+
+      std::mutex mtx;
+      std::vector<returned_t> returned;
+      int event = -1; // eventfd of the core, it is written when a connection is returned
+      bool closed = false; // the core has left, workers close connections themselves
+    };
+#endif
+
+  protected:
+    void init_socket(shared::packet_socket_t& socket, int port, int queue_count, bool reuse_port = false);
     void init_signal();
+    // run acceptor with thread pool
+    // throw drain_timeout_error if requests are not finished up to the drain timeout
+    void run_pool(int port, int pool_count, int queue_count);
+#ifndef _WIN32
+    // run shared-nothing thread per core, blocking requests are run by a pool of 'pool_count' workers
+    // throw drain_timeout_error if blocking requests are not finished up to the drain timeout
+    void run_per_core(int port, int pool_count, int queue_count);
+    // one core loop, it owns its listener, connections and stats
+    void run_core(size_t index, int cpu, int port, int queue_count, thread_pool_t& blocking);
+    // accept all pending connections of the core listener
+    void accept_all(shared::packet_socket_t& listener, int epoll, connections_t& connections, core_stats_t& stats);
+    // read the next request frame of a per-core connection without blocking
+    read_result read_frame(shared::socket_t::SOCKET_HANDLE socket, connection_t& connection);
+    // run a blocking request of a per-core connection by a worker, the connection goes back to the core by the handoff
+    void hand_off(thread_pool_t& pool, const std::shared_ptr<handoff_t>& handoff, shared::socket_t::SOCKET_HANDLE socket, connection_t connection);
+#endif
+    // accept a connection of the pool mode and queue its request, false if there is no connection
+    // throw if accepting fails and 'strict' is set
+    bool accept(thread_pool_t& pool, bool strict = true);
+    // queue a request of the connection to the pool, the connection is kept after the reply
+    void enqueue(thread_pool_t& pool, shared::packet_socket_t&& socket, const connection_t& connection);
+    // keep the connection of the pool mode for next requests, it is closed if keeping is off
+    void keep(shared::packet_socket_t& socket, connection_t connection);
+#ifndef _WIN32
+    // take a kept connection with a next request from the pool mode epoll
+    void resume(thread_pool_t& pool, shared::socket_t::SOCKET_HANDLE socket);
+    // close kept connections idle longer than keep-alive timeout, all of them if 'all' is set
+    void evict(connections_t& connections, int epoll, bool all);
+#endif
+    // new request of a kept connection
+    void renew(connection_t& connection);
+    // handle one request of the socket, the socket is not closed
+    // the request is taken from 'frame' if it is read by the caller
+    handle_result handle(shared::packet_socket_t& socket, const connection_t& connection, const std::vector<int8_t>* frame = nullptr);
+    // record accept span of a new request, return its trace id, 0 - tracing is disabled
+    uint64_t trace_accept(tracer_t::clock_t::time_point begin, tracer_t::clock_t::time_point end);
+    // write request trace to the file, return result message
+    std::string dump_trace();
+    // run requests of signals out of the signal handler
+    void on_requests();
+    // notify waiting loops to check is_finished()
+    void wakeup();
     // true if need to exit
     bool is_finished();
+    // re-read settings which can be changed without restart
+    void reload();
+    // make metrics text of the server in Prometheus format
+    std::string metrics();
+    // get pool counters, false if the pool mode is not running
+    bool pool_stats(pool_stats_t& stats);
+    // make stats text of the stats request, request latency and pool counters
+    std::string stats_text();
 
   protected:
     shared::packet_socket_t _socket;
     std::unique_ptr<service_i> _handler;
+    // request dispatch to the handler
+    dispatcher_t _dispatcher;
     shared::signal_t<myserver_t> _signal;
-    bool _finished = false;
+    std::atomic<bool> _finished{ false };
+    // settings reloading is requested by SIGHUP
+    std::atomic<bool> _reload{ false };
+    // trace dumping is requested by SIGUSR1
+    std::atomic<bool> _dump{ false };
+    // latency histograms of served requests
+    request_stats_t _stats;
+    // optional metrics http listener
+    std::unique_ptr<metrics_listener_t> _metrics;
+    // pool of the pool mode, metrics read its gauges
+    thread_pool_t* _pool = nullptr;
+    std::mutex _pool_mtx;
+    // request lifecycle spans
+    tracer_t _tracer;
+    // optional capture of incoming frames
+    capture_t _capture;
+    // idle time in ms of kept connections, 0 - connections are closed after the reply
+    int _keep_alive = 0;
+    // kept connections of the pool mode wait for next requests in the acceptor epoll
+    std::mutex _kept_mtx;
+    connections_t _kept;
+    int _poll = -1;
 #ifdef _WIN32
     SOCKET _cancel = INVALID_SOCKET;
+#else
+    int _wakeup = -1;
 #endif
   };
 
@@ -22,24 +22,28 @@ namespace csnet
   // send reply to server
   void srvapi_t::send_reply(packet_code action) const
   {
+    _reply_time = std::chrono::steady_clock::now();
     send(action | packet_code::P_RETURN_ACTION);
   }
 
   // send data reply to client
   void srvapi_t::send_reply(packet_code action, const void* data, size_t size) const
   {
+    _reply_time = std::chrono::steady_clock::now();
     send(action | packet_code::P_RETURN_ACTION, data, size);
   }
 
   // send text reply to client
   void srvapi_t::send_reply(packet_code action, const std::string& text) const
   {
+    _reply_time = std::chrono::steady_clock::now();
     send(action | packet_code::P_RETURN_ACTION, text);
   }
 
   // send error to server
   void srvapi_t::send_reply(packet_code action, uint32_t error, const std::string& text) const
   {
+    _reply_time = std::chrono::steady_clock::now();
     send(action | packet_code::P_RETURN_ACTION, error, text);
   }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ctime>
+#include <chrono>
 
 #include "signals.h"
 #include "csnet_api.h"
@@ -28,8 +29,22 @@ namespace csnet
     virtual std::string calculate(const std::string& input) const = 0;
   };
 
+  // reply channel interface of a request, it throws if the reply cannot be sent
+  class reply_i
+  {
+  public:
+    // send reply to client
+    virtual void send_reply(shared::packet_code action) const = 0;
+    // send data reply to client
+    virtual void send_reply(shared::packet_code action, const void* data, size_t size) const = 0;
+    // send text reply to client
+    virtual void send_reply(shared::packet_code action, const std::string& text) const = 0;
+    // send error to client
+    virtual void send_reply(shared::packet_code action, uint32_t error, const std::string& text) const = 0;
+  };
+
   // service api wrapper
-  class srvapi_t : public shared::server_api_t
+  class srvapi_t : public shared::server_api_t, public reply_i
   {
   public:
     srvapi_t(shared::packet_kind kind = shared::packet_kind::P_BASE_KIND);
@@ -44,6 +59,15 @@ namespace csnet
     void send_reply(shared::packet_code action, const std::string& text) const;
     // send error to client
     void send_reply(shared::packet_code action, uint32_t error, const std::string& text) const;
+
+    // get time when the reply sending is started
+    std::chrono::steady_clock::time_point reply_time() const
+    {
+      return _reply_time;
+    }
+
+  protected:
+    mutable std::chrono::steady_clock::time_point _reply_time;
   };
 
 }
\ No newline at end of file
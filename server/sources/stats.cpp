@@ -0,0 +1,200 @@
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "stats.h"
+
+namespace csnet
+{
+
+  using namespace shared;
+
+  // add to a counter of the shard, it has single writer
+  static void add(std::atomic<uint64_t>& counter, uint64_t value)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  // get count of served requests
+  uint64_t request_stats_t::snapshot_t::requests() const
+  {
+    uint64_t count = 0;
+    for (const action_stats_t& stats : actions)
+      count += stats.total.count();
+    return count;
+  }
+
+  // record a served request to the shard of the calling thread
+  void request_stats_t::record(packet_code action, clock_t::time_point accepted, clock_t::time_point started,
+    clock_t::time_point received, clock_t::time_point finished, size_t received_bytes, size_t sent_bytes)
+  {
+    size_t index = (size_t)action & ~(size_t)packet_code::P_RETURN_ACTION;
+    if (index >= ACTIONS)
+      index = (size_t)packet_code::P_NO_ACTION;
+
+    auto ns = [](clock_t::duration duration)
+    {
+      return (uint64_t)std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0);
+    };
+
+    shard_t& own = shard();
+    action_stats_t& stats = own.actions[index];
+    stats.wait.record(ns(started - accepted));
+    stats.handler.record(ns(finished - received));
+    stats.total.record(ns(finished - accepted));
+    add(own.received, received_bytes);
+    add(own.sent, sent_bytes);
+  }
+
+  // record an accepted connection
+  void request_stats_t::record_accept()
+  {
+    add(shard().accepted, 1);
+  }
+
+  // record a closed connection
+  void request_stats_t::record_close()
+  {
+    add(shard().closed, 1);
+  }
+
+  // record a connection closed without reply
+  void request_stats_t::record_error()
+  {
+    add(shard().errors, 1);
+  }
+
+  // get shard of the calling thread
+  request_stats_t::shard_t& request_stats_t::shard()
+  {
+    // pool workers and execmd threads come and go, their shards are reused
+    thread_local lease_t lease;
+    if (lease.shards != _shards)
+    {
+      lease.release();
+      lease.acquire(_shards);
+    }
+    return *lease.shard;
+  }
+
+  // take a free shard or a new one
+  void request_stats_t::lease_t::acquire(const std::shared_ptr<shards_t>& owner)
+  {
+    std::lock_guard<std::mutex> lck(owner->mtx);
+    if (owner->free.empty())
+    {
+      owner->all.emplace_back(new shard_t());
+      shard = owner->all.back().get();
+    }
+    else
+    {
+      shard = owner->free.back();
+      owner->free.pop_back();
+    }
+    shards = owner;
+  }
+
+  // give the shard back
+  void request_stats_t::lease_t::release()
+  {
+    if (!shards)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lck(shards->mtx);
+      shards->free.push_back(shard);
+    }
+    shards.reset();
+    shard = nullptr;
+  }
+
+  // merge shards of all threads, a shard of an exited thread keeps its counters
+  request_stats_t::snapshot_t request_stats_t::merge() const
+  {
+    snapshot_t merged;
+
+    std::lock_guard<std::mutex> lck(_shards->mtx);
+    for (const auto& shard : _shards->all)
+    {
+      for (size_t i = 0; i < ACTIONS; i++)
+      {
+        merged.actions[i].wait.merge(shard->actions[i].wait);
+        merged.actions[i].handler.merge(shard->actions[i].handler);
+        merged.actions[i].total.merge(shard->actions[i].total);
+      }
+      merged.accepted += shard->accepted.load(std::memory_order_relaxed);
+      merged.closed += shard->closed.load(std::memory_order_relaxed);
+      merged.errors += shard->errors.load(std::memory_order_relaxed);
+      merged.received += shard->received.load(std::memory_order_relaxed);
+      merged.sent += shard->sent.load(std::memory_order_relaxed);
+    }
+    return merged;
+  }
+
+  // format merged stats as a table, times are in us
+  std::string request_stats_t::to_string() const
+  {
+    std::vector<action_stats_t> merged = merge().actions;
+
+    std::stringstream buf;
+    buf << std::left << std::setw(20) << "action, us" << std::right << std::setw(10) << "count" << std::setw(10) << "mean"
+      << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+      << std::setw(10) << "max" << std::endl;
+    buf << std::fixed << std::setprecision(1);
+
+    auto line = [&buf](const std::string& name, const histogram_t& histogram)
+    {
+      buf << std::left << std::setw(20) << name << std::right << std::setw(10) << histogram.count()
+        << std::setw(10) << histogram.mean() / 1000 << std::setw(10) << histogram.percentile(50) / 1000.0
+        << std::setw(10) << histogram.percentile(90) / 1000.0 << std::setw(10) << histogram.percentile(99) / 1000.0
+        << std::setw(10) << histogram.percentile(99.9) / 1000.0 << std::setw(10) << histogram.max() / 1000.0 << std::endl;
+    };
+
+    bool empty = true;
+    for (size_t i = 0; i < ACTIONS; i++)
+    {
+      if (merged[i].total.count() == 0)
+        continue;
+
+      std::string name = action_name(i);
+      line(name + " wait", merged[i].wait);
+      line(name + " handler", merged[i].handler);
+      line(name + " total", merged[i].total);
+      empty = false;
+    }
+
+    if (empty)
+      buf << "there are no served requests" << std::endl;
+
+    return buf.str();
+  }
+
+  // get action name
+  const char* request_stats_t::action_name(size_t index)
+  {
+    switch ((packet_code)index)
+    {
+    case packet_code::P_ECHO_ACTION:
+      return "echo";
+    case packet_code::P_TIME_ACTION:
+      return "time";
+    case packet_code::P_EXECMD_ACTION:
+      return "execmd";
+    case packet_code::P_CREDENTIALS_ACTION:
+      return "credentials";
+    case packet_code::P_PING_ACTION:
+      return "ping";
+    case packet_code::P_CALC_ACTION:
+      return "calc";
+    case packet_code::P_STATS_ACTION:
+      return "stats";
+    case packet_code::P_TRACE_ACTION:
+      return "trace";
+    case packet_code::P_BATCH_ACTION:
+      return "batch";
+    default:
+      return "unknown";
+    }
+  }
+
+}
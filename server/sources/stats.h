@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "histogram.h"
+#include "packsock.h"
+
+namespace csnet
+{
+
+  // per-action latency histograms and traffic counters of served requests
+  // each thread records to its own shard without locks, shards are merged on read,
+  // the shard of an exited thread is taken by the next new thread
+  class request_stats_t
+  {
+  public:
+    // actions are indexed by packet_code, unknown ones share the P_NO_ACTION slot
+    static constexpr size_t ACTIONS = 10;
+
+    // histograms of one action, values are in ns
+    struct action_stats_t
+    {
+      shared::histogram_t wait; // from accept to the start of handling, it is queue wait in pool mode
+      shared::histogram_t handler; // from received request to sent reply
+      shared::histogram_t total; // from accept to sent reply
+    };
+
+    // merged stats of all threads
+    struct snapshot_t
+    {
+      std::vector<action_stats_t> actions = std::vector<action_stats_t>(ACTIONS);
+      uint64_t accepted = 0; // accepted connections
+      uint64_t closed = 0; // closed connections, kept ones are closed after their last request
+      uint64_t errors = 0; // connections closed without reply
+      uint64_t received = 0; // bytes of requests
+      uint64_t sent = 0; // bytes of replies
+
+      // get count of served requests
+      uint64_t requests() const;
+    };
+
+    typedef std::chrono::steady_clock clock_t;
+
+  private:
+    // stats of one thread, counters have single writer
+    struct shard_t
+    {
+      std::vector<action_stats_t> actions = std::vector<action_stats_t>(ACTIONS);
+      std::atomic<uint64_t> accepted{ 0 };
+      std::atomic<uint64_t> closed{ 0 };
+      std::atomic<uint64_t> errors{ 0 };
+      std::atomic<uint64_t> received{ 0 };
+      std::atomic<uint64_t> sent{ 0 };
+    };
+
+    // shards of all threads, free ones are left by exited threads
+    struct shards_t
+    {
+      std::mutex mtx;
+      std::vector<std::unique_ptr<shard_t>> all;
+      std::vector<shard_t*> free;
+    };
+
+    // shard taken by a thread, it is given back when the thread exits or records to other stats
+    struct lease_t
+    {
+      std::shared_ptr<shards_t> shards;
+      shard_t* shard = nullptr;
+
+      ~lease_t()
+      {
+        release();
+      }
+      // take a free shard or a new one
+      void acquire(const std::shared_ptr<shards_t>& owner);
+      // give the shard back
+      void release();
+    };
+
+  public:
+    request_stats_t() = default;
+    request_stats_t(const request_stats_t&) = delete;
+    request_stats_t& operator = (const request_stats_t&) = delete;
+
+  public:
+    // record a served request to the shard of the calling thread
+    void record(shared::packet_code action, clock_t::time_point accepted, clock_t::time_point started,
+      clock_t::time_point received, clock_t::time_point finished, size_t received_bytes, size_t sent_bytes);
+    // record an accepted connection
+    void record_accept();
+    // record a closed connection
+    void record_close();
+    // record a connection closed without reply
+    void record_error();
+
+    // merge shards of all threads, a shard of an exited thread keeps its counters
+    snapshot_t merge() const;
+
+    // format merged stats as a table, times are in us
+    std::string to_string() const;
+
+    // get action name
+    static const char* action_name(size_t index);
+
+  private:
+    // get shard of the calling thread
+    shard_t& shard();
+
+  private:
+    // a thread keeps the shards alive while it holds one
+    std::shared_ptr<shards_t> _shards = std::make_shared<shards_t>();
+  };
+
+}
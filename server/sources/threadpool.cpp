@@ -1,5 +1,7 @@
 #include <sstream>
+#include <algorithm>
 #include "threadpool.h"
+#include "affinity.h"
 #include "logger.h"
 
 namespace csnet
@@ -7,52 +9,300 @@ namespace csnet
 
   using namespace shared;
 
+  thread_local thread_pool_t* thread_pool_t::_current = nullptr;
+
+  // mark a region of a pool task as blocking
+  thread_pool_t::blocking_region_t::blocking_region_t() : _pool(thread_pool_t::current())
+  {
+    if (_pool)
+      _pool->enter_blocking();
+  }
+
+  thread_pool_t::blocking_region_t::~blocking_region_t()
+  {
+    if (_pool)
+      _pool->leave_blocking();
+  }
+
   // the constructor just launches some amount of workers
-  thread_pool_t::thread_pool_t(size_t threads) : _stop(false)
+  thread_pool_t::thread_pool_t(size_t threads, const std::vector<int>& cpus) : thread_pool_t(threads, pool_policy_t(), cpus)
   {
+  }
+
+  // elastic pool, launches 'threads' workers and resizes them by the policy
+  thread_pool_t::thread_pool_t(size_t threads, const pool_policy_t& policy, const std::vector<int>& cpus) : _cpus(cpus), _policy(policy), _stop(false)
+  {
+    // fixed size pool by default
+    if (_policy.min_threads == 0 || _policy.min_threads > threads)
+      _policy.min_threads = threads;
+    if (_policy.max_threads < threads)
+      _policy.max_threads = threads;
+
+    std::unique_lock<std::mutex> lock(_queue_mutex);
     for (size_t i = 0; i < threads; ++i)
+      spawn();
+
+    _resized = clock_t::now();
+  }
+
+  // the destructor joins all threads
+  thread_pool_t::~thread_pool_t()
+  {
+    wait();
+  }
+
+  // launch new worker, call under lock
+  void thread_pool_t::spawn()
+  {
+    reap();
+
+    // use lowest free index to keep workers evenly spread over cpus
+    size_t index = 0;
+    while (_workers.count(index))
+      ++index;
+
+    if (_stats.size() <= index)
+      _stats.resize(index + 1);
+    if (!_stats[index])
+      _stats[index].reset(new worker_stats_t());
+
+    _workers.emplace(index, std::thread(&thread_pool_t::worker, this, index, _stats[index].get()));
+  }
+
+  // worker thread function
+  void thread_pool_t::worker(size_t index, worker_stats_t* stats)
+  {
+    // bind before the first allocation so the thread's buffers are first touched on its own numa node,
+    // a worker without a cpu must not keep the mask inherited from a bound thread which has started it
+    int cpu = affinity_t::cpu_of(_cpus, index);
+    if (cpu < 0)
     {
-      // declare thread function
-      _workers.emplace_back
-      (
-        [this]
+      if (!affinity_t::unbind())
+        LOGWARN("Thread " << std::this_thread::get_id() << " cannot be unbound.");
+    }
+    else if (!affinity_t::bind(cpu))
+      LOGWARN("Thread " << std::this_thread::get_id() << " cannot be bound to cpu " << cpu << ".");
+
+    LOGDEBUG("Thread " << std::this_thread::get_id() << " is started.");
+
+    _current = this;
+    bool elastic = _policy.min_threads != _policy.max_threads;
+
+    // the worker is idle until the first task
+    auto ns = [](clock_t::time_point time)
+    {
+      return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    };
+    clock_t::time_point idle_since = clock_t::now();
+    stats->idle_since.store(ns(idle_since), std::memory_order_relaxed);
+
+    // time after the last task is idle time of the index, it is counted under the lock
+    // before the worker leaves, so a next worker of the index does not write the counters yet
+    auto leave = [&](clock_t::time_point now)
+    {
+      stats->idle.store(stats->idle.load(std::memory_order_relaxed) + ns(now) - ns(idle_since), std::memory_order_relaxed);
+      stats->idle_since.store(0, std::memory_order_relaxed);
+    };
+
+    for (;;)
+    {
+      task_t task;
       {
-        LOGLINE("Thread " << std::this_thread::get_id() << " is started.");
+        std::unique_lock<std::mutex> lock(this->_queue_mutex);
+        auto ready = [this]
+        {
+          return this->_stop || !this->_tasks.empty() || this->_compensating > this->_blocked;
+        };
 
-        for (;;)
+        if (!elastic)
         {
-          std::function<void()> task;
+          this->_condition.wait(lock, ready);
+        }
+        else if (!this->_condition.wait_for(lock, _policy.idle_timeout, ready))
+        {
+          // worker was idle too long, leave the pool if it is allowed
+          clock_t::time_point now = clock_t::now();
+          if (can_shrink(now))
           {
-            std::unique_lock<std::mutex> lock(this->_queue_mutex);
-            this->_condition.wait(lock, [this]
-            {
-              return this->_stop || !this->_tasks.empty();
-            });
-
-            // continue work?
-            if (this->_stop && this->_tasks.empty())
-              break;
-
-            // get next task
-            task = std::move(this->_tasks.front());
-            this->_tasks.pop();
+            _resized = now;
+            leave(now);
+            retire(index);
+
+            LOGDEBUG("Pool shrinks to " << _workers.size() << " threads.");
+            break;
           }
+          continue;
+        }
 
-          LOGLINE("Thread " << std::this_thread::get_id() << " executes a task.");
+        // continue work?
+        if (this->_stop && this->_tasks.empty())
+        {
+          leave(clock_t::now());
+          break;
+        }
 
-          task(); // execute a task
+        // blocked workers are back, retire an extra one
+        if (!this->_stop && _compensating > _blocked)
+        {
+          --_compensating;
+          leave(clock_t::now());
+          retire(index);
+
+          // pass a queued task to other workers
+          if (!this->_tasks.empty())
+            this->_condition.notify_one();
+
+          LOGDEBUG("Compensating worker is retired, " << _workers.size() << " threads.");
+          break;
         }
 
-        LOGLINE("Thread " << std::this_thread::get_id() << " is finished.");
+        // get next task
+        task = std::move(this->_tasks.front());
+        this->_tasks.pop();
+        ++_active;
+
+        // the task waited too long, add a worker for next tasks
+        clock_t::time_point now = clock_t::now();
+        if (now - task.queued > _policy.grow_wait)
+          grow(now, task.queued);
+
+        // single writer while the worker is in the pool, no need of atomic read-modify-write
+        stats->idle_since.store(0, std::memory_order_relaxed);
+        stats->idle.store(stats->idle.load(std::memory_order_relaxed) + ns(now) - ns(idle_since), std::memory_order_relaxed);
+        stats->wait.record((uint64_t)std::max<int64_t>(ns(now) - ns(task.queued), 0));
+        idle_since = now;
+      }
+
+      LOGRATE(log_level::trace, "Thread " << std::this_thread::get_id() << " executes a task.");
+
+      task.func(); // execute a task
+
+      clock_t::time_point done = clock_t::now();
+      stats->busy.store(stats->busy.load(std::memory_order_relaxed) + ns(done) - ns(idle_since), std::memory_order_relaxed);
+      stats->tasks.store(stats->tasks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      stats->idle_since.store(ns(done), std::memory_order_relaxed);
+      idle_since = done;
+
+      {
+        std::unique_lock<std::mutex> lock(this->_queue_mutex);
+        if (--_active == 0 && this->_tasks.empty())
+          _drained.notify_all();
       }
-      );
     }
+
+    LOGDEBUG("Thread " << std::this_thread::get_id() << " is finished.");
   }
 
-  // the destructor joins all threads
-  thread_pool_t::~thread_pool_t()
+  // get counters snapshot, worker counters are merged out of the queue lock
+  pool_stats_t thread_pool_t::stats()
   {
-    wait();
+    pool_stats_t result;
+    std::vector<std::pair<size_t, worker_stats_t*>> workers;
+    {
+      std::unique_lock<std::mutex> lock(_queue_mutex);
+      result.threads = _workers.size();
+      result.active = _active;
+      result.queued = _tasks.size();
+      result.max_queued = _max_queued;
+      for (size_t i = 0; i < _stats.size(); i++)
+      {
+        if (_stats[i])
+          workers.emplace_back(i, _stats[i].get());
+      }
+    }
+
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now().time_since_epoch()).count();
+    for (auto& worker : workers)
+    {
+      worker_stats_t* stats = worker.second;
+
+      pool_stats_t::worker_t counters;
+      counters.index = worker.first;
+      counters.tasks = stats->tasks.load(std::memory_order_relaxed);
+      counters.busy = std::chrono::nanoseconds(stats->busy.load(std::memory_order_relaxed));
+      counters.idle = std::chrono::nanoseconds(stats->idle.load(std::memory_order_relaxed));
+
+      // add current idle period of a waiting worker
+      int64_t idle_since = stats->idle_since.load(std::memory_order_relaxed);
+      if (idle_since && now > idle_since)
+        counters.idle += std::chrono::nanoseconds(now - idle_since);
+
+      result.tasks += counters.tasks;
+      result.wait.merge(stats->wait);
+      result.workers.push_back(counters);
+    }
+
+    return result;
+  }
+
+  // add a worker if it is allowed, call under lock
+  void thread_pool_t::grow(clock_t::time_point now, clock_t::time_point queued)
+  {
+    if (!can_grow(now))
+      return;
+
+    _resized = now;
+    spawn();
+
+    LOGDEBUG("Pool grows to " << _workers.size() << " threads, task waited "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(now - queued).count() << " ms.");
+  }
+
+  // is pool allowed to grow now, call under lock
+  bool thread_pool_t::can_grow(clock_t::time_point now) const
+  {
+    // growing reacts quickly, it is limited by grow_wait only
+    return !_stop && _workers.size() - _compensating < _policy.max_threads && now - _resized > _policy.grow_wait;
+  }
+
+  // is pool allowed to shrink now, call under lock
+  bool thread_pool_t::can_shrink(clock_t::time_point now) const
+  {
+    // shrinking waits for cooldown after any resize to avoid oscillation
+    return !_stop && _workers.size() - _compensating > _policy.min_threads && now - _resized > _policy.cooldown;
+  }
+
+  // move the worker to retired ones, call under lock
+  void thread_pool_t::retire(size_t index)
+  {
+    _retired.push_back(std::move(_workers[index]));
+    _workers.erase(index);
+  }
+
+  // a worker enters a blocking region
+  void thread_pool_t::enter_blocking()
+  {
+    std::unique_lock<std::mutex> lock(_queue_mutex);
+    ++_blocked;
+
+    // keep the count of running workers
+    if (!_stop && _compensating < _blocked && _compensating < _policy.max_compensating)
+    {
+      ++_compensating;
+      spawn();
+
+      LOGDEBUG("Compensating worker is launched, " << _blocked << " blocked, " << _workers.size() << " threads.");
+    }
+  }
+
+  // a worker leaves a blocking region
+  void thread_pool_t::leave_blocking()
+  {
+    {
+      std::unique_lock<std::mutex> lock(_queue_mutex);
+      --_blocked;
+    }
+
+    // wake an idle worker to retire
+    _condition.notify_one();
+  }
+
+  // join retired workers, call under lock
+  void thread_pool_t::reap()
+  {
+    for (std::thread& worker : _retired)
+      worker.join();
+    _retired.clear();
   }
 
   // wait with joining
@@ -61,23 +311,33 @@ namespace csnet
     close(true, false);
   }
 
+  // wait until the queue is empty and no task is running or timeout is expired
+  bool thread_pool_t::drain(std::chrono::milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> lock(_queue_mutex);
+    return _drained.wait_for(lock, timeout, [this]
+    {
+      return _tasks.empty() && _active == 0;
+    });
+  }
+
   // close pool with or w/o joining
   void thread_pool_t::close(bool wait, bool clear_tasks)
   {
     {
       // lock the code
       std::unique_lock<std::mutex> lock(_queue_mutex);
-      if (_workers.size() == 0)
+      if (_workers.size() == 0 && _retired.size() == 0)
         return;
 
-      LOGLINE("closing pool.");
-      LOGLINE("tasks count " << _tasks.size() << ".");
+      LOGDEBUG("closing pool.");
+      LOGDEBUG("tasks count " << _tasks.size() << ".");
 
       _stop = true; // tell to all threads to exit
 
       if (clear_tasks)
       {
-        LOGLINE("empty tasks.");
+        LOGDEBUG("empty tasks.");
 
         // empty task queue, does need to continue task process
         while (!_tasks.empty())
@@ -87,25 +347,30 @@ namespace csnet
 
     _condition.notify_all(); // notify all threads about changings
 
+    // workers do not leave or join the pool after stopping
+    for (auto& worker : _workers)
+      _retired.push_back(std::move(worker.second));
+
     if (wait)
     {
-      LOGLINE("waiting for closing.");
+      LOGDEBUG("waiting for closing.");
 
       // waiting for a closing all threads
-      for (std::thread& worker : _workers)
+      for (std::thread& worker : _retired)
         worker.join();
 
-      LOGLINE("pool is closed.");
+      LOGDEBUG("pool is closed.");
     }
     else
     {
       // not waiting for a closing all threads
-      for (std::thread& worker : _workers)
+      for (std::thread& worker : _retired)
         worker.detach();
     }
 
     // clear threads pool
     _workers.clear();
+    _retired.clear();
   }
 
 }
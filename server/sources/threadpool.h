@@ -1,24 +1,101 @@
 ﻿#pragma once
 
 #include <vector>
+#include <map>
 #include <queue>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <chrono>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <atomic>
+
+#include "histogram.h"
 
 namespace csnet
 {
 
+  // thread pool sizing policy
+  struct pool_policy_t
+  {
+    size_t min_threads = 0; // pool does not shrink below, 0 - initial threads count
+    size_t max_threads = 0; // pool does not grow above, 0 - initial threads count
+    std::chrono::milliseconds grow_wait{ 50 }; // grow if a task waited in the queue longer
+    std::chrono::milliseconds idle_timeout{ 30000 }; // shrink if a worker was idle longer
+    std::chrono::milliseconds cooldown{ 1000 }; // do not resize again sooner
+    size_t max_compensating = 64; // max extra workers launched for workers in blocking regions
+  };
+
+  // thread pool counters snapshot
+  struct pool_stats_t
+  {
+    // counters of a worker index, a retired worker leaves them to the next worker with the same index
+    struct worker_t
+    {
+      size_t index = 0;
+      uint64_t tasks = 0; // executed tasks
+      std::chrono::nanoseconds busy{ 0 }; // time of running tasks
+      std::chrono::nanoseconds idle{ 0 }; // time of waiting for tasks
+    };
+
+    size_t threads = 0; // current workers
+    size_t active = 0; // running tasks
+    size_t queued = 0; // current queue depth
+    size_t max_queued = 0; // max queue depth since the start
+    uint64_t tasks = 0; // executed tasks of all workers
+    shared::histogram_t wait; // ns from enqueue to the start of a task
+    std::vector<worker_t> workers;
+  };
+
   // thread pool manager class based on Jakob Progsch, Václav Zeman
   class thread_pool_t
   {
+    typedef std::chrono::steady_clock clock_t;
+
+    // queued task
+    struct task_t
+    {
+      std::function<void()> func;
+      clock_t::time_point queued;
+    };
+
+    // counters of a worker index, they are written by its current worker only, which finishes them under the lock before it leaves
+    // each one takes own cache lines, so workers do not share them
+    struct alignas(64) worker_stats_t
+    {
+      std::atomic<uint64_t> tasks{ 0 };
+      std::atomic<int64_t> busy{ 0 }; // ns
+      std::atomic<int64_t> idle{ 0 }; // ns
+      std::atomic<int64_t> idle_since{ 0 }; // ns of steady clock when the worker became idle, 0 - busy or left
+      shared::histogram_t wait; // ns from enqueue to start
+    };
+
+  public:
+    // mark a region of a pool task as blocking (waiting in a syscall, a pipe, a lock)
+    // the pool launches a compensating worker to keep running tasks in parallel
+    // and retires it when the region is left, it does nothing outside a pool thread
+    class blocking_region_t
+    {
+    public:
+      blocking_region_t();
+      ~blocking_region_t();
+
+      blocking_region_t(const blocking_region_t&) = delete;
+      blocking_region_t& operator = (const blocking_region_t&) = delete;
+
+    private:
+      thread_pool_t* _pool;
+    };
+
   public:
     // the constructor just launches some amount of workers
-    explicit thread_pool_t(size_t threads);
+    // each worker is bound to cpus[index % cpus.size()] if cpus is not empty
+    explicit thread_pool_t(size_t threads, const std::vector<int>& cpus = std::vector<int>());
+    // elastic pool, launches 'threads' workers and resizes them by the policy
+    thread_pool_t(size_t threads, const pool_policy_t& policy, const std::vector<int>& cpus = std::vector<int>());
     // the destructor joins all threads
     ~thread_pool_t();
 
@@ -28,6 +105,46 @@ namespace csnet
     // close pool with or w/o joining
     void close(bool wait = true, bool clear_tasks = false);
 
+    // wait until the queue is empty and no task is running or timeout is expired
+    // return true if the pool is drained
+    bool drain(std::chrono::milliseconds timeout);
+
+    // get cpu list the workers are bound to
+    const std::vector<int>& cpus() const
+    {
+      return _cpus;
+    }
+
+    // get the pool of the calling thread, nullptr if it is not a pool thread
+    static thread_pool_t* current()
+    {
+      return _current;
+    }
+
+    // get current workers count
+    size_t size()
+    {
+      std::unique_lock<std::mutex> lock(_queue_mutex);
+      return _workers.size();
+    }
+
+    // get queued tasks count
+    size_t queued()
+    {
+      std::unique_lock<std::mutex> lock(_queue_mutex);
+      return _tasks.size();
+    }
+
+    // get running tasks count
+    size_t active()
+    {
+      std::unique_lock<std::mutex> lock(_queue_mutex);
+      return _active;
+    }
+
+    // get counters snapshot, worker counters are merged out of the queue lock
+    pool_stats_t stats();
+
     // add new work item to the pool
     template<class F, class... Args>
     decltype(auto) enqueue(F&& f, Args&&... args)
@@ -48,22 +165,69 @@ namespace csnet
           throw std::runtime_error("enqueue on stopped ThreadPool");
 
         // add task to the end of the queue
-        _tasks.emplace([task]() { (*task)(); });
+        clock_t::time_point now = clock_t::now();
+        _tasks.push({ [task]() { (*task)(); }, now });
+        if (_tasks.size() > _max_queued)
+          _max_queued = _tasks.size();
+
+        // all workers are busy longer than allowed
+        if (now - _tasks.front().queued > _policy.grow_wait)
+          grow(now, _tasks.front().queued);
       }
       _condition.notify_one(); // notify only one thread about changings
       return res;
     }
 
   private:
-    // need to keep track of threads so we can join them
-    std::vector<std::thread> _workers;
+    // launch new worker, call under lock
+    void spawn();
+    // worker thread function
+    void worker(size_t index, worker_stats_t* stats);
+    // add a worker if it is allowed, call under lock
+    void grow(clock_t::time_point now, clock_t::time_point queued);
+    // is pool allowed to grow now, call under lock
+    bool can_grow(clock_t::time_point now) const;
+    // is pool allowed to shrink now, call under lock
+    bool can_shrink(clock_t::time_point now) const;
+    // move the worker to retired ones, call under lock
+    void retire(size_t index);
+    // join retired workers, call under lock
+    void reap();
+    // a worker enters a blocking region
+    void enter_blocking();
+    // a worker leaves a blocking region
+    void leave_blocking();
+
+  private:
+    // need to keep track of threads so we can join them, key is worker index
+    std::map<size_t, std::thread> _workers;
+    // workers which left the pool and wait for joining
+    std::vector<std::thread> _retired;
+    // cpus to bind the workers
+    std::vector<int> _cpus;
+    // sizing policy
+    pool_policy_t _policy;
+    // workers in blocking regions
+    size_t _blocked = 0;
+    // extra workers launched for blocked ones
+    size_t _compensating = 0;
+    // running tasks
+    size_t _active = 0;
+    // max queue depth
+    size_t _max_queued = 0;
+    // counters by worker index, they are kept until the pool is destroyed
+    std::vector<std::unique_ptr<worker_stats_t>> _stats;
+    // last time the pool was resized
+    clock_t::time_point _resized;
     // the task queue
-    std::queue<std::function<void()>> _tasks;
+    std::queue<task_t> _tasks;
     // synchronization
     std::mutex _queue_mutex;
     std::condition_variable _condition;
+    std::condition_variable _drained;
     bool _stop;
+    // the pool of the calling thread
+    static thread_local thread_pool_t* _current;
   };
 
 }
-
@@ -0,0 +1,189 @@
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <set>
+
+#include "tracer.h"
+#include "stats.h"
+#include "binlog.h"
+
+namespace csnet
+{
+
+  using namespace shared;
+
+  // record a stage of the request to the ring of the calling thread
+  void tracer_t::record(stage kind, uint64_t id, uint16_t action, clock_t::time_point begin, clock_t::time_point end)
+  {
+    ring_t& own = ring();
+    if (own.spans.empty())
+      return;
+
+    std::lock_guard<std::mutex> lck(own.mtx);
+    span_t& span = own.spans[own.next % own.spans.size()];
+    span.id = id;
+    span.begin = begin;
+    span.end = end;
+    span.action = action & ~(uint16_t)packet_code::P_RETURN_ACTION;
+    span.kind = kind;
+    span.thread = own.thread;
+    own.next++;
+  }
+
+  // get ring of the calling thread
+  tracer_t::ring_t& tracer_t::ring()
+  {
+    // pool workers and execmd threads come and go, their rings are reused
+    thread_local lease_t lease;
+    if (lease.rings != _rings)
+    {
+      lease.release();
+      lease.acquire(_rings, _capacity);
+    }
+    return *lease.ring;
+  }
+
+  // take a free ring or a new one of 'capacity' spans
+  void tracer_t::lease_t::acquire(const std::shared_ptr<rings_t>& owner, size_t capacity)
+  {
+    {
+      std::lock_guard<std::mutex> lck(owner->mtx);
+      if (!owner->free.empty())
+      {
+        ring = owner->free.back();
+        owner->free.pop_back();
+      }
+    }
+
+    if (ring == nullptr)
+    {
+      std::unique_ptr<ring_t> created(new ring_t());
+      created->spans.resize(capacity);
+
+      std::lock_guard<std::mutex> lck(owner->mtx);
+      owner->all.push_back(std::move(created));
+      ring = owner->all.back().get();
+    }
+
+    // spans of the exited thread stay, the next ones are of this thread
+    std::lock_guard<std::mutex> lck(ring->mtx);
+    ring->thread = binlog_t::thread(); // the same thread id as in binary log
+    rings = owner;
+  }
+
+  // give the ring back
+  void tracer_t::lease_t::release()
+  {
+    if (!rings)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lck(rings->mtx);
+      rings->free.push_back(ring);
+    }
+    rings.reset();
+    ring = nullptr;
+  }
+
+  // write spans of all threads to the file as Chrome trace JSON, return count of spans
+  size_t tracer_t::dump(const std::string& filename) const
+  {
+    // copy rings first, so writers wait for memory copying only
+    std::vector<std::vector<span_t>> copies;
+    {
+      std::lock_guard<std::mutex> lck(_rings->mtx);
+      for (const auto& ring : _rings->all)
+      {
+        std::lock_guard<std::mutex> ring_lck(ring->mtx);
+        size_t size = std::min(ring->next, ring->spans.size());
+        std::vector<span_t> spans;
+        spans.reserve(size);
+        for (size_t i = ring->next - size; i < ring->next; i++)
+          spans.push_back(ring->spans[i % ring->spans.size()]);
+        copies.push_back(std::move(spans));
+      }
+    }
+
+    // time is shown from the oldest span
+    // a thread is named once, its spans may be in several rings
+    clock_t::time_point origin = clock_t::time_point::max();
+    std::set<uint32_t> threads;
+    for (const auto& copy : copies)
+    {
+      for (const span_t& span : copy)
+      {
+        origin = std::min(origin, span.begin);
+        threads.insert(span.thread);
+      }
+    }
+
+    std::ofstream out(filename, std::ios::out | std::ios::trunc);
+    if (!out)
+      throw std::runtime_error("Cannot open trace file \"" + filename + "\"");
+
+    auto us = [origin](clock_t::time_point time)
+    {
+      return std::chrono::duration<double, std::micro>(time - origin).count();
+    };
+
+    size_t count = 0;
+    int pid = (int)::getpid();
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    out << std::fixed << std::setprecision(3);
+    for (uint32_t thread : threads)
+    {
+      out << (count ? ",\n" : "\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << thread
+        << ",\"args\":{\"name\":\"thread " << thread << "\"}}";
+      count++;
+    }
+
+    for (const auto& copy : copies)
+    {
+      for (const span_t& span : copy)
+      {
+        out << (count ? ",\n" : "\n") << "{\"name\":\"" << stage_name(span.kind) << "\",\"cat\":\"request\",\"ph\":\"X\",\"pid\":" << pid
+          << ",\"tid\":" << span.thread << ",\"ts\":" << us(span.begin) << ",\"dur\":" << us(span.end) - us(span.begin)
+          << ",\"args\":{\"request\":" << span.id;
+        if (span.action)
+          out << ",\"action\":\"" << request_stats_t::action_name(span.action) << "\"";
+        out << "}}";
+        count++;
+      }
+    }
+    out << "\n]}\n";
+
+    if (!out)
+      throw std::runtime_error("Cannot write trace file \"" + filename + "\"");
+
+    return count - threads.size();
+  }
+
+  // get stage name
+  const char* tracer_t::stage_name(stage kind)
+  {
+    switch (kind)
+    {
+    case stage::accept:
+      return "accept";
+    case stage::queue:
+      return "queue";
+    case stage::recv:
+      return "recv";
+    case stage::handler:
+      return "handler";
+    case stage::send:
+      return "send";
+    default:
+      return "unknown";
+    }
+  }
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+namespace csnet
+{
+
+  // request lifecycle spans kept in per-thread ring buffers, the ring of an exited thread is taken by the next new thread
+  // the buffers are dumped on demand as Chrome trace JSON, it is opened by chrome://tracing or Perfetto
+  class tracer_t
+  {
+  public:
+    typedef std::chrono::steady_clock clock_t;
+
+    // request stages
+    enum class stage : uint8_t
+    {
+      accept, // accept syscall of the connection
+      queue, // from accept to the start of handling, pool queue or waiting for data
+      recv, // receiving the request
+      handler, // service handler
+      send // sending the reply
+    };
+
+  private:
+    // finished stage of a request, it keeps the thread id as a ring holds spans of an exited thread too
+    struct span_t
+    {
+      uint64_t id = 0;
+      clock_t::time_point begin;
+      clock_t::time_point end;
+      uint16_t action = 0;
+      stage kind = stage::accept;
+      uint32_t thread = 0;
+    };
+
+    // spans of one thread, the oldest ones are overwritten
+    // the lock is taken by the dump only, so it is not contended
+    struct ring_t
+    {
+      std::mutex mtx;
+      std::vector<span_t> spans;
+      size_t next = 0; // count of recorded spans
+      uint32_t thread = 0;
+    };
+
+    // rings of all threads, free ones are left by exited threads
+    struct rings_t
+    {
+      std::mutex mtx;
+      std::vector<std::unique_ptr<ring_t>> all;
+      std::vector<ring_t*> free;
+    };
+
+    // ring taken by a thread, it is given back when the thread exits or records to other tracer
+    struct lease_t
+    {
+      std::shared_ptr<rings_t> rings;
+      ring_t* ring = nullptr;
+
+      ~lease_t()
+      {
+        release();
+      }
+      // take a free ring or a new one of 'capacity' spans
+      void acquire(const std::shared_ptr<rings_t>& owner, size_t capacity);
+      // give the ring back
+      void release();
+    };
+
+  public:
+    tracer_t() = default;
+    tracer_t(const tracer_t&) = delete;
+    tracer_t& operator = (const tracer_t&) = delete;
+
+  public:
+    // set spans count kept per thread, 0 - tracing is disabled, it is set before requests are served
+    void set_capacity(size_t capacity)
+    {
+      _capacity = capacity;
+    }
+    // is tracing enabled
+    bool enabled() const
+    {
+      return _capacity != 0;
+    }
+    // get new request id
+    uint64_t next_id()
+    {
+      return _ids.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // record a stage of the request to the ring of the calling thread
+    void record(stage kind, uint64_t id, uint16_t action, clock_t::time_point begin, clock_t::time_point end);
+
+    // write spans of all threads to the file as Chrome trace JSON, return count of spans
+    // throw std::runtime_error if the file cannot be written
+    size_t dump(const std::string& filename) const;
+
+    // get stage name
+    static const char* stage_name(stage kind);
+
+  private:
+    // get ring of the calling thread
+    ring_t& ring();
+
+  private:
+    std::atomic<size_t> _capacity{ 0 };
+    std::atomic<uint64_t> _ids{ 0 };
+    // a thread keeps the rings alive while it holds one
+    std::shared_ptr<rings_t> _rings = std::make_shared<rings_t>();
+  };
+
+}
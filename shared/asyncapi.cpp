@@ -0,0 +1,339 @@
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <cerrno>
+#include <array>
+
+#include "asyncapi.h"
+#include "csnet_api.h"
+
+#ifndef WSAEWOULDBLOCK
+#define WSAEWOULDBLOCK EWOULDBLOCK
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // size of a chunk of received data
+    static constexpr size_t _READ_CHUNK = 64 * 1024;
+
+    async_client_api_t::async_client_api_t(packet_kind kind) : _kind(kind)
+    {
+    }
+
+    async_client_api_t::~async_client_api_t()
+    {
+      close();
+    }
+
+    // connect to server and start the event loop
+    void async_client_api_t::connect(const std::string& host, int port, int connect_attempts, int next_attempt, int connect_timeout)
+    {
+      close();
+
+      // the blocking api keeps the connect attempts
+      client_api_t api(_kind);
+      api.connect(host, port, connect_attempts, next_attempt, connect_timeout);
+      _socket = api.release();
+      if (!_socket.set_unblocking(true))
+        throw csnet_api_error(_socket.error_msg());
+
+#ifndef _WIN32
+      _wakeup = ::eventfd(0, EFD_NONBLOCK);
+      if (_wakeup < 0)
+        throw csnet_api_error(std::strerror(errno));
+#endif
+
+      _received.clear();
+      _sending.clear();
+      _sent = 0;
+      _stop = false;
+      _running = true;
+      _thread = std::thread(&async_client_api_t::run, this);
+    }
+
+    // stop the event loop and close connection, pending requests fail
+    void async_client_api_t::close()
+    {
+      if (_thread.joinable())
+      {
+        {
+          std::lock_guard<std::mutex> lck(_mtx);
+          _stop = true;
+        }
+        wakeup();
+        _thread.join();
+      }
+
+      fail(std::make_exception_ptr(csnet_api_error("Connection is closed")));
+      _socket.close();
+#ifndef _WIN32
+      if (_wakeup >= 0)
+      {
+        ::close(_wakeup);
+        _wakeup = -1;
+      }
+#endif
+    }
+
+    // is the event loop running on a live connection?
+    bool async_client_api_t::connected() const
+    {
+      std::lock_guard<std::mutex> lck(_mtx);
+      return _running;
+    }
+
+    // get count of requests waiting for replies
+    size_t async_client_api_t::in_flight() const
+    {
+      std::lock_guard<std::mutex> lck(_mtx);
+      return _pending.size();
+    }
+
+    // wait until all requests are replied or failed
+    void async_client_api_t::flush() const
+    {
+      std::unique_lock<std::mutex> lck(_mtx);
+      _idle.wait(lck, [this] { return _pending.empty(); });
+    }
+
+    // queue the request, the handler is called with the reply of 'reply_type'
+    void async_client_api_t::request(packet_type type, packet_code action, const void* data, size_t size, packet_type reply_type, handler_t handler)
+    {
+      thread_local std::vector<int8_t> frame;
+      if (!packet_socket_t::encode(packet_info_t(_kind, type, action), data, size, frame))
+        throw csnet_api_error("Packet is too large");
+
+      bool wake = false;
+      {
+        std::lock_guard<std::mutex> lck(_mtx);
+        if (!_running)
+          throw csnet_api_error("There is no connection");
+
+        // the frame and its pending request are queued together, so replies keep the order
+        _pending.push_back({ reply_type, action | packet_code::P_RETURN_ACTION, std::move(handler) });
+        // the loop takes all queued frames at once, it is woken up by the first one only
+        wake = _queued.empty();
+        _queued.insert(_queued.end(), frame.begin(), frame.end());
+      }
+
+      if (wake)
+        wakeup();
+    }
+
+    // event loop of the connection
+    void async_client_api_t::run()
+    {
+#ifdef _WIN32
+      // there is no eventfd, new requests are picked up by the poll timeout
+      WSAPOLLFD fds[1] = {};
+      const int count = 1;
+      const int timeout = 1;
+#else
+      pollfd fds[2] = {};
+      fds[1].fd = _wakeup;
+      fds[1].events = POLLIN;
+      const int count = 2;
+      const int timeout = -1;
+#endif
+      fds[0].fd = _socket.socket();
+
+      while (true)
+      {
+        {
+          std::lock_guard<std::mutex> lck(_mtx);
+          if (_stop)
+            break;
+
+          // take the queued frames when all of ours are sent
+          if (_sent == _sending.size() && !_queued.empty())
+          {
+            _sending.swap(_queued);
+            _queued.clear();
+            _sent = 0;
+          }
+        }
+
+        if (!write())
+          break;
+
+        fds[0].events = POLLIN;
+        if (_sent < _sending.size())
+          fds[0].events |= POLLOUT;
+
+#ifdef _WIN32
+        int ready = ::WSAPoll(fds, count, timeout);
+#else
+        int ready = ::poll(fds, count, timeout);
+#endif
+        if (ready < 0)
+        {
+#ifndef _WIN32
+          if (errno == EINTR)
+            continue;
+#endif
+          fail(std::make_exception_ptr(csnet_api_error(std::strerror(errno))));
+          break;
+        }
+
+#ifndef _WIN32
+        if (fds[1].revents & POLLIN)
+        {
+          uint64_t value;
+          if (::read(_wakeup, &value, sizeof(value)) < 0) {}
+        }
+#endif
+
+        if ((fds[0].revents & (POLLIN | POLLHUP | POLLERR)) && !read())
+          break;
+      }
+
+      std::lock_guard<std::mutex> lck(_mtx);
+      _running = false;
+    }
+
+    // send queued frames while the socket takes them, false if the connection is broken
+    bool async_client_api_t::write()
+    {
+      while (_sent < _sending.size())
+      {
+        size_t num = _socket.socket_t::send(_sending.data() + _sent, _sending.size() - _sent, MSG_NOSIGNAL);
+        if (num == (size_t)-1)
+        {
+          if (_socket.error() == EAGAIN || _socket.error() == WSAEWOULDBLOCK)
+            return true;
+
+          fail(std::make_exception_ptr(csnet_api_error(_socket.error_msg())));
+          return false;
+        }
+        _sent += num;
+      }
+
+      _sending.clear();
+      _sent = 0;
+      return true;
+    }
+
+    // receive and complete replies while there is data, false if the connection is broken
+    bool async_client_api_t::read()
+    {
+      std::array<int8_t, _READ_CHUNK> chunk;
+      while (true)
+      {
+        size_t num = _socket.socket_t::receive(chunk.data(), chunk.size());
+        if (num == (size_t)-1 || num == 0)
+        {
+          if (num == (size_t)-1 && (_socket.error() == EAGAIN || _socket.error() == WSAEWOULDBLOCK))
+            break;
+
+          fail(std::make_exception_ptr(csnet_api_error(num == 0 ? std::string("Connection is closed by server") : _socket.error_msg())));
+          return false;
+        }
+        _received.insert(_received.end(), chunk.begin(), chunk.begin() + num);
+
+        // complete all whole frames
+        size_t parsed = 0;
+        while (_received.size() - parsed >= sizeof(uint16_t))
+        {
+          uint16_t size;
+          std::memcpy(&size, _received.data() + parsed, sizeof(size));
+          if (size < sizeof(packet_info_t))
+          {
+            fail(std::make_exception_ptr(csnet_api_error("Malformed packet")));
+            return false;
+          }
+          if (_received.size() - parsed < size)
+            break;
+
+          complete(reinterpret_cast<const packet_info_t*>(_received.data() + parsed));
+          parsed += size;
+        }
+        _received.erase(_received.begin(), _received.begin() + parsed);
+
+        if (num < chunk.size())
+          break;
+      }
+
+      return true;
+    }
+
+    // complete the oldest pending request by its reply
+    void async_client_api_t::complete(const packet_info_t* reply)
+    {
+      // the request is pending up to the end of its handler, so flush() waits for the handlers,
+      // callers only add requests to the back, it keeps the front one in place
+      pending_t* pending = nullptr;
+      {
+        std::lock_guard<std::mutex> lck(_mtx);
+        if (_pending.empty())
+          return; // there is no request of the reply
+        pending = &_pending.front();
+      }
+
+      std::exception_ptr error;
+      if (reply->kind == _kind && reply->type == packet_type::P_ERROR_TYPE)
+        error = std::make_exception_ptr(csnet_api_error(static_cast<const packet_error_t*>(reply)->error_text));
+      else if (reply->kind != _kind || reply->type != pending->type || reply->action != pending->action)
+        error = std::make_exception_ptr(csnet_api_error("Unknown packet"));
+
+      try
+      {
+        pending->handler(error ? nullptr : reply, error);
+      }
+      catch (...)
+      {
+        // a handler error does not stop the loop
+      }
+
+      std::lock_guard<std::mutex> lck(_mtx);
+      _pending.pop_front();
+      if (_pending.empty())
+        _idle.notify_all();
+    }
+
+    // fail all pending requests, the connection is not usable after that
+    void async_client_api_t::fail(std::exception_ptr error)
+    {
+      std::deque<pending_t> pending;
+      {
+        std::lock_guard<std::mutex> lck(_mtx);
+        _running = false;
+        _queued.clear();
+        pending.swap(_pending);
+      }
+
+      for (pending_t& request : pending)
+      {
+        try
+        {
+          request.handler(nullptr, error);
+        }
+        catch (...)
+        {
+        }
+      }
+
+      std::lock_guard<std::mutex> lck(_mtx);
+      _idle.notify_all();
+    }
+
+    // wake up the event loop
+    void async_client_api_t::wakeup() const
+    {
+#ifndef _WIN32
+      uint64_t value = 1;
+      if (::write(_wakeup, &value, sizeof(value)) < 0) {}
+#endif
+    }
+
+  }
+}
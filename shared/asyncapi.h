@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <exception>
+
+#include "packsock.h"
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // asynchronous client net api base class
+    // requests are pipelined over one connection, an event loop thread writes them and reads the replies,
+    // the server replies requests of a connection in order, so a reply completes the oldest pending request
+    class async_client_api_t
+    {
+      static constexpr int _CONNECT_ATTEMPT = 5; // what is count attempt to connect if server is busy?
+      static constexpr int _WAIT_NEXT_CONNECT_ATTEMPT = 100; // time in ms to wait next attempt
+      static constexpr int _CONNECT_TIMEOUT = 3000; // time in ms to wait an answer of the server addresses
+
+    public:
+      // reply handler, it gets the reply packet or the error, the packet is valid while the handler runs
+      // handlers are called by the event loop thread, they should not block
+      typedef std::function<void(const packet_info_t* reply, std::exception_ptr error)> handler_t;
+
+    public:
+      async_client_api_t(packet_kind kind = packet_kind::P_BASE_KIND);
+      virtual ~async_client_api_t();
+
+      async_client_api_t(const async_client_api_t&) = delete;
+      async_client_api_t& operator = (const async_client_api_t&) = delete;
+
+    public:
+      // connect to server and start the event loop
+      // throw csnet_api_error if connecting fails
+      void connect(const std::string& host, int port, int connect_attempts = _CONNECT_ATTEMPT, int next_attempt = _WAIT_NEXT_CONNECT_ATTEMPT,
+        int connect_timeout = _CONNECT_TIMEOUT);
+      // stop the event loop and close connection, pending requests fail
+      void close();
+      // is the event loop running on a live connection?
+      bool connected() const;
+      // get count of requests waiting for replies
+      size_t in_flight() const;
+      // wait until all requests are replied or failed
+      void flush() const;
+
+    protected:
+      // queue the request, the handler is called with the reply of 'reply_type'
+      // throw csnet_api_error if there is no connection or the packet is too large
+      void request(packet_type type, packet_code action, const void* data, size_t size, packet_type reply_type, handler_t handler);
+
+    private:
+      // pending request
+      struct pending_t
+      {
+        packet_type type;
+        packet_code action;
+        handler_t handler;
+      };
+
+      // event loop of the connection
+      void run();
+      // send queued frames while the socket takes them, false if the connection is broken
+      bool write();
+      // receive and complete replies while there is data, false if the connection is broken
+      bool read();
+      // complete the oldest pending request by its reply
+      void complete(const packet_info_t* reply);
+      // fail all pending requests, the connection is not usable after that
+      void fail(std::exception_ptr error);
+      // wake up the event loop
+      void wakeup() const;
+
+    private:
+      packet_kind _kind;
+      packet_socket_t _socket;
+      std::thread _thread;
+#ifndef _WIN32
+      int _wakeup = -1;
+#endif
+      mutable std::mutex _mtx;
+      mutable std::condition_variable _idle;
+      bool _running = false;
+      bool _stop = false;
+      std::deque<pending_t> _pending;
+      // frames queued by callers
+      std::vector<int8_t> _queued;
+      // frames of the event loop, they are sent up to '_sent'
+      std::vector<int8_t> _sending;
+      size_t _sent = 0;
+      // received data, it is not a whole frame
+      std::vector<int8_t> _received;
+    };
+
+  }
+}
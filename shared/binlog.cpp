@@ -0,0 +1,186 @@
+#include <chrono>
+#include <ctime>
+#include <array>
+#include <iomanip>
+#include <atomic>
+#include <stdexcept>
+
+#include "binlog.h"
+#include "logger.h"
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    constexpr uint32_t binlog_t::VERSION;
+    constexpr uint32_t binlog_t::TEXT_FORMAT;
+
+    // get monotonic time in ns
+    int64_t binlog_t::now()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // get small sequential id of the calling thread
+    uint32_t binlog_t::thread()
+    {
+      static std::atomic<uint32_t> next{ 1 };
+      thread_local uint32_t id = next++;
+      return id;
+    }
+
+    // make header record of a new file
+    std::string binlog_t::header()
+    {
+      std::string record;
+      begin(record, header_record);
+      put(record, VERSION);
+      put(record, (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+      put(record, now());
+      end(record);
+      return record;
+    }
+
+    // make format record
+    std::string binlog_t::format(uint32_t id, log_level level, const char* file, int line, const char* format)
+    {
+      std::string record;
+      begin(record, format_record);
+      put(record, id);
+      put(record, (uint8_t)level);
+      put(record, (uint32_t)line);
+      put_string(record, file, std::strlen(file));
+      put_string(record, format, std::strlen(format));
+      end(record);
+      return record;
+    }
+
+    // decode record, return true if it is an event
+    bool binlog_decoder_t::decode(const std::string& record, binlog_entry_t& entry)
+    {
+      size_t pos = 0;
+      uint8_t type = get<uint8_t>(record, pos);
+      uint32_t size = get<uint32_t>(record, pos);
+      check(record, pos, size);
+
+      if (type == binlog_t::header_record)
+      {
+        if (get<uint32_t>(record, pos) != binlog_t::VERSION)
+          throw std::runtime_error("unsupported binary log version");
+
+        _wall = get<int64_t>(record, pos);
+        _steady = get<int64_t>(record, pos);
+        _formats.clear();
+        return false;
+      }
+      else if (type == binlog_t::format_record)
+      {
+        uint32_t id = get<uint32_t>(record, pos);
+        format_t& format = _formats[id];
+        format.level = get<uint8_t>(record, pos);
+        format.line = get<uint32_t>(record, pos);
+        format.file = get_string(record, pos);
+        format.text = get_string(record, pos);
+        return false;
+      }
+      else if (type != binlog_t::event_record)
+      {
+        throw std::runtime_error("unknown binary log record");
+      }
+
+      uint32_t id = get<uint32_t>(record, pos);
+      entry.time = _wall + (get<int64_t>(record, pos) - _steady);
+      entry.thread = get<uint32_t>(record, pos);
+      entry.level = (int)log_level::info;
+      entry.text.clear();
+
+      const char* format = "{}";
+      auto it = _formats.find(id);
+      if (it != _formats.end())
+      {
+        format = it->second.text.c_str();
+        entry.level = it->second.level;
+      }
+      else if (id != binlog_t::TEXT_FORMAT)
+      {
+        entry.text = "<unknown format #" + std::to_string(id) + ">";
+      }
+
+      // substitute placeholders by arguments
+      while (pos < record.size())
+      {
+        std::string value;
+        switch (get<uint8_t>(record, pos))
+        {
+        case binlog_t::int_arg:
+          value = std::to_string(get<int64_t>(record, pos));
+          break;
+        case binlog_t::uint_arg:
+          value = std::to_string(get<uint64_t>(record, pos));
+          break;
+        case binlog_t::double_arg:
+        {
+          std::stringstream buf;
+          buf << get<double>(record, pos);
+          value = buf.str();
+          break;
+        }
+        case binlog_t::string_arg:
+          value = get_string(record, pos);
+          break;
+        default:
+          throw std::runtime_error("unknown binary log argument");
+        }
+
+        const char* placeholder = std::strstr(format, "{}");
+        if (placeholder == nullptr)
+        {
+          entry.text += " " + value;
+          continue;
+        }
+
+        entry.text.append(format, placeholder - format);
+        entry.text += value;
+        format = placeholder + 2;
+      }
+      entry.text += format;
+
+      return true;
+    }
+
+    // format entry like text log line 'time, thread id: N. text'
+    std::string binlog_decoder_t::to_string(const binlog_entry_t& entry)
+    {
+      std::time_t now = (std::time_t)(entry.time / 1000000000);
+      int msec = (int)(entry.time / 1000000 % 1000);
+
+      std::array<char, 80> time;
+      strftime(time.data(), time.size(), "%Y-%m-%d %X", localtime(&now));
+
+      std::stringstream buf;
+      buf << time.data() << "." << std::setfill('0') << std::setw(3) << msec << ", thread id: " << entry.thread << ". " << entry.text;
+      if (entry.text.empty() || entry.text.back() != '\n')
+        buf << std::endl;
+      return buf.str();
+    }
+
+    // read string value
+    std::string binlog_decoder_t::get_string(const std::string& record, size_t& pos) const
+    {
+      uint32_t size = get<uint32_t>(record, pos);
+      check(record, pos, size);
+      std::string value = record.substr(pos, size);
+      pos += size;
+      return value;
+    }
+
+    // throw if the record is shorter than needed
+    void binlog_decoder_t::check(const std::string& record, size_t pos, size_t size) const
+    {
+      if (pos + size > record.size())
+        throw std::runtime_error("binary log record is corrupted");
+    }
+
+  }
+}
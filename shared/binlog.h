@@ -0,0 +1,239 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <map>
+#include <type_traits>
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    enum class log_level : int;
+
+    // binary log format
+    // file:   magic, header record, then format and event records
+    // record: uint8 type, uint32 body size, body
+    // header: uint32 version, int64 wall clock ns, int64 monotonic ns at the same moment
+    // format: uint32 id, uint8 level, uint32 line, string file, string format with '{}' placeholders
+    // event:  uint32 format id, int64 monotonic ns, uint32 thread, arguments as uint8 tag and raw value
+    // string: uint32 size and chars, numbers are in host byte order
+    class binlog_t
+    {
+    public:
+      static constexpr uint32_t VERSION = 1;
+      // format id of plain text lines
+      static constexpr uint32_t TEXT_FORMAT = 0;
+
+      // record types
+      enum record_type : uint8_t
+      {
+        header_record = 'H',
+        format_record = 'F',
+        event_record = 'E'
+      };
+
+      // argument tags
+      enum arg_tag : uint8_t
+      {
+        int_arg = 'i',
+        uint_arg = 'u',
+        double_arg = 'd',
+        string_arg = 's'
+      };
+
+    public:
+      // get file magic
+      static const char* magic()
+      {
+        return "CSNETLOG";
+      }
+      // get monotonic time in ns
+      static int64_t now();
+      // get small sequential id of the calling thread
+      static uint32_t thread();
+
+      // make header record of a new file
+      static std::string header();
+      // make format record
+      static std::string format(uint32_t id, log_level level, const char* file, int line, const char* format);
+
+      // make event record
+      template<class... Args>
+      static std::string event(uint32_t id, const Args&... args)
+      {
+        std::string record;
+        record.reserve(64);
+        begin(record, event_record);
+        put(record, id);
+        put(record, now());
+        put(record, thread());
+        int unpack[] = { 0, (arg(record, args), 0)... };
+        (void)unpack;
+        end(record);
+        return record;
+      }
+
+      // format text by '{}' placeholders on the caller side, it is used by text log
+      template<class... Args>
+      static std::string text(const char* format, const Args&... args)
+      {
+        std::stringstream buf;
+        const char* pos = format;
+        int unpack[] = { 0, (pos = text_arg(buf, pos, args), 0)... };
+        (void)unpack;
+        buf << pos;
+        return buf.str();
+      }
+
+    private:
+      // start record, the size is written by end()
+      static void begin(std::string& record, record_type type)
+      {
+        record.push_back((char)type);
+        record.append(sizeof(uint32_t), '\0');
+      }
+      // finish record
+      static void end(std::string& record)
+      {
+        uint32_t size = (uint32_t)(record.size() - 1 - sizeof(uint32_t));
+        std::memcpy(&record[1], &size, sizeof(size));
+      }
+      // append raw value
+      template<class T>
+      static void put(std::string& record, T value)
+      {
+        record.append(reinterpret_cast<const char*>(&value), sizeof(value));
+      }
+      // append string value
+      static void put_string(std::string& record, const char* str, size_t size)
+      {
+        put(record, (uint32_t)size);
+        record.append(str, size);
+      }
+
+      // append argument
+      template<class T>
+      static void arg(std::string& record, const T& value)
+      {
+        if constexpr (std::is_same<T, bool>::value)
+        {
+          record.push_back(uint_arg);
+          put(record, (uint64_t)value);
+        }
+        else if constexpr (std::is_same<T, char>::value)
+        {
+          record.push_back(string_arg);
+          put_string(record, &value, 1);
+        }
+        else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+        {
+          record.push_back(int_arg);
+          put(record, (int64_t)value);
+        }
+        else if constexpr (std::is_integral<T>::value || std::is_enum<T>::value)
+        {
+          record.push_back(uint_arg);
+          put(record, (uint64_t)value);
+        }
+        else if constexpr (std::is_floating_point<T>::value)
+        {
+          record.push_back(double_arg);
+          put(record, (double)value);
+        }
+        else if constexpr (std::is_same<T, std::string>::value)
+        {
+          record.push_back(string_arg);
+          put_string(record, value.data(), value.size());
+        }
+        else if constexpr (std::is_convertible<T, const char*>::value)
+        {
+          const char* str = value;
+          record.push_back(string_arg);
+          put_string(record, str, std::strlen(str));
+        }
+        else
+        {
+          // other types are formatted on the caller side
+          std::stringstream buf;
+          buf << value;
+          std::string str = buf.str();
+          record.push_back(string_arg);
+          put_string(record, str.data(), str.size());
+        }
+      }
+
+      // write text before next placeholder and the argument, return the rest of the format
+      template<class T>
+      static const char* text_arg(std::stringstream& buf, const char* format, const T& value)
+      {
+        const char* placeholder = std::strstr(format, "{}");
+        if (placeholder == nullptr)
+          return format + std::strlen(format); // extra arguments are skipped
+
+        buf.write(format, placeholder - format);
+        if constexpr (std::is_enum<T>::value)
+          buf << (uint64_t)value;
+        else
+          buf << value;
+        return placeholder + 2;
+      }
+    };
+
+    // decoded event of binary log
+    struct binlog_entry_t
+    {
+      int64_t time = 0; // wall clock ns
+      uint32_t thread = 0;
+      int level = 0;
+      std::string text;
+    };
+
+    // binary log decoder, it turns records to text
+    class binlog_decoder_t
+    {
+      // registered format
+      struct format_t
+      {
+        int level = 0;
+        std::string file;
+        uint32_t line = 0;
+        std::string text;
+      };
+
+    public:
+      // decode record, return true if it is an event
+      // header and format records update the decoder state
+      // throw std::runtime_error if the record is corrupted
+      bool decode(const std::string& record, binlog_entry_t& entry);
+
+      // format entry like text log line 'time, thread id: N. text'
+      static std::string to_string(const binlog_entry_t& entry);
+
+    private:
+      // read raw value
+      template<class T>
+      T get(const std::string& record, size_t& pos) const
+      {
+        check(record, pos, sizeof(T));
+        T value;
+        std::memcpy(&value, record.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+      }
+      // read string value
+      std::string get_string(const std::string& record, size_t& pos) const;
+      // throw if the record is shorter than needed
+      void check(const std::string& record, size_t pos, size_t size) const;
+
+    private:
+      std::map<uint32_t, format_t> _formats;
+      int64_t _wall = 0;
+      int64_t _steady = 0;
+    };
+
+  }
+}
@@ -37,8 +37,8 @@ namespace csnet
     // open config file
     void cfgparser_t::openfile(const std::string& filename)
     {
-      std::string fn = findfile(filename);
-      _file.open(fn, std::ios::in);
+      _filename = findfile(filename);
+      _file.open(_filename, std::ios::in);
       if (!_file)
       {
         std::stringstream buf;
@@ -165,6 +165,20 @@ namespace csnet
       throw std::runtime_error("cfgparser_t::set_value is not implemented");
     }
 
+    // reopen the config file to read its changed values
+    void cfgparser_t::reload()
+    {
+      _file.close();
+      _file.clear();
+      _file.open(_filename, std::ios::in);
+      if (!_file)
+      {
+        std::stringstream buf;
+        buf << "Cannot open config file \"" << _filename << "\"";
+        throw std::runtime_error(buf.str());
+      }
+    }
+
     // find section like '[section]' in the config file
     bool cfgparser_t::find_section(const std::string& section) const
     {
@@ -23,6 +23,8 @@ namespace csnet
       std::string get_value(const std::string& section, const std::string& name) const;
       // NOT IMPLEMENTED
       std::string set_value(const std::string& section, const std::string& name, const std::string& value);
+      // reopen the config file to read its changed values
+      void reload();
 
     private:
       // find section like '[section]' in the config file
@@ -44,6 +46,7 @@ namespace csnet
 
     private:
       mutable std::fstream _file;
+      std::string _filename;
     };
 
   }
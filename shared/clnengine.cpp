@@ -0,0 +1,497 @@
+#ifndef _WIN32
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <cerrno>
+#include <array>
+#include <sstream>
+#include <algorithm>
+
+#include "clnengine.h"
+#include "csnet_api.h"
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // size of a chunk of received data
+    static constexpr size_t _READ_CHUNK = 64 * 1024;
+    // max events of one epoll wait
+    static constexpr int _MAX_EVENTS = 256;
+
+    client_engine_t::client_engine_t(packet_kind kind) : _kind(kind)
+    {
+    }
+
+    client_engine_t::~client_engine_t()
+    {
+      stop();
+    }
+
+    // start the event loop thread
+    void client_engine_t::start()
+    {
+      stop();
+
+      _epoll = ::epoll_create1(0);
+      _wakeup = ::eventfd(0, EFD_NONBLOCK);
+      if (_epoll < 0 || _wakeup < 0)
+        throw csnet_api_error(std::strerror(errno));
+
+      // the wakeup has id 0, there is no connection with it
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.u64 = 0;
+      ::epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &event);
+
+      // the loop takes the lock first, so it sees the thread set
+      std::lock_guard<std::mutex> lck(_mtx);
+      _stop = false;
+      _thread = std::thread(&client_engine_t::run, this);
+    }
+
+    // stop the event loop and close all connections, pending requests fail
+    void client_engine_t::stop()
+    {
+      if (_thread.joinable())
+      {
+        {
+          std::lock_guard<std::mutex> lck(_mtx);
+          _stop = true;
+        }
+        uint64_t value = 1;
+        if (::write(_wakeup, &value, sizeof(value)) < 0) {}
+        _thread.join();
+      }
+
+      if (_wakeup >= 0)
+        ::close(_wakeup);
+      if (_epoll >= 0)
+        ::close(_epoll);
+      _wakeup = -1;
+      _epoll = -1;
+    }
+
+    // open a connection, the handler is called by the loop when it is connected or failed
+    client_engine_t::connection_id_t client_engine_t::connect(const std::string& host, int port, connect_handler_t handler)
+    {
+      connection_id_t id = _next_id++;
+      post([this, id, host, port, handler]() { open(id, host, port, handler); });
+      return id;
+    }
+
+    // queue the request to the connection, the handler gets the reply of 'reply_type' or the error
+    void client_engine_t::request(connection_id_t connection, packet_type type, packet_code action, const void* data, size_t size,
+      packet_type reply_type, handler_t handler)
+    {
+      std::vector<int8_t> frame;
+      if (!packet_socket_t::encode(packet_info_t(_kind, type, action), data, size, frame))
+        throw csnet_api_error("Packet is too large");
+
+      pending_t pending = { reply_type, action | packet_code::P_RETURN_ACTION, std::move(handler) };
+      post([this, connection, frame = std::move(frame), pending = std::move(pending)]() mutable
+      {
+        auto found = _connections.find(connection);
+        if (found == _connections.end())
+        {
+          try
+          {
+            pending.handler(nullptr, std::make_exception_ptr(csnet_api_error("There is no connection")));
+          }
+          catch (...)
+          {
+            // a handler error does not stop the loop
+          }
+          return;
+        }
+
+        // the frame is sent with the next write, requests of a connection are sent in turn
+        connection_t& conn = found->second;
+        conn.sending.insert(conn.sending.end(), frame.begin(), frame.end());
+        conn.pending.push_back(std::move(pending));
+        if (conn.connected)
+        {
+          if (!write(connection, conn))
+            return;
+          update(connection, conn);
+        }
+      });
+    }
+
+    // close the connection, its pending requests fail
+    void client_engine_t::close(connection_id_t connection)
+    {
+      post([this, connection]()
+      {
+        fail(connection, std::make_exception_ptr(csnet_api_error("Connection is closed")));
+      });
+    }
+
+    // raise the limit of open files for 'count' connections up to the hard limit, return the limit
+    size_t client_engine_t::raise_files_limit(size_t count)
+    {
+      rlimit limit = {};
+      if (::getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return 0;
+
+      // stdio, logs and the loop take some files too
+      rlim_t wanted = count + 64;
+      if (limit.rlim_cur < wanted && limit.rlim_cur < limit.rlim_max)
+      {
+        limit.rlim_cur = std::min(wanted, limit.rlim_max);
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+        ::getrlimit(RLIMIT_NOFILE, &limit);
+      }
+      return (size_t)limit.rlim_cur;
+    }
+
+    // event loop
+    void client_engine_t::run()
+    {
+      std::array<epoll_event, _MAX_EVENTS> events;
+      std::vector<std::function<void()>> commands;
+
+      while (true)
+      {
+        {
+          std::lock_guard<std::mutex> lck(_mtx);
+          if (_stop)
+            break;
+          commands.swap(_commands);
+        }
+
+        // commands of handlers are queued to the next round, so handlers do not change connections under the loop
+        for (std::function<void()>& command : commands)
+          command();
+        commands.clear();
+
+        {
+          // do not sleep if handlers have queued commands
+          std::lock_guard<std::mutex> lck(_mtx);
+          if (!_commands.empty())
+            continue;
+        }
+
+        int count = ::epoll_wait(_epoll, events.data(), (int)events.size(), -1);
+        if (count < 0 && errno != EINTR)
+          break;
+
+        for (int i = 0; i < count; i++)
+        {
+          connection_id_t id = events[i].data.u64;
+          if (id == 0)
+          {
+            uint64_t value;
+            if (::read(_wakeup, &value, sizeof(value)) < 0) {}
+            continue;
+          }
+
+          auto found = _connections.find(id);
+          if (found == _connections.end())
+            continue;
+          connection_t& connection = found->second;
+
+          if (!connection.connected)
+          {
+            connected(id, connection);
+            continue;
+          }
+
+          if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !read(id, connection))
+            continue;
+          if ((events[i].events & EPOLLOUT) && !write(id, connection))
+            continue;
+          update(id, connection);
+        }
+      }
+
+      // commands queued before the stop are run, so their handlers are called,
+      // new ones are rejected by post()
+      {
+        std::lock_guard<std::mutex> lck(_mtx);
+        _stop = true;
+        commands.swap(_commands);
+      }
+      for (std::function<void()>& command : commands)
+        command();
+
+      // the loop is stopped, all connections fail
+      std::vector<connection_id_t> ids;
+      for (auto& connection : _connections)
+        ids.push_back(connection.first);
+      for (connection_id_t id : ids)
+        fail(id, std::make_exception_ptr(csnet_api_error("Engine is stopped")));
+    }
+
+    // queue a command to the loop
+    void client_engine_t::post(std::function<void()> command)
+    {
+      bool wake = false;
+      {
+        std::lock_guard<std::mutex> lck(_mtx);
+        if (_stop || !_thread.joinable())
+          throw csnet_api_error("Engine is not started");
+
+        // the loop takes all commands at once, it is woken up by the first one only,
+        // the loop thread itself takes them before the next wait
+        wake = _commands.empty() && std::this_thread::get_id() != _thread.get_id();
+        _commands.push_back(std::move(command));
+      }
+
+      if (wake)
+      {
+        uint64_t value = 1;
+        if (::write(_wakeup, &value, sizeof(value)) < 0) {}
+      }
+    }
+
+    // open the connection by the loop
+    void client_engine_t::open(connection_id_t id, const std::string& host, int port, connect_handler_t handler)
+    {
+      connection_t& connection = _connections[id];
+      connection.on_connect = std::move(handler);
+      _connections_count++;
+
+      const addrinfo* address = resolve(host, port);
+      if (!address)
+      {
+        fail(id, std::make_exception_ptr(csnet_api_error("Cannot resolve host \"" + host + "\"")));
+        return;
+      }
+
+      connection.socket = ::socket(address->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+      if (connection.socket < 0)
+      {
+        fail(id, std::make_exception_ptr(csnet_api_error(std::strerror(errno))));
+        return;
+      }
+
+      int nodelay = 1;
+      ::setsockopt(connection.socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+      if (::connect(connection.socket, address->ai_addr, address->ai_addrlen) != 0 && errno != EINPROGRESS)
+      {
+        fail(id, std::make_exception_ptr(csnet_api_error(std::strerror(errno))));
+        return;
+      }
+
+      // it is connected when the socket is writable
+      epoll_event event = {};
+      event.events = EPOLLOUT;
+      event.data.u64 = id;
+      ::epoll_ctl(_epoll, EPOLL_CTL_ADD, connection.socket, &event);
+      connection.events = EPOLLOUT;
+    }
+
+    // resolve the address by the loop, addresses are cached
+    const addrinfo* client_engine_t::resolve(const std::string& host, int port)
+    {
+      std::stringstream key;
+      key << host << ':' << port;
+      auto found = _addresses.find(key.str());
+      if (found != _addresses.end())
+        return found->second.get();
+
+      addrinfo hints = {};
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      addrinfo* info = nullptr;
+      if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &info) != 0)
+        return nullptr;
+
+      _addresses.emplace(key.str(), std::unique_ptr<addrinfo, void(*)(addrinfo*)>(info, ::freeaddrinfo));
+      return info;
+    }
+
+    // the connection is connected or failed
+    void client_engine_t::connected(connection_id_t id, connection_t& connection)
+    {
+      int error = 0;
+      socklen_t len = sizeof(error);
+      if (::getsockopt(connection.socket, SOL_SOCKET, SO_ERROR, &error, &len) != 0)
+        error = errno;
+      if (error != 0)
+      {
+        fail(id, std::make_exception_ptr(csnet_api_error(std::strerror(error))));
+        return;
+      }
+
+      connection.connected = true;
+      connect_handler_t handler = std::move(connection.on_connect);
+      if (handler)
+      {
+        try
+        {
+          handler(id, nullptr);
+        }
+        catch (...)
+        {
+          // a handler error does not stop the loop
+        }
+      }
+
+      // requests queued before connecting are sent now
+      if (write(id, connection))
+        update(id, connection);
+    }
+
+    // send frames while the socket takes them, false if the connection is broken
+    bool client_engine_t::write(connection_id_t id, connection_t& connection)
+    {
+      while (connection.sent < connection.sending.size())
+      {
+        ssize_t num = ::send(connection.socket, connection.sending.data() + connection.sent, connection.sending.size() - connection.sent, MSG_NOSIGNAL);
+        if (num < 0)
+        {
+          if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return true;
+
+          fail(id, std::make_exception_ptr(csnet_api_error(std::strerror(errno))));
+          return false;
+        }
+        connection.sent += num;
+      }
+
+      connection.sending.clear();
+      connection.sent = 0;
+      return true;
+    }
+
+    // receive and complete replies while there is data, false if the connection is broken
+    bool client_engine_t::read(connection_id_t id, connection_t& connection)
+    {
+      // one buffer serves all connections of the loop
+      static thread_local std::array<int8_t, _READ_CHUNK> chunk;
+      while (true)
+      {
+        ssize_t num = ::recv(connection.socket, chunk.data(), chunk.size(), 0);
+        if (num <= 0)
+        {
+          if (num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+          fail(id, std::make_exception_ptr(csnet_api_error(num == 0 ? std::string("Connection is closed by server") : std::strerror(errno))));
+          return false;
+        }
+        connection.received.insert(connection.received.end(), chunk.begin(), chunk.begin() + num);
+
+        // complete all whole frames
+        size_t parsed = 0;
+        while (connection.received.size() - parsed >= sizeof(uint16_t))
+        {
+          uint16_t size;
+          std::memcpy(&size, connection.received.data() + parsed, sizeof(size));
+          if (size < sizeof(packet_info_t))
+          {
+            fail(id, std::make_exception_ptr(csnet_api_error("Malformed packet")));
+            return false;
+          }
+          if (connection.received.size() - parsed < size)
+            break;
+
+          complete(connection, reinterpret_cast<const packet_info_t*>(connection.received.data() + parsed));
+          parsed += size;
+        }
+        connection.received.erase(connection.received.begin(), connection.received.begin() + parsed);
+
+        if ((size_t)num < chunk.size())
+          break;
+      }
+
+      return true;
+    }
+
+    // complete the oldest pending request of the connection by its reply
+    void client_engine_t::complete(connection_t& connection, const packet_info_t* reply)
+    {
+      if (connection.pending.empty())
+        return; // there is no request of the reply
+
+      pending_t pending = std::move(connection.pending.front());
+      connection.pending.pop_front();
+
+      std::exception_ptr error;
+      if (reply->kind == _kind && reply->type == packet_type::P_ERROR_TYPE)
+        error = std::make_exception_ptr(csnet_api_error(static_cast<const packet_error_t*>(reply)->error_text));
+      else if (reply->kind != _kind || reply->type != pending.type || reply->action != pending.action)
+        error = std::make_exception_ptr(csnet_api_error("Unknown packet"));
+
+      try
+      {
+        pending.handler(error ? nullptr : reply, error);
+      }
+      catch (...)
+      {
+        // a handler error does not stop the loop
+      }
+    }
+
+    // set the epoll events of the connection by its state
+    void client_engine_t::update(connection_id_t id, connection_t& connection)
+    {
+      uint32_t events = EPOLLIN;
+      if (connection.sent < connection.sending.size())
+        events |= EPOLLOUT;
+      if (events == connection.events)
+        return;
+
+      epoll_event event = {};
+      event.events = events;
+      event.data.u64 = id;
+      ::epoll_ctl(_epoll, EPOLL_CTL_MOD, connection.socket, &event);
+      connection.events = events;
+    }
+
+    // close the connection and fail its pending requests
+    void client_engine_t::fail(connection_id_t id, std::exception_ptr error)
+    {
+      auto found = _connections.find(id);
+      if (found == _connections.end())
+        return;
+
+      // the connection is removed before handlers are called, so they see it closed
+      connection_t connection = std::move(found->second);
+      _connections.erase(found);
+      _connections_count--;
+      if (connection.socket >= 0)
+      {
+        ::epoll_ctl(_epoll, EPOLL_CTL_DEL, connection.socket, nullptr);
+        ::close(connection.socket);
+      }
+
+      // a handler error does not stop the loop and other handlers
+      if (connection.on_connect)
+      {
+        try
+        {
+          connection.on_connect(id, error);
+        }
+        catch (...)
+        {
+        }
+      }
+      for (pending_t& pending : connection.pending)
+      {
+        try
+        {
+          pending.handler(nullptr, error);
+        }
+        catch (...)
+        {
+        }
+      }
+    }
+
+  }
+}
+
+#endif
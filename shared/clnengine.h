@@ -0,0 +1,132 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+#include <netdb.h>
+
+#include "packsock.h"
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // event driven client engine, one event loop thread drives many non-blocking connections by epoll
+    // requests of a connection are pipelined and replied in order, handlers are called by the loop thread
+    // it is supported in Linux only
+    class client_engine_t
+    {
+    public:
+      // connection id, 0 - there is no connection
+      typedef uint64_t connection_id_t;
+      // connect handler, it gets the error if connecting fails
+      typedef std::function<void(connection_id_t connection, std::exception_ptr error)> connect_handler_t;
+      // reply handler, it gets the reply packet or the error, the packet is valid while the handler runs
+      typedef std::function<void(const packet_info_t* reply, std::exception_ptr error)> handler_t;
+
+    public:
+      client_engine_t(packet_kind kind = packet_kind::P_BASE_KIND);
+      ~client_engine_t();
+
+      client_engine_t(const client_engine_t&) = delete;
+      client_engine_t& operator = (const client_engine_t&) = delete;
+
+    public:
+      // start the event loop thread
+      // throw csnet_api_error if it fails
+      void start();
+      // stop the event loop and close all connections, pending requests fail
+      void stop();
+      // open a connection, the handler is called by the loop when it is connected or failed
+      connection_id_t connect(const std::string& host, int port, connect_handler_t handler = nullptr);
+      // queue the request to the connection, the handler gets the reply of 'reply_type' or the error
+      // throw csnet_api_error if the packet is too large
+      void request(connection_id_t connection, packet_type type, packet_code action, const void* data, size_t size,
+        packet_type reply_type, handler_t handler);
+      // close the connection, its pending requests fail
+      void close(connection_id_t connection);
+      // get count of open connections
+      size_t connections() const
+      {
+        return _connections_count;
+      }
+
+      // raise the limit of open files for 'count' connections up to the hard limit, return the limit
+      static size_t raise_files_limit(size_t count);
+
+    private:
+      // pending request
+      struct pending_t
+      {
+        packet_type type;
+        packet_code action;
+        handler_t handler;
+      };
+
+      // non-blocking connection
+      struct connection_t
+      {
+        int socket = -1;
+        bool connected = false;
+        uint32_t events = 0; // events of the epoll
+        connect_handler_t on_connect;
+        std::deque<pending_t> pending;
+        std::vector<int8_t> sending; // frames to send, they are sent up to 'sent'
+        size_t sent = 0;
+        std::vector<int8_t> received; // received data, it is not a whole frame
+      };
+
+      typedef std::unordered_map<connection_id_t, connection_t> connections_t;
+
+      // event loop
+      void run();
+      // queue a command to the loop
+      void post(std::function<void()> command);
+      // open the connection by the loop
+      void open(connection_id_t id, const std::string& host, int port, connect_handler_t handler);
+      // resolve the address by the loop, addresses are cached
+      const addrinfo* resolve(const std::string& host, int port);
+      // the connection is connected or failed
+      void connected(connection_id_t id, connection_t& connection);
+      // send frames while the socket takes them, false if the connection is broken
+      bool write(connection_id_t id, connection_t& connection);
+      // receive and complete replies while there is data, false if the connection is broken
+      bool read(connection_id_t id, connection_t& connection);
+      // complete the oldest pending request of the connection by its reply
+      void complete(connection_t& connection, const packet_info_t* reply);
+      // set the epoll events of the connection by its state
+      void update(connection_id_t id, connection_t& connection);
+      // close the connection and fail its pending requests
+      void fail(connection_id_t id, std::exception_ptr error);
+
+    private:
+      packet_kind _kind;
+      int _epoll = -1;
+      int _wakeup = -1;
+      std::thread _thread;
+      std::atomic<connection_id_t> _next_id{ 1 };
+      std::atomic<size_t> _connections_count{ 0 };
+      std::mutex _mtx;
+      std::vector<std::function<void()>> _commands;
+      bool _stop = false;
+      // the loop thread owns them
+      connections_t _connections;
+      std::map<std::string, std::unique_ptr<addrinfo, void(*)(addrinfo*)>> _addresses;
+    };
+
+  }
+}
+
+#endif
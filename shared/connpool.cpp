@@ -0,0 +1,108 @@
+#include <sstream>
+#include <algorithm>
+
+#include "connpool.h"
+#include "csnet_api.h"
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    connection_pool_t::connection_pool_t(size_t max_idle, int idle_timeout) : _max_idle(max_idle), _idle_timeout(idle_timeout)
+    {
+    }
+
+    connection_pool_t::~connection_pool_t()
+    {
+    }
+
+    // take a warm connection to host:port, false if there is no alive one
+    bool connection_pool_t::checkout(const std::string& host, int port, packet_socket_t& socket)
+    {
+      std::lock_guard<std::mutex> lck(_mtx);
+      auto found = _idle.find(key(host, port));
+      if (found == _idle.end())
+        return false;
+
+      std::deque<idle_t>& connections = found->second;
+      evict(connections, clock_t::now());
+
+      // the last one is the warmest, the old ones are evicted by time
+      while (!connections.empty())
+      {
+        packet_socket_t taken = std::move(connections.back().socket);
+        connections.pop_back();
+
+        // an idle connection has nothing to read, else the server closed it or the stream is broken
+        if (taken.read_ready(0, 0) == 0)
+        {
+          socket = std::move(taken);
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    // give back a connection after a whole reply, it is closed if the pool is full
+    void connection_pool_t::checkin(const std::string& host, int port, packet_socket_t&& socket)
+    {
+      if (socket.socket() == socket_t::INVALID_SOCKET_HANDLE)
+        return;
+
+      std::lock_guard<std::mutex> lck(_mtx);
+      std::deque<idle_t>& connections = _idle[key(host, port)];
+      clock_t::time_point now = clock_t::now();
+      evict(connections, now);
+      if (connections.size() >= _max_idle)
+        return;
+
+      connections.push_back({ std::move(socket), now });
+    }
+
+    // connect in advance up to 'count' idle connections to host:port
+    void connection_pool_t::preconnect(const std::string& host, int port, size_t count, int connect_attempts, int next_attempt, int connect_timeout)
+    {
+      count = std::min(count, _max_idle);
+      for (size_t i = idle(host, port); i < count; i++)
+      {
+        client_api_t api;
+        api.connect(host, port, connect_attempts, next_attempt, connect_timeout);
+        checkin(host, port, api.release());
+      }
+    }
+
+    // close all idle connections
+    void connection_pool_t::clear()
+    {
+      std::lock_guard<std::mutex> lck(_mtx);
+      _idle.clear();
+    }
+
+    // get count of idle connections to host:port
+    size_t connection_pool_t::idle(const std::string& host, int port) const
+    {
+      std::lock_guard<std::mutex> lck(_mtx);
+      auto found = _idle.find(key(host, port));
+      return found != _idle.end() ? found->second.size() : 0;
+    }
+
+    // pool key of host:port
+    std::string connection_pool_t::key(const std::string& host, int port)
+    {
+      std::stringstream buf;
+      buf << host << ':' << port;
+      return buf.str();
+    }
+
+    // close idle connections older than idle timeout, the pool is locked
+    void connection_pool_t::evict(std::deque<idle_t>& connections, clock_t::time_point now)
+    {
+      // the oldest ones are in front
+      while (!connections.empty() && now - connections.front().since >= _idle_timeout)
+        connections.pop_front();
+    }
+
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <chrono>
+
+#include "packsock.h"
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // pool of warm client connections per host:port, it is thread-safe
+    // the server keeps a connection after a reply, so next requests skip the connecting
+    class connection_pool_t
+    {
+      static constexpr size_t _MAX_IDLE = 8; // max idle connections per host:port
+      static constexpr int _IDLE_TIMEOUT = 10000; // time in ms, it should be less than the server keep-alive timeout
+
+    public:
+      connection_pool_t(size_t max_idle = _MAX_IDLE, int idle_timeout = _IDLE_TIMEOUT);
+      ~connection_pool_t();
+
+      connection_pool_t(const connection_pool_t&) = delete;
+      connection_pool_t& operator = (const connection_pool_t&) = delete;
+
+    public:
+      // take a warm connection to host:port, false if there is no alive one
+      bool checkout(const std::string& host, int port, packet_socket_t& socket);
+      // give back a connection after a whole reply, it is closed if the pool is full
+      void checkin(const std::string& host, int port, packet_socket_t&& socket);
+      // connect in advance up to 'count' idle connections to host:port
+      // throw csnet_api_error if connecting fails
+      void preconnect(const std::string& host, int port, size_t count, int connect_attempts, int next_attempt, int connect_timeout);
+      // close all idle connections
+      void clear();
+      // get count of idle connections to host:port
+      size_t idle(const std::string& host, int port) const;
+
+    private:
+      typedef std::chrono::steady_clock clock_t;
+
+      // idle connection
+      struct idle_t
+      {
+        packet_socket_t socket;
+        clock_t::time_point since;
+      };
+
+      // pool key of host:port
+      static std::string key(const std::string& host, int port);
+      // close idle connections older than idle timeout, the pool is locked
+      void evict(std::deque<idle_t>& connections, clock_t::time_point now);
+
+    private:
+      size_t _max_idle;
+      std::chrono::milliseconds _idle_timeout;
+      mutable std::mutex _mtx;
+      std::map<std::string, std::deque<idle_t>> _idle;
+    };
+
+  }
+}
@@ -28,21 +28,30 @@ namespace csnet
     void csnet_api_t::send(packet_code action) const
     {
       if (!_socket.send(packet_info_t(_kind, packet_type::P_NULL_TYPE, action)))
+      {
+        _broken = true;
         throw csnet_api_error(_socket.error_msg());
+      }
     }
 
     // send data to server
     void csnet_api_t::send(packet_code action, const void* data, size_t size) const
     {
       if (!_socket.send(packet_info_t(_kind, packet_type::P_DATA_TYPE, action), data, size))
+      {
+        _broken = true;
         throw csnet_api_error(_socket.error_msg());
+      }
     }
 
     // send text to server
     void csnet_api_t::send(packet_code action, const std::string& text) const
     {
       if (!_socket.send(packet_info_t(_kind, packet_type::P_TEXT_TYPE, action), text))
+      {
+        _broken = true;
         throw csnet_api_error(_socket.error_msg());
+      }
     }
 
     // send error to server
@@ -60,7 +69,10 @@ namespace csnet
       packet_error->error_code = error;
 
       if (!_socket.send(packet_error))
+      {
+        _broken = true;
         throw csnet_api_error(_socket.error_msg());
+      }
     }
 
     // did server return error?
@@ -68,14 +80,20 @@ namespace csnet
     {
       iserror(packet);
       if (packet->kind != _kind || packet->type != type || packet->action != action)
+      {
+        _broken = true;
         throw csnet_api_error("Unknown packet");
+      }
     }
 
     // did server return error?
     void csnet_api_t::iserror(packet_info_t* packet) const
     {
       if (!packet)
+      {
+        _broken = true;
         throw csnet_api_error(_socket.error_msg().size() ? _socket.error_msg() : "Error receiving packet");
+      }
       else if (packet->kind == _kind && packet->type == packet_type::P_ERROR_TYPE)
         throw csnet_api_error(static_cast<packet_error_t*>(packet)->error_text);
     }
@@ -129,6 +147,23 @@ namespace csnet
       return _packet != nullptr;
     }
 
+    // take a request frame read by the caller, false if it is not a whole packet
+    bool server_api_t::receive(const std::vector<int8_t>& frame)
+    {
+      _packet.reset();
+      uint16_t size = 0;
+      if (frame.size() >= sizeof(packet_info_t))
+        std::memcpy(&size, frame.data(), sizeof(size));
+      if (size < sizeof(packet_info_t) || size != frame.size())
+        return false;
+
+      // the packet is allocated like the received one
+      int8_t* placement = new int8_t[size];
+      std::memmove(placement, frame.data(), size);
+      _packet.reset(reinterpret_cast<packet_info_t*>(placement));
+      return true;
+    }
+
     // is packet of the type
     bool server_api_t::is_packet_of(packet_type type, packet_code action) const
     {
@@ -143,10 +178,11 @@ namespace csnet
 
     client_api_t::~client_api_t()
     {
+      close();
     }
 
-    // connect to server w/o credentials
-    void client_api_t::connect(const std::string& host, int port, int connect_attempts, int next_attempt)
+    // connect to server w/o credentials, the server addresses are raced up to 'connect_timeout' ms
+    void client_api_t::connect(const std::string& host, int port, int connect_attempts, int next_attempt, int connect_timeout)
     {
       // try to connect
       int res = 0;
@@ -156,18 +192,17 @@ namespace csnet
         // need to recreate before new connect
         close();
 
-        // init socket object
-        if (!_socket.create())
-          throw csnet_api_error(_socket.error_msg());
-        res = _socket.connect(host, port);
+        // the socket is created by the family of the answering address
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        res = _socket.connect(host, port, connect_timeout);
         if (res)
           break; // connected
         else if (WSAETIMEDOUT == _socket.error()) // checking for timeout
           throw csnet_api_error(_socket.error_msg());
 
         // skip any connect error and try again
-        //waiting for next connection
-        std::this_thread::sleep_for(std::chrono::milliseconds(next_attempt));
+        // waiting for next connection, the time of the failed attempt is a part of it
+        std::this_thread::sleep_until(started + std::chrono::milliseconds(next_attempt));
       }
 
       if (!res) // attempts have been exhausted
@@ -176,9 +211,25 @@ namespace csnet
       // it is OK!
     }
 
-    // close connection
+    // take a warm connection of the pool or connect to server, close() gives it back
+    void client_api_t::connect(connection_pool_t& pool, const std::string& host, int port, int connect_attempts, int next_attempt, int connect_timeout)
+    {
+      close();
+      if (!pool.checkout(host, port, _socket))
+        connect(host, port, connect_attempts, next_attempt, connect_timeout);
+
+      _pool = &pool;
+      _host = host;
+      _port = port;
+    }
+
+    // close connection, a healthy pooled connection goes back to its pool
     void client_api_t::close()
     {
+      if (_pool && !_broken)
+        _pool->checkin(_host, _port, std::move(_socket));
+      _pool = nullptr;
+      _broken = false;
       _socket.close();
     }
 
@@ -4,6 +4,7 @@
 #include <stdexcept>
 
 #include "packsock.h"
+#include "connpool.h"
 
 namespace csnet
 {
@@ -31,6 +32,13 @@ namespace csnet
       csnet_api_t(packet_kind kind = packet_kind::P_BASE_KIND);
       virtual ~csnet_api_t();
 
+    public:
+      // take the socket out of the api, e.g. to keep the connection
+      packet_socket_t release()
+      {
+        return std::move(_socket);
+      }
+
     protected:
       // send action to server
       void send(packet_code action) const;
@@ -55,6 +63,8 @@ namespace csnet
     protected:
       packet_kind _kind;
       packet_socket_t _socket;
+      // the stream is out of sync after a failed send or receive, the connection cannot be reused
+      mutable bool _broken = false;
     };
 
     // packet with credentials data
@@ -77,6 +87,8 @@ namespace csnet
       void onaccept(packet_socket_t&& socket);
       // receive data from server
       bool receive();
+      // take a request frame read by the caller, false if it is not a whole packet
+      bool receive(const std::vector<int8_t>& frame);
       // is packet of the type
       bool is_packet_of(packet_type type, packet_code action) const;
       // get typed packet
@@ -85,6 +97,16 @@ namespace csnet
       {
         return static_cast<T*>(_packet.get());
       }
+      // get bytes received from the client
+      size_t received_bytes() const
+      {
+        return _socket.received_bytes();
+      }
+      // get bytes sent to the client
+      size_t sent_bytes() const
+      {
+        return _socket.sent_bytes();
+      }
 
     protected:
       std::unique_ptr<packet_info_t> _packet;
@@ -95,15 +117,20 @@ namespace csnet
     {
       static constexpr int _CONNECT_ATTEMPT = 5; // what is count attempt to connect if server is busy?
       static constexpr int _WAIT_NEXT_CONNECT_ATTEMPT = 100; // time in ms to wait next attempt
+      static constexpr int _CONNECT_TIMEOUT = 3000; // time in ms to wait an answer of the server addresses
 
     public:
       client_api_t(packet_kind kind = packet_kind::P_BASE_KIND);
       virtual ~client_api_t();
 
     public:
-      // connect to server w/o credentials
-      void connect(const std::string& host, int port, int connect_attempts = _CONNECT_ATTEMPT, int next_attempt = _WAIT_NEXT_CONNECT_ATTEMPT);
-      // close connection
+      // connect to server w/o credentials, the server addresses are raced up to 'connect_timeout' ms
+      void connect(const std::string& host, int port, int connect_attempts = _CONNECT_ATTEMPT, int next_attempt = _WAIT_NEXT_CONNECT_ATTEMPT,
+        int connect_timeout = _CONNECT_TIMEOUT);
+      // take a warm connection of the pool or connect to server, close() gives it back
+      void connect(connection_pool_t& pool, const std::string& host, int port, int connect_attempts = _CONNECT_ATTEMPT, int next_attempt = _WAIT_NEXT_CONNECT_ATTEMPT,
+        int connect_timeout = _CONNECT_TIMEOUT);
+      // close connection, a healthy pooled connection goes back to its pool
       void close();
       // check server connection
       uint64_t ping(uint64_t data) const;
@@ -115,6 +142,11 @@ namespace csnet
       virtual std::string receive_reply_text(packet_code action) const;
       // receive reply data from server
       virtual void receive_reply_data(packet_code action, std::vector<int8_t>& data) const;
+
+    private:
+      connection_pool_t* _pool = nullptr;
+      std::string _host;
+      int _port = 0;
     };
 
   }
@@ -0,0 +1,101 @@
+#include "histogram.h"
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // copy counts
+    histogram_t::histogram_t(const histogram_t& rhs)
+    {
+      merge(rhs);
+    }
+
+    // copy counts
+    histogram_t& histogram_t::operator = (const histogram_t& rhs)
+    {
+      if (this != &rhs)
+      {
+        reset();
+        merge(rhs);
+      }
+      return *this;
+    }
+
+    // add counts of other histogram
+    void histogram_t::merge(const histogram_t& rhs)
+    {
+      for (size_t i = 0; i < BUCKETS; i++)
+      {
+        uint64_t count = rhs.bucket(i);
+        if (count)
+          _buckets[i].store(bucket(i) + count, std::memory_order_relaxed);
+      }
+      _count.store(count() + rhs.count(), std::memory_order_relaxed);
+      _sum.store(sum() + rhs.sum(), std::memory_order_relaxed);
+      if (rhs.max() > max())
+        _max.store(rhs.max(), std::memory_order_relaxed);
+    }
+
+    // clear counts
+    void histogram_t::reset()
+    {
+      for (auto& bucket : _buckets)
+        bucket.store(0, std::memory_order_relaxed);
+      _count = 0;
+      _sum = 0;
+      _max = 0;
+    }
+
+    // get value at percentile like 99.9, it is the highest value of its bucket
+    uint64_t histogram_t::percentile(double p) const
+    {
+      // the buckets are read one by one, so the total may differ from count()
+      uint64_t total = 0;
+      for (size_t i = 0; i < BUCKETS; i++)
+        total += bucket(i);
+      if (total == 0)
+        return 0;
+
+      uint64_t rank = (uint64_t)(p / 100.0 * total + 0.5);
+      if (rank < 1)
+        rank = 1;
+      if (rank > total)
+        rank = total;
+
+      uint64_t seen = 0;
+      for (size_t i = 0; i < BUCKETS; i++)
+      {
+        seen += bucket(i);
+        if (seen >= rank)
+        {
+          // no value is over the max
+          uint64_t upper = upper_of(i);
+          return (upper < max()) ? upper : max();
+        }
+      }
+      return max();
+    }
+
+    // get count of values which buckets are not above the value, like a cumulative bucket of other formats
+    uint64_t histogram_t::count_below(uint64_t value) const
+    {
+      uint64_t count = 0;
+      for (size_t i = 0; i < BUCKETS && upper_of(i) <= value; i++)
+        count += bucket(i);
+      return count;
+    }
+
+    // get the highest value of the bucket
+    uint64_t histogram_t::upper_of(size_t index)
+    {
+      if (index < _LINEAR)
+        return index;
+
+      uint64_t shift = (index - _LINEAR) / _SUB_COUNT + 1;
+      uint64_t sub = (index - _LINEAR) % _SUB_COUNT;
+      return ((_SUB_COUNT + sub + 1) << shift) - 1;
+    }
+
+  }
+}
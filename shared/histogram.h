@@ -0,0 +1,122 @@
+#pragma once
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <array>
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // HDR-style log-linear histogram of values like latencies in ns
+    // values below 64 are exact, above them each power of two is split to 32 buckets,
+    // so a value is kept with ~3% precision up to 2^36 (~68 s in ns), larger values are clamped
+    // one thread records, any thread may read and merge it
+    class histogram_t
+    {
+      static constexpr int _SUB_BITS = 5;
+      static constexpr uint64_t _SUB_COUNT = 1 << _SUB_BITS;
+      static constexpr uint64_t _LINEAR = _SUB_COUNT * 2; // exact values
+      static constexpr int _MAX_BITS = 36;
+
+    public:
+      static constexpr size_t BUCKETS = _LINEAR + (_MAX_BITS - _SUB_BITS - 1) * _SUB_COUNT;
+      static constexpr uint64_t MAX_VALUE = (1ull << _MAX_BITS) - 1;
+
+    public:
+      histogram_t() = default;
+      histogram_t(const histogram_t& rhs);
+      histogram_t& operator = (const histogram_t& rhs);
+
+    public:
+      // add value, it is called by the owner thread only
+      void record(uint64_t value)
+      {
+        if (value > MAX_VALUE)
+          value = MAX_VALUE;
+
+        // single writer, no need of atomic read-modify-write
+        std::atomic<uint64_t>& bucket = _buckets[index_of(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _sum.store(_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if (value > _max.load(std::memory_order_relaxed))
+          _max.store(value, std::memory_order_relaxed);
+      }
+
+      // add counts of other histogram
+      void merge(const histogram_t& rhs);
+      // clear counts
+      void reset();
+
+      // get count of values
+      uint64_t count() const
+      {
+        return _count.load(std::memory_order_relaxed);
+      }
+      // get sum of values
+      uint64_t sum() const
+      {
+        return _sum.load(std::memory_order_relaxed);
+      }
+      // get max value
+      uint64_t max() const
+      {
+        return _max.load(std::memory_order_relaxed);
+      }
+      // get mean value
+      double mean() const
+      {
+        return count() ? (double)sum() / count() : 0;
+      }
+      // get value at percentile like 99.9, it is the highest value of its bucket
+      uint64_t percentile(double p) const;
+      // get count of values which buckets are not above the value, like a cumulative bucket of other formats
+      uint64_t count_below(uint64_t value) const;
+
+      // get count of values in the bucket
+      uint64_t bucket(size_t index) const
+      {
+        return _buckets[index].load(std::memory_order_relaxed);
+      }
+      // get the highest value of the bucket
+      static uint64_t upper_of(size_t index);
+      // get bucket index of the value
+      static size_t index_of(uint64_t value)
+      {
+        if (value < _LINEAR)
+          return (size_t)value;
+
+        int bits = 63 - count_zeros(value); // position of the highest bit, it is _SUB_BITS + 1 or more
+        int shift = bits - _SUB_BITS;
+        return (size_t)(_LINEAR + (shift - 1) * _SUB_COUNT + ((value >> shift) & (_SUB_COUNT - 1)));
+      }
+
+    private:
+      // count leading zero bits, value is not zero
+      static int count_zeros(uint64_t value)
+      {
+#ifdef _WIN32
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return 63 - (int)index;
+#else
+        return __builtin_clzll(value);
+#endif
+      }
+
+    private:
+      std::array<std::atomic<uint64_t>, BUCKETS> _buckets{};
+      std::atomic<uint64_t> _count{ 0 };
+      std::atomic<uint64_t> _sum{ 0 };
+      std::atomic<uint64_t> _max{ 0 };
+    };
+
+  }
+}
@@ -4,7 +4,6 @@
 #else
 #include <unistd.h>
 #include <libgen.h>
-#include <sys/time.h>
 #endif
 
 #include <cstdio>
@@ -15,7 +14,10 @@
 #include <limits.h>
 #include <cstdlib>
 #include <array>
-#include <iomanip>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <functional>
 
 #include "logger.h"
 
@@ -36,11 +38,73 @@ namespace csnet
     }
 
     // open logfile by name
-    bool logger_t::open(const std::string& filename)
+    bool logger_t::open(const std::string& filename, bool binary)
     {
       std::string fn = findfile(filename);
-      _file.open(fn, std::fstream::out | std::fstream::trunc);
-      return (bool)_file;
+      _file.open(fn, std::fstream::out | std::fstream::trunc | (binary ? std::fstream::binary : std::fstream::out));
+      if (!_file)
+        return false;
+
+      _binary = binary;
+      _file << prologue();
+      _file.flush();
+
+      enable(binary);
+      return true;
+    }
+
+    // open rotating memory-mapped segments 'filename.N' of segment_size bytes,
+    // last 'segments' files are kept, written data is synced every sync_interval ms
+    bool logger_t::open_mapped(const std::string& filename, bool binary, size_t segment_size, size_t segments, int sync_interval)
+    {
+      std::string fn = findfile(filename);
+
+      _binary = binary;
+      try
+      {
+        _sink.reset(new mmap_sink_t(fn, segment_size, segments, sync_interval, [this] { return prologue(); }, &_formats_mtx));
+      }
+      catch (std::exception& e)
+      {
+        std::cerr << e.what() << std::endl;
+        return false;
+      }
+
+      enable(binary);
+      return true;
+    }
+
+    // enable logging after opening
+    void logger_t::enable(bool binary)
+    {
+      if (binary)
+      {
+        // the decoder to double binary log to stdout knows formats registered before opening
+        binlog_entry_t entry;
+        _decoder.decode(binlog_t::header(), entry);
+
+        std::lock_guard<std::recursive_mutex> lck(_formats_mtx);
+        for (const std::string& format : _formats)
+          _decoder.decode(format, entry);
+      }
+
+      _opened = true;
+      _threshold = (int)_level.load();
+    }
+
+    // get data written first to a log file, the binary log needs header and known formats
+    std::string logger_t::prologue()
+    {
+      std::string data;
+      if (_binary)
+      {
+        data = binlog_t::magic() + binlog_t::header();
+
+        std::lock_guard<std::recursive_mutex> lck(_formats_mtx);
+        for (const std::string& format : _formats)
+          data += format;
+      }
+      return data;
     }
 
     // find log file
@@ -69,11 +133,14 @@ namespace csnet
         log = path.parent_path().string() + '\\' + log_path.filename().string();
       }
 #else
+      std::string dir = log; // dirname changes its argument
       if (log.empty()) // if file is not specified use exe-name + .log
       {
         char dest[PATH_MAX];
-        if (readlink("/proc/self/exe", dest, PATH_MAX) != -1) // get process full path
+        ssize_t length = readlink("/proc/self/exe", dest, PATH_MAX - 1);
+        if (length != -1) // get process full path
         {
+          dest[length] = 0; // readlink does not terminate the path
           // process path
           std::string fn = basename(dest);
           // process name
@@ -85,11 +152,13 @@ namespace csnet
           log += ".log";
         }
       }
-      else if (dirname(&log.front()) == nullptr || *dirname(&log.front()) == '.') // if dir is not specified use exe dir
+      else if (dirname(&dir.front()) == nullptr || *dirname(&dir.front()) == '.') // if dir is not specified use exe dir
       {
         char dest[PATH_MAX];
-        if (readlink("/proc/self/exe", dest, PATH_MAX) != -1) // get process full path
+        ssize_t length = readlink("/proc/self/exe", dest, PATH_MAX - 1);
+        if (length != -1) // get process full path
         {
+          dest[length] = 0; // readlink does not terminate the path
           // process name
           std::string fn = basename(&log.front());
           // process name
@@ -108,7 +177,97 @@ namespace csnet
     // close logfile
     void logger_t::close()
     {
+      if (opened())
+        report_suppressed();
+
+      // producers which passed the level check leave before the file is closed
+      _threshold = (int)log_level::off;
+      _opened = false;
+      stop_async();
+      wait_producers();
+
+      std::lock_guard<std::mutex> lck(_mtx);
       _file.close();
+      _sink.reset();
+    }
+
+    // set runtime log level, it can be changed at any time
+    void logger_t::set_level(log_level level)
+    {
+      _level = level;
+      if (opened())
+        _threshold = (int)level;
+    }
+
+    // get level by name like 'info', unknown name is 'info'
+    log_level logger_t::to_level(const std::string& name)
+    {
+      for (int level = (int)log_level::trace; level <= (int)log_level::off; level++)
+      {
+        if (name == level_name((log_level)level))
+          return (log_level)level;
+      }
+      return log_level::info;
+    }
+
+    // get level name
+    const char* logger_t::level_name(log_level level)
+    {
+      switch (level)
+      {
+      case log_level::trace:
+        return "trace";
+      case log_level::debug:
+        return "debug";
+      case log_level::info:
+        return "info";
+      case log_level::warn:
+        return "warn";
+      case log_level::error:
+        return "error";
+      default:
+        return "off";
+      }
+    }
+
+    // start background writer, producers queue lines to the lock-free ring
+    // and the writer writes them in batches, flushes by size or by time
+    void logger_t::start_async(size_t queue_size, int flush_interval, size_t flush_size)
+    {
+      if (_async || !opened())
+        return;
+
+      _queue.reset(new ring_buffer_t<record_t>(queue_size));
+      _flush_interval = std::chrono::milliseconds(flush_interval);
+      _flush_size = flush_size;
+      _stop_writer = false;
+      _writer = std::thread(&logger_t::writer, this);
+      _async = true;
+    }
+
+    // stop background writer and write queued lines
+    void logger_t::stop_async()
+    {
+      if (!_async)
+        return;
+
+      // producers write to the file under the lock after the queue is written
+      std::lock_guard<std::mutex> lck(_mtx);
+      _async = false;
+      // a producer which has seen the async mode pushes its line before the final drain
+      wait_producers();
+      {
+        std::lock_guard<std::mutex> stop(_writer_mtx);
+        _stop_writer = true;
+      }
+      _wakeup.notify_one();
+      _writer.join();
+
+      // lines pushed while the writer was stopping
+      record_t record;
+      while (_queue->pop(record))
+        output(record.text, record.prefix);
+      flush();
     }
 
     // log out like a printf format
@@ -116,67 +275,423 @@ namespace csnet
     {
       if (opened())
       {
-        std::lock_guard<std::mutex> lck(_mtx);
-
-        // get buffer size
+        // format message, most lines fit the stack buffer
+        std::array<char, 512> buffer;
         va_list args;
         va_start(args, format);
-        size_t size = vsnprintf(nullptr, 0, format, args) + 1;
+        va_list copy;
+        va_copy(copy, args);
+        int size = vsnprintf(buffer.data(), buffer.size(), format, args);
+        va_end(args);
 
-        // allocate buffer
         std::string str;
-        str.resize(size);
+        if (size >= (int)buffer.size())
+        {
+          str.resize(size + 1);
+          vsnprintf(&str.front(), str.size(), format, copy);
+          str.resize(size);
+        }
+        else if (size > 0)
+        {
+          str.assign(buffer.data(), size);
+        }
+        va_end(copy);
 
-        // format message
-        va_start(args, format);
-        vsnprintf(&str.front(), str.size(), format, args);
+        logout(str);
+      }
+    }
+
+    // log out, the string is not a format
+    void logger_t::logout(const std::string& log)
+    {
+      if (opened())
+      {
+        size_t prefix = 0;
+        std::string line = make_line(log, prefix);
+        write(std::move(line), prefix);
+      }
+    }
+
+    // register a static format of LOGFMT call site, return its id
+    uint32_t logger_t::register_format(log_level level, const char* file, int line, const char* format)
+    {
+      std::unique_lock<std::recursive_mutex> lck(_formats_mtx);
+      uint32_t id = (uint32_t)_formats.size() + 1;
+      _formats.push_back(binlog_t::format(id, level, file, line, format));
+
+      if (_binary && opened())
+      {
+        // a rotating writer takes the lock to start a segment, the format is written
+        // after it is known, so it is in the new segment prologue or after it;
+        // the lock is released first, the write may rotate the segment itself
+        std::string record = _formats.back();
+        lck.unlock();
+        write_format(std::move(record));
+      }
+
+      return id;
+    }
+
+    // make a record of the text line with time and thread id
+    std::string logger_t::make_line(const std::string& log, size_t& prefix) const
+    {
+      if (_binary)
+      {
+        prefix = 0;
+        return binlog_t::event(binlog_t::TEXT_FORMAT, log);
+      }
+
+      const std::string& time = cur_time();
+      const std::string& id = thread_id();
+
+      std::string line;
+      line.reserve(time.size() + id.size() + log.size() + 16);
+      line += time;
+      line += ", thread id: ";
+      line += id;
+      line += ". ";
+      prefix = line.size();
+      line += log;
+      return line;
+    }
+
+    // write the line to the file or queue it
+    void logger_t::write(std::string&& line, size_t prefix)
+    {
+      // there is no writer to report call sites which have gone quiet, the next line does it
+      if (!_async)
+      {
+        for (const std::string& text : passed_suppressed())
+          logout(text);
+      }
+
+      {
+        // the state is checked after the producer is counted, so closing and stopping see it
+        producer_t producer(_producers);
+        if (!_opened)
+          return;
+
+        if (_async)
+        {
+          if (!_queue->push(record_t{ std::move(line), prefix }))
+          {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+          }
+
+          // wake the writer only if it sleeps
+          if (_sleeping.load())
+          {
+            std::lock_guard<std::mutex> lck(_writer_mtx);
+            _wakeup.notify_one();
+          }
+          return;
+        }
+
+        // segments are written w/o lock
+        if (_sink && !_stdout)
+        {
+          put(line);
+          return;
+        }
+      }
+
+      std::lock_guard<std::mutex> lck(_mtx);
+      output(line, prefix);
+      flush();
+    }
+
+    // write the binary record which may not be dropped
+    void logger_t::write_format(std::string&& record)
+    {
+      {
+        producer_t producer(_producers);
+        if (!_opened)
+          return;
+
+        if (_async)
+        {
+          // formats are registered once per call site, wait for the writer
+          record_t format{ std::move(record), 0 };
+          while (!_queue->push(std::move(format)))
+            std::this_thread::yield();
+          return;
+        }
+      }
+
+      std::lock_guard<std::mutex> lck(_mtx);
+      output(record, 0);
+      flush();
+    }
+
+    // write the record to the file and stdout, call under lock or from the writer
+    void logger_t::output(const std::string& text, size_t prefix)
+    {
+      put(text);
+
+      if (!_stdout)
+        return;
+
+      // double a log to stdout
+      binlog_entry_t entry;
+      if (!_binary)
+        std::clog << text.c_str() + prefix;
+      else if (_decoder.decode(text, entry))
+        std::clog << entry.text << (entry.text.empty() || entry.text.back() != '\n' ? "\n" : "");
+    }
+
+    // write the record to the segment or the file
+    void logger_t::put(const std::string& text)
+    {
+      if (!_sink)
+        _file << text;
+      else if (!_sink->write(text.data(), text.size()))
+        _dropped.fetch_add(1, std::memory_order_relaxed); // larger than a segment
+    }
+
+    // wait for producers which write w/o lock
+    void logger_t::wait_producers() const
+    {
+      while (_producers.load())
+        std::this_thread::yield();
+    }
 
-        // write to file
-        _file << cur_time() << ", thread id: " << thread_id() << ". " << str.c_str();
+    // flush the file, segments are synced by their own thread
+    void logger_t::flush()
+    {
+      if (!_sink)
         _file.flush();
+    }
 
-        if (_stdout)
-          std::clog << str.c_str(); // double a log to stdout
+    // background writer thread function
+    void logger_t::writer()
+    {
+      record_t record;
+      size_t unflushed = 0;
+      uint64_t reported = 0;
+      std::chrono::steady_clock::time_point flushed = std::chrono::steady_clock::now();
 
-        va_end(args);
+      for (;;)
+      {
+        // write a batch of queued lines
+        size_t batch = 0;
+        while (_queue->pop(record))
+        {
+          output(record.text, record.prefix);
+
+          unflushed += record.text.size();
+          batch++;
+
+          if (unflushed >= _flush_size)
+          {
+            flush();
+            unflushed = 0;
+            flushed = std::chrono::steady_clock::now();
+          }
+        }
+
+        // report call sites which have gone quiet, the writer writes the lines itself
+        // as its own logging is not possible when the async mode is stopped
+        for (const std::string& text : passed_suppressed())
+        {
+          size_t prefix = 0;
+          output(make_line(text, prefix), prefix);
+          unflushed += text.size();
+        }
+
+        // report lines lost under pressure
+        uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+        if (dropped != reported)
+        {
+          std::stringstream buf;
+          buf << dropped - reported << " log lines are dropped, the queue is full." << std::endl;
+          size_t prefix = 0;
+          put(make_line(buf.str(), prefix));
+          reported = dropped;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (unflushed && now - flushed >= _flush_interval)
+        {
+          flush();
+          unflushed = 0;
+          flushed = now;
+        }
+
+        if (batch == 0)
+        {
+          std::unique_lock<std::mutex> lck(_writer_mtx);
+          if (_stop_writer)
+            break;
+
+          // sleep until a producer wakes or the flush interval is passed
+          _sleeping = true;
+          _wakeup.wait_for(lck, _flush_interval);
+          _sleeping = false;
+        }
       }
+
+      flush();
     }
 
-    // return current system time
-    std::string logger_t::thread_id() const
+    // return current thread id, the text is cached per thread
+    const std::string& logger_t::thread_id() const
     {
-      std::stringstream ss;
-      ss << std::this_thread::get_id();
-      return ss.str();
+      thread_local std::string id = []
+      {
+        std::stringstream ss;
+        ss << std::this_thread::get_id();
+        return ss.str();
+      }();
+      return id;
     }
 
-    // return current thread id
-    std::string logger_t::cur_time() const
+    // return current system time, the text is cached per thread
+    // and only milliseconds are reformatted within the same second
+    const std::string& logger_t::cur_time() const
     {
-      int msec;
+      thread_local std::string text;
+      thread_local std::time_t second = -1;
+
+      std::chrono::system_clock::time_point today = std::chrono::system_clock::now();
+      std::time_t now = std::chrono::system_clock::to_time_t(today);
+      int msec = (int)(std::chrono::duration_cast<std::chrono::milliseconds>(today.time_since_epoch()).count() % 1000);
 
+      if (now != second)
+      {
+        // the second is changed, format date and time
+        tm timeinfo;
 #ifdef _WIN32
-      SYSTEMTIME systime;
-      ::GetLocalTime(&systime);
-      msec = systime.wMilliseconds;
+        localtime_s(&timeinfo, &now);
 #else
-      timeval tv;
-      gettimeofday(&tv, 0);
-      msec = tv.tv_usec * 100;
+        localtime_r(&now, &timeinfo);
 #endif
+        std::array<char, 80> time;
+        size_t size = strftime(time.data(), time.size(), "%Y-%m-%d %X", &timeinfo);
 
-      std::chrono::system_clock::time_point today = std::chrono::system_clock::now();
-      std::time_t now = std::chrono::system_clock::to_time_t(today);
+        text.assign(time.data(), size);
+        text += ".000";
+        second = now;
+      }
 
-      tm* timeinfo;
-      timeinfo = localtime(&now);
+      // milliseconds suffix
+      char* suffix = &text[text.size() - 3];
+      suffix[0] = (char)('0' + msec / 100);
+      suffix[1] = (char)('0' + msec / 10 % 10);
+      suffix[2] = (char)('0' + msec % 10);
 
-      std::stringstream buf;
+      return text;
+    }
+
+    // log counts of suppressed lines of all call sites
+    void logger_t::report_suppressed()
+    {
+      std::lock_guard<std::mutex> lck(_limiters_mtx);
+      for (log_limiter_t* limiter : _limiters)
+        limiter->report();
+    }
+
+    // take report lines of call sites whose second is passed, it is done once per second
+    std::vector<std::string> logger_t::passed_suppressed()
+    {
+      std::vector<std::string> lines;
+      int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      int64_t second = _limiters_second.load(std::memory_order_relaxed);
+      if (now == second || !_limiters_second.compare_exchange_strong(second, now, std::memory_order_relaxed))
+        return lines;
+
+      // the lines are logged by the caller w/o the lock
+      std::lock_guard<std::mutex> lck(_limiters_mtx);
+      for (log_limiter_t* limiter : _limiters)
+      {
+        if (!limiter->next_second())
+          continue;
+
+        std::string text = limiter->take_report();
+        if (!text.empty())
+          lines.push_back(std::move(text));
+      }
+      return lines;
+    }
 
-      std::array<char, 80> time;
-      strftime(time.data(), time.size(), "%Y-%m-%d %X", timeinfo);
-      buf << time.data() << "." << std::setfill('0') << std::setw(3) << msec;
+    log_limiter_t::log_limiter_t(kind_t kind, const char* file, int line) : _kind(kind)
+    {
+      const char* name = std::strrchr(file, '/');
+#ifdef _WIN32
+      if (name == nullptr)
+        name = std::strrchr(file, '\\');
+#endif
+      _site = (name ? name + 1 : file) + std::string(":") + std::to_string(line);
 
+      logger_t* logger = logger_t::instance();
+      std::lock_guard<std::mutex> lck(logger->_limiters_mtx);
+      logger->_limiters.push_back(this);
+    }
+
+    log_limiter_t::~log_limiter_t()
+    {
+      logger_t* logger = logger_t::instance();
+      std::lock_guard<std::mutex> lck(logger->_limiters_mtx);
+      logger->_limiters.erase(std::remove(logger->_limiters.begin(), logger->_limiters.end(), this), logger->_limiters.end());
+    }
+
+    // is the line logged, the decision costs a few atomic operations
+    bool log_limiter_t::allow()
+    {
+      // start next second, the thread which starts it reports the previous one
+      if (next_second())
+        report();
+
+      bool allowed = true;
+      if (_kind == rate)
+      {
+        uint32_t limit = logger_t::instance()->rate_limit();
+        allowed = limit == 0 || _count.fetch_add(1, std::memory_order_relaxed) < limit;
+      }
+      else
+      {
+        // thread local xorshift, the sampling must not contend
+        thread_local uint64_t seed = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        allowed = (seed % 1000000) < logger_t::instance()->sample_percent() * 10000;
+      }
+
+      if (!allowed)
+        _suppressed.fetch_add(1, std::memory_order_relaxed);
+      return allowed;
+    }
+
+    // log suppressed lines count and reset it
+    void log_limiter_t::report()
+    {
+      std::string text = take_report();
+      if (!text.empty())
+        logger_t::instance()->logout(text);
+    }
+
+    // start next second if the current one is passed, true if the calling thread has started it
+    bool log_limiter_t::next_second()
+    {
+      int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      int64_t second = _second.load(std::memory_order_relaxed);
+      if (now == second || !_second.compare_exchange_strong(second, now, std::memory_order_relaxed))
+        return false;
+
+      _count.store(0, std::memory_order_relaxed);
+      return true;
+    }
+
+    // take suppressed lines count as a report line and reset it, empty if no lines are suppressed
+    std::string log_limiter_t::take_report()
+    {
+      uint64_t suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+      if (!suppressed)
+        return std::string();
+
+      std::stringstream buf;
+      buf << suppressed << " lines are " << (_kind == rate ? "rate limited" : "not sampled") << " at " << _site << "." << std::endl;
       return buf.str();
     }
 
@@ -4,16 +4,37 @@
 #include <fstream>
 #include <sstream>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+
+#include <vector>
+
+#include "ringbuf.h"
+#include "binlog.h"
+#include "mmapsink.h"
 
 namespace csnet
 {
   namespace shared
   {
 
+// log levels, the compile-time floor CSNET_LOG_LEVEL removes calls below it from the binary
+#define CSNET_LOG_TRACE 0
+#define CSNET_LOG_DEBUG 1
+#define CSNET_LOG_INFO 2
+#define CSNET_LOG_WARN 3
+#define CSNET_LOG_ERROR 4
+
+#ifndef CSNET_LOG_LEVEL
+#define CSNET_LOG_LEVEL CSNET_LOG_TRACE
+#endif
+
 #define LOGOUT(seq) \
 do \
 { \
-    if (shared::logger_t::instance()->opened()) \
+    if (shared::logger_t::instance()->enabled(shared::log_level::info)) \
     { \
         std::stringstream buf; \
         buf << seq; \
@@ -21,10 +42,11 @@ do \
     } \
 } while (false)
 
-#define LOGLINE(seq) \
+// log a line of the level, it costs one atomic load if the level is disabled at runtime
+#define LOGLEVEL(level, seq) \
 do  \
 { \
-    if (shared::logger_t::instance()->opened()) \
+    if (shared::logger_t::instance()->enabled(level)) \
     { \
         std::stringstream buf; \
         buf << seq << std::endl; \
@@ -32,9 +54,116 @@ do  \
     } \
 } while (false)
 
+#if CSNET_LOG_LEVEL <= CSNET_LOG_TRACE
+#define LOGTRACE(seq) LOGLEVEL(shared::log_level::trace, seq)
+#else
+#define LOGTRACE(seq) do {} while (false)
+#endif
+
+#if CSNET_LOG_LEVEL <= CSNET_LOG_DEBUG
+#define LOGDEBUG(seq) LOGLEVEL(shared::log_level::debug, seq)
+#else
+#define LOGDEBUG(seq) do {} while (false)
+#endif
+
+#if CSNET_LOG_LEVEL <= CSNET_LOG_INFO
+#define LOGINFO(seq) LOGLEVEL(shared::log_level::info, seq)
+#else
+#define LOGINFO(seq) do {} while (false)
+#endif
+
+#if CSNET_LOG_LEVEL <= CSNET_LOG_WARN
+#define LOGWARN(seq) LOGLEVEL(shared::log_level::warn, seq)
+#else
+#define LOGWARN(seq) do {} while (false)
+#endif
+
+#if CSNET_LOG_LEVEL <= CSNET_LOG_ERROR
+#define LOGERROR(seq) LOGLEVEL(shared::log_level::error, seq)
+#else
+#define LOGERROR(seq) do {} while (false)
+#endif
+
+// info level line
+#define LOGLINE(seq) LOGINFO(seq)
+
+// log a line by a static format with '{}' placeholders, the binary log keeps
+// the format id and raw arguments and the text is formatted by the decoder
+#define LOGFMT(level, format, ...) \
+do \
+{ \
+    if constexpr ((int)(level) >= CSNET_LOG_LEVEL) \
+    { \
+        if (shared::logger_t::instance()->enabled(level)) \
+        { \
+            static const uint32_t format_id = shared::logger_t::instance()->register_format(level, __FILE__, __LINE__, format); \
+            shared::logger_t::instance()->logfmt(format_id, format, ##__VA_ARGS__); \
+        } \
+    } \
+} while (false)
+
+// log a line limited per call site, suppressed lines are counted and reported once per second,
+// a call site which has gone quiet is reported by the async writer or by the next line of any site
+#define LOGLIMITED(level, limit, seq) \
+do \
+{ \
+    if constexpr ((int)(level) >= CSNET_LOG_LEVEL) \
+    { \
+        if (shared::logger_t::instance()->enabled(level)) \
+        { \
+            static shared::log_limiter_t limiter(limit, __FILE__, __LINE__); \
+            if (limiter.allow()) \
+            { \
+                std::stringstream buf; \
+                buf << seq << std::endl; \
+                shared::logger_t::instance()->logout(buf.str()); \
+            } \
+        } \
+    } \
+} while (false)
+
+#define LOGFMT_LIMITED(level, limit, format, ...) \
+do \
+{ \
+    if constexpr ((int)(level) >= CSNET_LOG_LEVEL) \
+    { \
+        if (shared::logger_t::instance()->enabled(level)) \
+        { \
+            static shared::log_limiter_t limiter(limit, __FILE__, __LINE__); \
+            if (limiter.allow()) \
+            { \
+                static const uint32_t format_id = shared::logger_t::instance()->register_format(level, __FILE__, __LINE__, format); \
+                shared::logger_t::instance()->logfmt(format_id, format, ##__VA_ARGS__); \
+            } \
+        } \
+    } \
+} while (false)
+
+// log at most rate_limit lines per second from the call site
+#define LOGRATE(level, seq) LOGLIMITED(level, shared::log_limiter_t::rate, seq)
+#define LOGFMT_RATE(level, format, ...) LOGFMT_LIMITED(level, shared::log_limiter_t::rate, format, ##__VA_ARGS__)
+// log sample_percent of lines from the call site
+#define LOGSAMPLE(level, seq) LOGLIMITED(level, shared::log_limiter_t::sample, seq)
+#define LOGFMT_SAMPLE(level, format, ...) LOGFMT_LIMITED(level, shared::log_limiter_t::sample, format, ##__VA_ARGS__)
+
+    // log level
+    enum class log_level : int
+    {
+      trace = CSNET_LOG_TRACE,
+      debug = CSNET_LOG_DEBUG,
+      info = CSNET_LOG_INFO,
+      warn = CSNET_LOG_WARN,
+      error = CSNET_LOG_ERROR,
+      off
+    };
+
+    class log_limiter_t;
+
     // log out class
     class logger_t
     {
+      friend class log_limiter_t;
+
     protected:
       logger_t();
       ~logger_t();
@@ -48,22 +177,47 @@ do  \
       logger_t& operator = (logger_t&& rhs) = delete;
 
     public:
-      // open logfile by name
-      bool open(const std::string& filename);
+      // open logfile by name, the binary log is read by csnet-logdecode
+      bool open(const std::string& filename, bool binary = false);
+      // open rotating memory-mapped segments 'filename.N' of segment_size bytes,
+      // last 'segments' files are kept, written data is synced every sync_interval ms
+      bool open_mapped(const std::string& filename, bool binary, size_t segment_size, size_t segments, int sync_interval);
       // close logfile
       void close();
 
+      // start background writer, producers queue lines to the lock-free ring
+      // and the writer writes them in batches, flushes by size or by time
+      void start_async(size_t queue_size, int flush_interval, size_t flush_size);
+      // stop background writer and write queued lines
+      void stop_async();
+
     public:
       // is logfile opened
       bool opened() const
       {
-        return _file.is_open();
+        return _opened.load();
       }
       // get instance to use logger
       static logger_t* instance()
       {
         return &_instance;
       }
+      // is the level logged, it is false for any level if logfile is not opened
+      bool enabled(log_level level) const
+      {
+        return (int)level >= _threshold.load(std::memory_order_relaxed);
+      }
+      // set runtime log level, it can be changed at any time
+      void set_level(log_level level);
+      // get runtime log level
+      log_level level() const
+      {
+        return _level;
+      }
+      // get level by name like 'info', unknown name is 'info'
+      static log_level to_level(const std::string& name);
+      // get level name
+      static const char* level_name(log_level level);
       // double a log to stdout
       void use_stdout(bool out)
       {
@@ -72,26 +226,196 @@ do  \
 
       // log out like a printf format
       void logout(const char* format, ...);
-      // log out
-      void logout(const std::string& log)
+      // log out, the string is not a format
+      void logout(const std::string& log);
+
+      // register a static format of LOGFMT call site, return its id
+      uint32_t register_format(log_level level, const char* file, int line, const char* format);
+
+      // log out by the registered format, the text log formats it at once
+      template<class... Args>
+      void logfmt(uint32_t id, const char* format, const Args&... args)
+      {
+        if (!opened())
+          return;
+
+        if (_binary)
+          write(binlog_t::event(id, args...), 0);
+        else
+          logout(binlog_t::text(format, args...) + "\n");
+      }
+
+      // set max lines per second of LOGRATE call site, 0 - unlimited
+      void set_rate_limit(uint32_t lines)
+      {
+        _rate_limit = lines;
+      }
+      // get max lines per second of LOGRATE call site
+      uint32_t rate_limit() const
+      {
+        return _rate_limit.load(std::memory_order_relaxed);
+      }
+      // set percent of logged lines of LOGSAMPLE call site
+      void set_sample_percent(double percent)
+      {
+        _sample_percent = percent;
+      }
+      // get percent of logged lines of LOGSAMPLE call site
+      double sample_percent() const
       {
-        logout(log.c_str());
+        return _sample_percent.load(std::memory_order_relaxed);
+      }
+      // log counts of suppressed lines of all call sites
+      void report_suppressed();
+
+      // get count of lines dropped because the queue was full
+      uint64_t dropped() const
+      {
+        return _dropped.load(std::memory_order_relaxed);
       }
 
     private:
       // find log file
       std::string findfile(const std::string& filename) const;
-      // return current system time
-      std::string cur_time() const;
-      // return current thread id 
-      std::string thread_id() const;
+      // return current system time, the text is cached per thread
+      // and only milliseconds are reformatted within the same second
+      const std::string& cur_time() const;
+      // return current thread id, the text is cached per thread
+      const std::string& thread_id() const;
+      // enable logging after opening
+      void enable(bool binary);
+      // get data written first to a log file, the binary log needs header and known formats
+      std::string prologue();
+      // write the record to the segment or the file
+      void put(const std::string& text);
+      // flush the file, segments are synced by their own thread
+      void flush();
+      // make a record of the text line with time and thread id
+      std::string make_line(const std::string& log, size_t& prefix) const;
+      // write the line to the file or queue it
+      void write(std::string&& line, size_t prefix);
+      // write the binary record which may not be dropped
+      void write_format(std::string&& record);
+      // write the record to the file and stdout, call under lock or from the writer
+      void output(const std::string& text, size_t prefix);
+      // take report lines of call sites whose second is passed, it is done once per second
+      std::vector<std::string> passed_suppressed();
+      // wait for producers which write w/o lock
+      void wait_producers() const;
+      // background writer thread function
+      void writer();
+
+    private:
+      // queued log line
+      struct record_t
+      {
+        std::string text;
+        size_t prefix = 0; // length of time and thread id prefix
+      };
+
+      // producer which writes w/o lock, it is counted while it queues a line or puts it to the segment
+      class producer_t
+      {
+      public:
+        producer_t(std::atomic<size_t>& producers) : _producers(producers)
+        {
+          _producers.fetch_add(1);
+        }
+        ~producer_t()
+        {
+          _producers.fetch_sub(1);
+        }
+
+      private:
+        std::atomic<size_t>& _producers;
+      };
 
     protected:
-      // multithreading locker
+      // multithreading locker, the file is written under it
       std::mutex _mtx;
+      // producers which write w/o lock, closing and stopping wait for them
+      std::atomic<size_t> _producers{ 0 };
+      // the file or segments are opened, producers do not write while the logger is closing
+      std::atomic<bool> _opened{ false };
       std::ofstream _file;
+      // memory-mapped segments instead of the file
+      std::unique_ptr<mmap_sink_t> _sink;
       bool _stdout = false;
       static logger_t _instance;
+
+      // binary mode
+      bool _binary = false;
+      // formats of LOGFMT call sites, index is format id - 1
+      std::vector<std::string> _formats;
+      std::recursive_mutex _formats_mtx;
+      // decoder to double the binary log to stdout
+      binlog_decoder_t _decoder;
+
+      // limited call sites
+      std::atomic<uint32_t> _rate_limit{ 1000 };
+      std::atomic<double> _sample_percent{ 100 };
+      std::vector<log_limiter_t*> _limiters;
+      std::mutex _limiters_mtx;
+      std::atomic<int64_t> _limiters_second{ 0 };
+
+      // runtime log level
+      std::atomic<log_level> _level{ log_level::trace };
+      // effective level threshold, off if logfile is not opened
+      std::atomic<int> _threshold{ (int)log_level::off };
+
+      // async mode
+      std::unique_ptr<ring_buffer_t<record_t>> _queue;
+      std::thread _writer;
+      // the writer sleeps and it is stopped under it
+      std::mutex _writer_mtx;
+      std::condition_variable _wakeup;
+      std::atomic<bool> _async{ false };
+      std::atomic<bool> _stop_writer{ false };
+      std::atomic<bool> _sleeping{ false };
+      std::atomic<uint64_t> _dropped{ 0 };
+      std::chrono::milliseconds _flush_interval{ 100 };
+      size_t _flush_size = 0;
+    };
+
+    // per call site limiter of LOGRATE and LOGSAMPLE lines
+    // it counts suppressed lines and reports them when next second is started by the call site or by the logger
+    class log_limiter_t
+    {
+    public:
+      // limiting kind
+      enum kind_t
+      {
+        rate, // at most logger_t::rate_limit() lines per second
+        sample // random logger_t::sample_percent() of lines
+      };
+
+    public:
+      log_limiter_t(kind_t kind, const char* file, int line);
+      ~log_limiter_t();
+
+      log_limiter_t(const log_limiter_t&) = delete;
+      log_limiter_t& operator = (const log_limiter_t&) = delete;
+
+    public:
+      // is the line logged, the decision costs a few atomic operations
+      bool allow();
+      // log suppressed lines count and reset it
+      void report();
+
+    private:
+      friend class logger_t;
+
+      // start next second if the current one is passed, true if the calling thread has started it
+      bool next_second();
+      // take suppressed lines count as a report line and reset it, empty if no lines are suppressed
+      std::string take_report();
+
+    private:
+      kind_t _kind;
+      std::string _site;
+      std::atomic<int64_t> _second{ 0 };
+      std::atomic<uint32_t> _count{ 0 };
+      std::atomic<uint64_t> _suppressed{ 0 };
     };
 
   }
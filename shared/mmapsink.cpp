@@ -0,0 +1,363 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "mmapsink.h"
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // create first segment, 'segments' is count of kept files, 0 - keep all
+    mmap_sink_t::mmap_sink_t(const std::string& filename, size_t segment_size, size_t segments, int sync_interval,
+      prologue_t prologue, std::recursive_mutex* guard) :
+      _filename(filename), _segment_size(segment_size), _segments(segments), _sync_interval(sync_interval),
+      _prologue(prologue), _guard(guard)
+    {
+      remove_stale();
+
+      segment_t* first = create(_seq = 1);
+      if (_prologue)
+      {
+        std::string data = _prologue();
+        std::memcpy(first->data, data.data(), std::min(data.size(), first->size));
+        first->offset = std::min(data.size(), first->size);
+      }
+      _current = first;
+      _rotations = 1;
+
+      _syncer = std::thread(&mmap_sink_t::syncer, this);
+    }
+
+    // remove all segments 'filename.N' of a previous run, numbers may have gaps
+    void mmap_sink_t::remove_stale() const
+    {
+      size_t slash = _filename.find_last_of("/\\");
+      std::string dir = slash == std::string::npos ? std::string() : _filename.substr(0, slash + 1);
+      std::string prefix = (slash == std::string::npos ? _filename : _filename.substr(slash + 1)) + ".";
+
+      // the name is the prefix and a segment number
+      auto is_segment = [&prefix](const char* name)
+      {
+        size_t length = std::strlen(name);
+        if (length <= prefix.size() || prefix.compare(0, prefix.size(), name, prefix.size()) != 0)
+          return false;
+        return std::all_of(name + prefix.size(), name + length, [](char c) { return c >= '0' && c <= '9'; });
+      };
+
+      std::vector<std::string> stale;
+#ifdef _WIN32
+      WIN32_FIND_DATAA found;
+      HANDLE find = ::FindFirstFileA((_filename + ".*").c_str(), &found);
+      if (find != INVALID_HANDLE_VALUE)
+      {
+        do
+        {
+          if (is_segment(found.cFileName))
+            stale.push_back(dir + found.cFileName);
+        } while (::FindNextFileA(find, &found));
+        ::FindClose(find);
+      }
+#else
+      DIR* entries = ::opendir(dir.empty() ? "." : dir.c_str());
+      if (entries)
+      {
+        while (dirent* entry = ::readdir(entries))
+        {
+          if (is_segment(entry->d_name))
+            stale.push_back(dir + entry->d_name);
+        }
+        ::closedir(entries);
+      }
+#endif
+
+      for (const std::string& path : stale)
+        std::remove(path.c_str());
+    }
+
+    // sync and truncate segments to written data
+    mmap_sink_t::~mmap_sink_t()
+    {
+      {
+        std::lock_guard<std::mutex> lck(_mtx);
+        _stop = true;
+      }
+      _wakeup.notify_one();
+      _syncer.join();
+
+      // writers are gone, the current segment ends at its last reservation
+      segment_t* current = _current.load();
+      current->end = std::min(current->offset.load(), current->size);
+
+      for (segment_t* segment : _retired)
+        release(segment);
+      release(current);
+
+      if (_spare)
+      {
+        release(_spare);
+        std::remove(_spare->path.c_str());
+      }
+    }
+
+    // copy data to the current segment, false if data is larger than a segment
+    bool mmap_sink_t::write(const char* data, size_t size)
+    {
+      if (size > _segment_size / 2)
+        return false;
+
+      for (;;)
+      {
+        segment_t* segment = _current.load(std::memory_order_acquire);
+
+        // announce the copy, then check the segment is not retired meanwhile
+        segment->writers.fetch_add(1);
+        if (segment != _current.load())
+        {
+          segment->writers.fetch_sub(1);
+          continue;
+        }
+
+        size_t pos = segment->offset.fetch_add(size);
+        if (pos + size <= segment->size)
+        {
+          std::memcpy(segment->data + pos, data, size);
+          segment->writers.fetch_sub(1, std::memory_order_release);
+          return true;
+        }
+        segment->writers.fetch_sub(1);
+
+        if (pos <= segment->size)
+        {
+          // the reservation crosses the end, this writer switches the segment
+          segment->end = pos;
+          rotate(segment);
+        }
+        else
+        {
+          // other writer switches the segment
+          while (_current.load() == segment)
+            std::this_thread::yield();
+        }
+      }
+    }
+
+    // publish next segment instead of the full one
+    void mmap_sink_t::rotate(segment_t* full)
+    {
+      segment_t* next = nullptr;
+      {
+        // the spare is ready unless segments are filled faster than created
+        std::unique_lock<std::mutex> lck(_mtx);
+        if (_spare == nullptr)
+        {
+          _wakeup.notify_one();
+          _prepared.wait(lck, [this] { return _spare != nullptr; });
+        }
+        std::swap(next, _spare);
+      }
+
+      {
+        std::unique_lock<std::recursive_mutex> guard;
+        if (_guard)
+          guard = std::unique_lock<std::recursive_mutex>(*_guard);
+
+        if (_prologue)
+        {
+          std::string data = _prologue();
+          size_t size = std::min(data.size(), next->size);
+          std::memcpy(next->data, data.data(), size);
+          next->offset = size;
+        }
+        _current.store(next, std::memory_order_release);
+      }
+      _rotations.fetch_add(1, std::memory_order_relaxed);
+
+      {
+        std::lock_guard<std::mutex> lck(_mtx);
+        _retired.push_back(full);
+      }
+      _wakeup.notify_one();
+    }
+
+    // background thread function
+    void mmap_sink_t::syncer()
+    {
+      for (;;)
+      {
+        bool prepare = false;
+        std::deque<segment_t*> retired;
+        {
+          std::unique_lock<std::mutex> lck(_mtx);
+          _wakeup.wait_for(lck, _sync_interval, [this]
+          {
+            return _stop || _spare == nullptr || !_retired.empty();
+          });
+          if (_stop)
+            break;
+
+          prepare = (_spare == nullptr);
+
+          // take segments all writers left
+          while (!_retired.empty() && _retired.front()->writers.load(std::memory_order_acquire) == 0)
+          {
+            retired.push_back(_retired.front());
+            _retired.pop_front();
+          }
+        }
+
+        if (prepare)
+        {
+          try
+          {
+            // segments are created here only, so their numbers go in order
+            segment_t* spare = create(_seq + 1);
+            _seq++;
+            {
+              std::lock_guard<std::mutex> lck(_mtx);
+              _spare = spare;
+            }
+            _prepared.notify_all();
+          }
+          catch (std::exception&)
+          {
+            // no space or descriptors, writers wait for next attempt
+            std::this_thread::sleep_for(_sync_interval);
+          }
+        }
+        else if (retired.empty())
+        {
+          // a writer still copies to a retired segment
+          std::this_thread::yield();
+        }
+
+        for (segment_t* segment : retired)
+        {
+          release(segment);
+
+          // keep last segments only
+          if (_segments && segment->seq >= _segments)
+            std::remove((_filename + "." + std::to_string(segment->seq + 1 - _segments)).c_str());
+        }
+
+        sync(_current.load(), false);
+      }
+    }
+
+    // sync written data of the segment
+    void mmap_sink_t::sync(segment_t* segment, bool wait)
+    {
+      size_t written = std::min(segment->offset.load(), segment->size);
+      if (written <= segment->synced)
+        return;
+
+#ifdef _WIN32
+      ::FlushViewOfFile(segment->data + segment->synced, written - segment->synced);
+      if (wait)
+        ::FlushFileBuffers(segment->file);
+#else
+      // msync needs a page aligned address
+      size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+      size_t from = segment->synced / page * page;
+      ::msync(segment->data + from, written - from, wait ? MS_SYNC : MS_ASYNC);
+#endif
+      segment->synced = written;
+    }
+
+    // create, preallocate and map segment file
+    mmap_sink_t::segment_t* mmap_sink_t::create(uint64_t seq)
+    {
+      std::unique_ptr<segment_t> segment(new segment_t());
+      segment->seq = seq;
+      segment->path = _filename + "." + std::to_string(seq);
+      segment->size = _segment_size;
+
+#ifdef _WIN32
+      segment->file = ::CreateFileA(segment->path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE,
+        nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (segment->file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Cannot create log segment \"" + segment->path + "\"");
+
+      LARGE_INTEGER size;
+      size.QuadPart = (LONGLONG)_segment_size;
+      segment->mapping = ::CreateFileMappingA(segment->file, nullptr, PAGE_READWRITE, size.HighPart, size.LowPart, nullptr);
+      if (segment->mapping)
+        segment->data = (char*)::MapViewOfFile(segment->mapping, FILE_MAP_WRITE, 0, 0, _segment_size);
+      if (segment->data == nullptr)
+      {
+        if (segment->mapping)
+          ::CloseHandle(segment->mapping);
+        ::CloseHandle(segment->file);
+        throw std::runtime_error("Cannot map log segment \"" + segment->path + "\"");
+      }
+#else
+      segment->file = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (segment->file < 0)
+        throw std::runtime_error("Cannot create log segment \"" + segment->path + "\": " + std::strerror(errno));
+
+      // allocate blocks now, so writers never fault on a full disk
+      int err = ::posix_fallocate(segment->file, 0, _segment_size);
+      if (err != 0 && ::ftruncate(segment->file, _segment_size) != 0)
+        err = errno;
+      else
+        err = 0;
+
+      void* data = err ? MAP_FAILED : ::mmap(nullptr, _segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->file, 0);
+      if (data == MAP_FAILED)
+      {
+        ::close(segment->file);
+        throw std::runtime_error("Cannot map log segment \"" + segment->path + "\"");
+      }
+      segment->data = (char*)data;
+#endif
+
+      std::lock_guard<std::mutex> lck(_mtx);
+      _all.push_back(std::move(segment));
+      return _all.back().get();
+    }
+
+    // sync, unmap and truncate segment file to written data
+    void mmap_sink_t::release(segment_t* segment)
+    {
+      if (segment->data == nullptr)
+        return;
+
+      size_t end = std::min(segment->end.load(), segment->size);
+      segment->offset = end;
+      sync(segment, true);
+
+#ifdef _WIN32
+      ::UnmapViewOfFile(segment->data);
+      ::CloseHandle(segment->mapping);
+
+      LARGE_INTEGER size;
+      size.QuadPart = (LONGLONG)end;
+      if (::SetFilePointerEx(segment->file, size, nullptr, FILE_BEGIN))
+        ::SetEndOfFile(segment->file);
+      ::CloseHandle(segment->file);
+#else
+      ::munmap(segment->data, segment->size);
+      if (::ftruncate(segment->file, end) != 0)
+      {
+        // the tail stays zero filled
+      }
+      ::close(segment->file);
+#endif
+
+      segment->data = nullptr;
+    }
+
+  }
+}
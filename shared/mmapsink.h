@@ -0,0 +1,112 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // log sink backed by preallocated memory-mapped segment files 'filename.N'
+    // writers reserve space by an atomic offset and copy data to the mapping,
+    // the background thread prepares next segment, syncs and retires full ones
+    class mmap_sink_t
+    {
+      // mapped segment file
+      struct segment_t
+      {
+        uint64_t seq = 0;
+        std::string path;
+        char* data = nullptr;
+        size_t size = 0;
+        std::atomic<size_t> offset{ 0 }; // next reserved position, it may exceed the size
+        std::atomic<size_t> end{ 0 }; // written data size of a full segment
+        std::atomic<int> writers{ 0 }; // writers copying to the mapping
+        size_t synced = 0; // synced data size, it is used by the background thread
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#else
+        int file = -1;
+#endif
+      };
+
+    public:
+      // data written first to each segment, like a binary log header
+      typedef std::function<std::string()> prologue_t;
+
+      // create first segment, 'segments' is count of kept files, 0 - keep all
+      // the guard is locked while prologue is written and next segment is published
+      mmap_sink_t(const std::string& filename, size_t segment_size, size_t segments, int sync_interval,
+        prologue_t prologue = nullptr, std::recursive_mutex* guard = nullptr);
+      // sync and truncate segments to written data
+      ~mmap_sink_t();
+
+      mmap_sink_t(const mmap_sink_t&) = delete;
+      mmap_sink_t& operator = (const mmap_sink_t&) = delete;
+
+    public:
+      // copy data to the current segment, false if data is larger than a segment
+      bool write(const char* data, size_t size);
+
+      // get count of segments created
+      uint64_t rotations() const
+      {
+        return _rotations.load(std::memory_order_relaxed);
+      }
+
+    private:
+      // remove all segments 'filename.N' of a previous run, numbers may have gaps
+      void remove_stale() const;
+      // create, preallocate and map segment file
+      segment_t* create(uint64_t seq);
+      // sync, unmap and truncate segment file to written data
+      void release(segment_t* segment);
+      // publish next segment instead of the full one
+      void rotate(segment_t* full);
+      // background thread function
+      void syncer();
+      // sync written data of the segment
+      void sync(segment_t* segment, bool wait);
+
+    private:
+      std::string _filename;
+      size_t _segment_size;
+      size_t _segments;
+      std::chrono::milliseconds _sync_interval;
+      prologue_t _prologue;
+      std::recursive_mutex* _guard;
+
+      // current segment, it is replaced by the writer which fills it
+      std::atomic<segment_t*> _current{ nullptr };
+      std::atomic<uint64_t> _rotations{ 0 };
+
+      // segments are deleted by the destructor only, a writer may still look at a retired one
+      std::vector<std::unique_ptr<segment_t>> _all;
+      // prepared next segment and segments waiting for writers to leave them
+      segment_t* _spare = nullptr;
+      std::deque<segment_t*> _retired;
+      std::mutex _mtx;
+      std::condition_variable _wakeup;
+      std::condition_variable _prepared;
+      // last created segment number
+      uint64_t _seq = 0;
+      std::thread _syncer;
+      bool _stop = false;
+    };
+
+  }
+}
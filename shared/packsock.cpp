@@ -23,29 +23,32 @@ namespace csnet
     // caller should delete the pointer
     packet_info_t* packet_socket_t::receive() const
     {
-      int16_t size;
-      size_t num = socket_t::receive(&size, sizeof(int16_t)); // read packet size (2 bytes)
-      if (num != sizeof(int16_t) || size == 0)
+      uint16_t size;
+      size_t num = socket_t::receive(&size, sizeof(int16_t), MSG_WAITALL); // read packet size (2 bytes)
+      if (num != sizeof(int16_t) || size < sizeof(packet_info_t))
         return nullptr;
 
-      std::vector<int8_t> data;
-      num = socket_t::receive(data, (size_t)size * sizeof(int8_t) - sizeof(int16_t)); // read whole data (size - 2 bytes)
+      // per-thread receive buffer, it keeps its capacity and is first touched by the owner thread
+      // so a thread bound to a cpu gets the buffer on its own numa node
+      thread_local std::vector<int8_t> data;
+      data.clear();
+      // a large packet comes in several segments, wait for all of them
+      num = socket_t::receive(data, (size_t)size * sizeof(int8_t) - sizeof(int16_t), MSG_WAITALL); // read whole data (size - 2 bytes)
 
       // check result, size should be equ (packet size) - (size field) i.e. size - sizeof(int16_t)
       if (num != (size - sizeof(int16_t)) || data.size() != (size - sizeof(int16_t)))
         return nullptr;
 
-      // insert the size at front of the data
-      data.insert(data.begin(), reinterpret_cast<int8_t*>(&size), reinterpret_cast<int8_t*>(&size) + sizeof(int16_t));
-
       // allocate memory for packet with data
-      int8_t* placement = new int8_t[data.size()];
+      int8_t* placement = new int8_t[size];
       // resize the packet in the allocated memory
       packet_info_t* packet = new (placement) packet_info_t;
 
-      // copy received data to the packet
-      std::memmove(packet, data.data(), data.size());
+      // copy the size and received data to the packet
+      std::memmove(placement, &size, sizeof(int16_t));
+      std::memmove(placement + sizeof(int16_t), data.data(), data.size());
 
+      _received += size;
       return packet;
     }
 
@@ -53,32 +56,37 @@ namespace csnet
     // union 'packet' and 'text' and send them
     bool packet_socket_t::send(const packet_info_t& packet, const std::string& text) const
     {
-      size_t size = sizeof(packet_info_t) + text.size() + sizeof(char); // calculate full data size
-      std::vector<char> data(size); // allocate a meory for the packet
-
-      packet_text_t* packet_text = reinterpret_cast<packet_text_t*>(data.data()); // map the packet on allocated memory
-
-      std::memmove(packet_text, &packet, sizeof(packet_info_t)); // copy the packet info to the packet
-      std::strcpy(packet_text->text, text.c_str()); // copy the text to the packet
-      packet_text->size = size; // set full size of the packet with data
-
-      return send(packet_text);
+      // the text is sent with its terminating zero
+      return send(packet, text.c_str(), text.size() + sizeof(char));
     }
 
     // send data packet to socket
     // union 'packet' and 'data' and send them
     bool packet_socket_t::send(const packet_info_t& packet, const void* data, size_t data_size) const
+    {
+      std::vector<int8_t> frame;
+      if (!encode(packet, data, data_size, frame))
+        return false;
+
+      return send(reinterpret_cast<const packet_info_t*>(frame.data()));
+    }
+
+    // make a frame of the packet head and data, false if it is larger than MAX_PACKET_SIZE
+    bool packet_socket_t::encode(const packet_info_t& packet, const void* data, size_t data_size, std::vector<int8_t>& frame)
     {
       size_t size = sizeof(packet_info_t) + data_size; // calculate full data size
-      std::vector<int8_t> d(size); // allocate a meory for the packet
+      if (size > MAX_PACKET_SIZE)
+        return false;
+      frame.resize(size); // allocate a meory for the packet
 
-      packet_data_t* packet_data = reinterpret_cast<packet_data_t*>(d.data()); // map the packet on allocated memory
+      packet_data_t* packet_data = reinterpret_cast<packet_data_t*>(frame.data()); // map the packet on allocated memory
 
-      std::memmove(packet_data, &packet, sizeof(packet_info_t)); // copy the packet info to the packet
-      std::memmove(packet_data->data, data, data_size); // copy the data to the packet
-      packet_data->size = size; // set full size of the packet with data
+      std::memmove(static_cast<void*>(packet_data), &packet, sizeof(packet_info_t)); // copy the packet info to the packet
+      if (data_size)
+        std::memmove(packet_data->data, data, data_size); // copy the data to the packet
+      packet_data->size = (uint16_t)size; // set full size of the packet with data
 
-      return send(packet_data);
+      return true;
     }
 
   }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include "socket.h"
 
 namespace csnet
@@ -32,7 +34,10 @@ namespace csnet
       P_EXECMD_ACTION = 3, // execute command
       P_CREDENTIALS_ACTION = 4, // check credentials
       P_PING_ACTION = 5, // ping
-      P_CALC_ACTION = 6 // calculate
+      P_CALC_ACTION = 6, // calculate
+      P_STATS_ACTION = 7, // get server latency statistics
+      P_TRACE_ACTION = 8, // dump server request trace
+      P_BATCH_ACTION = 9 // batch of requests, its data are whole request packets, the reply data are their reply packets
     };
 
     //overloading operator + to use OR for enum class type
@@ -48,7 +53,7 @@ namespace csnet
     {
       packet_info_t() {}
       packet_info_t(packet_kind k, packet_type t, packet_code a) : kind(k), type(t), action(a) {}
-      uint16_t size_data()
+      uint16_t size_data() const
       {
         return size - sizeof(packet_info_t);
       }
@@ -89,6 +94,10 @@ namespace csnet
     // packet socket class
     class packet_socket_t : public socket_t
     {
+    public:
+      // max size of a packet with its head, the size field is 16 bit
+      static constexpr size_t MAX_PACKET_SIZE = UINT16_MAX;
+
     public:
       packet_socket_t() {}
       //packet_socket_t(const socket_t& socket) : socket_t(socket) {}
@@ -129,6 +138,9 @@ namespace csnet
       // union 'packet' and 'data' and send them
       bool send(const packet_info_t& packet, const void* data, size_t data_size) const;
 
+      // make a frame of the packet head and data, false if it is larger than MAX_PACKET_SIZE
+      static bool encode(const packet_info_t& packet, const void* data, size_t data_size, std::vector<int8_t>& frame);
+
       // send packet w/o data from socket
       bool send(const packet_info_t& packet) const
       {
@@ -139,8 +151,27 @@ namespace csnet
       // send any type packet from socket
       bool send(const packet_info_t* packet) const
       {
-        return socket_t::send(reinterpret_cast<const int8_t*>(packet), (size_t)packet->size) == packet->size;
+        bool sent = socket_t::send(reinterpret_cast<const int8_t*>(packet), (size_t)packet->size) == packet->size;
+        if (sent)
+          _sent += packet->size;
+        return sent;
+      }
+
+      // get bytes of received packets
+      size_t received_bytes() const
+      {
+        return _received;
       }
+      // get bytes of sent packets
+      size_t sent_bytes() const
+      {
+        return _sent;
+      }
+
+    protected:
+      // traffic of the socket, it is counted from the creation or moving
+      mutable size_t _received = 0;
+      mutable size_t _sent = 0;
     };
 
   }
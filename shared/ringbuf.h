@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+namespace csnet
+{
+  namespace shared
+  {
+
+    // bounded lock-free multi-producer queue based on Dmitry Vyukov's MPMC queue
+    // push and pop never block, push fails if the queue is full
+    template <class T>
+    class ring_buffer_t
+    {
+      static constexpr size_t _CACHE_LINE = 64;
+
+      // queue cell, its sequence tells whether it is free or filled for the position
+      struct cell_t
+      {
+        std::atomic<size_t> sequence;
+        T data;
+      };
+
+    public:
+      // capacity is rounded up to a power of two
+      explicit ring_buffer_t(size_t capacity)
+      {
+        size_t size = 2;
+        while (size < capacity)
+          size <<= 1;
+
+        _mask = size - 1;
+        _cells.reset(new cell_t[size]);
+        for (size_t i = 0; i < size; i++)
+          _cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+
+      ring_buffer_t(const ring_buffer_t&) = delete;
+      ring_buffer_t& operator = (const ring_buffer_t&) = delete;
+
+    public:
+      // add item to the queue, false if the queue is full
+      bool push(T&& data)
+      {
+        size_t pos = _enqueue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+          cell_t& cell = _cells[pos & _mask];
+          size_t seq = cell.sequence.load(std::memory_order_acquire);
+          intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+          if (diff == 0)
+          {
+            // the cell is free, try to take it
+            if (_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+              cell.data = std::move(data);
+              cell.sequence.store(pos + 1, std::memory_order_release);
+              return true;
+            }
+          }
+          else if (diff < 0)
+          {
+            return false; // the queue is full
+          }
+          else
+          {
+            pos = _enqueue.load(std::memory_order_relaxed);
+          }
+        }
+      }
+
+      // get item from the queue, false if the queue is empty
+      bool pop(T& data)
+      {
+        size_t pos = _dequeue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+          cell_t& cell = _cells[pos & _mask];
+          size_t seq = cell.sequence.load(std::memory_order_acquire);
+          intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+          if (diff == 0)
+          {
+            // the cell is filled, try to take it
+            if (_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+              data = std::move(cell.data);
+              cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+              return true;
+            }
+          }
+          else if (diff < 0)
+          {
+            return false; // the queue is empty
+          }
+          else
+          {
+            pos = _dequeue.load(std::memory_order_relaxed);
+          }
+        }
+      }
+
+      // get queue capacity
+      size_t capacity() const
+      {
+        return _mask + 1;
+      }
+
+    private:
+      std::unique_ptr<cell_t[]> _cells;
+      size_t _mask = 0;
+      // producers and consumer positions are on own cache lines
+      alignas(_CACHE_LINE) std::atomic<size_t> _enqueue{ 0 };
+      alignas(_CACHE_LINE) std::atomic<size_t> _dequeue{ 0 };
+    };
+
+  }
+}
@@ -18,6 +18,10 @@ namespace csnet
       virtual std::string get_value(const std::string& section, const std::string& name) const = 0;
       // write value by 'name' from 'section'
       virtual std::string set_value(const std::string& section, const std::string& name, const std::string& value) = 0;
+      // re-read values from the source
+      virtual void reload()
+      {
+      }
 
       virtual ~settings_provider_t() = default;
     };
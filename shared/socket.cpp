@@ -6,6 +6,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <poll.h>
 #define closesocket(socket) close(socket)
 #define socket_errno() errno
 #endif
@@ -14,9 +15,18 @@
 #include <sstream>
 #include <array>
 #include <functional>
+#include <chrono>
+#include <algorithm>
 
 #include "socket.h"
 
+#ifndef WSAETIMEDOUT
+#define WSAETIMEDOUT ETIMEDOUT
+#endif
+#ifndef WSAEWOULDBLOCK
+#define WSAEWOULDBLOCK EWOULDBLOCK
+#endif
+
 namespace csnet
 {
   namespace shared
@@ -125,6 +135,14 @@ namespace csnet
       return error() == 0;
     }
 
+    // set integer socket option
+    bool socket_t::set_option(int level, int name, int value) const
+    {
+      if (::setsockopt(_socket, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) < 0)
+        set_error(socket_errno());
+      return error() == 0;
+    }
+
     // initiate a connection on a socket
     bool socket_t::connect(const sockaddr* addr, size_t len) const
     {
@@ -146,6 +164,162 @@ namespace csnet
       return connect(servinfo->ai_addr, servinfo->ai_addrlen);
     }
 
+    // order the addresses by turns of their families, so a dead family does not hold the other one back
+    static std::vector<const addrinfo*> interleave(const addrinfo* servinfo)
+    {
+      std::vector<const addrinfo*> first;
+      std::vector<const addrinfo*> other;
+      for (const addrinfo* ai = servinfo; ai; ai = ai->ai_next)
+        (ai->ai_family == servinfo->ai_family ? first : other).push_back(ai);
+
+      std::vector<const addrinfo*> addresses;
+      for (size_t i = 0; i < std::max(first.size(), other.size()); i++)
+      {
+        if (i < first.size())
+          addresses.push_back(first[i]);
+        if (i < other.size())
+          addresses.push_back(other[i]);
+      }
+      return addresses;
+    }
+
+    // connect to the first answering address of the host in 'timeout' ms (-1 w/o timeout)
+    // the addresses are raced, the next one starts after 'stagger' ms or when the previous one fails,
+    // the socket is created by the winner's family and stays blocking
+    bool socket_t::connect(const std::string& host, uint16_t port, int timeout, int stagger)
+    {
+      typedef std::chrono::steady_clock clock_t;
+
+      close();
+
+      // getting ip-address from host name
+      addrinfo* ai = getaddrinfo(host, port);
+      // add to smart pointer
+      std::unique_ptr<addrinfo, std::function<void(addrinfo*)>> servinfo(ai, [](addrinfo* ai) { ::freeaddrinfo(ai); });
+      if (!servinfo)
+        return false;
+
+      std::vector<const addrinfo*> addresses = interleave(servinfo.get());
+
+      // connecting sockets, the losers are closed by the end
+      std::vector<socket_t> attempts;
+#ifdef _WIN32
+      std::vector<WSAPOLLFD> fds;
+#else
+      std::vector<pollfd> fds;
+#endif
+      socket_t winner;
+      size_t next = 0;
+      int last_error = WSAETIMEDOUT;
+      clock_t::time_point deadline = clock_t::now() + std::chrono::milliseconds(std::max(timeout, 0));
+      clock_t::time_point next_start = clock_t::now();
+
+      while (winner.socket() == INVALID_SOCKET_HANDLE)
+      {
+        clock_t::time_point now = clock_t::now();
+        if (timeout >= 0 && now >= deadline)
+        {
+          last_error = WSAETIMEDOUT;
+          break;
+        }
+
+        // start the next address by its time or at once if there is no attempt in flight
+        if (next < addresses.size() && (attempts.empty() || now >= next_start))
+        {
+          const addrinfo* address = addresses[next++];
+          next_start = now + std::chrono::milliseconds(stagger);
+
+          socket_t attempt;
+          if (!attempt.create(address->ai_family, address->ai_socktype, address->ai_protocol) || !attempt.set_unblocking(true))
+          {
+            last_error = attempt.error();
+            continue;
+          }
+
+          if (::connect(attempt, address->ai_addr, (socklen_t)address->ai_addrlen) == 0)
+          {
+            // connected at once, e.g. to the loopback
+            winner = std::move(attempt);
+            break;
+          }
+
+          int error = socket_errno();
+          if (error != EINPROGRESS && error != WSAEWOULDBLOCK)
+          {
+            last_error = error;
+            continue;
+          }
+
+          fds.push_back({});
+          fds.back().fd = attempt;
+          fds.back().events = POLLOUT;
+          attempts.push_back(std::move(attempt));
+          continue;
+        }
+
+        if (attempts.empty())
+          break; // all addresses have failed
+
+        // wait up to the deadline or the start of the next address
+        int wait = -1;
+        if (timeout >= 0)
+          wait = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+        if (next < addresses.size())
+        {
+          int start = (int)std::chrono::duration_cast<std::chrono::milliseconds>(next_start - now).count() + 1;
+          wait = (wait < 0) ? start : std::min(wait, start);
+        }
+
+#ifdef _WIN32
+        int ready = ::WSAPoll(fds.data(), (ULONG)fds.size(), wait);
+#else
+        int ready = ::poll(fds.data(), fds.size(), wait);
+#endif
+        if (ready < 0)
+        {
+          if (socket_errno() == EINTR)
+            continue;
+          last_error = socket_errno();
+          break;
+        }
+
+        // the first connected attempt wins, a failed one is dropped
+        for (size_t i = 0; i < fds.size() && ready > 0;)
+        {
+          if (fds[i].revents == 0)
+          {
+            i++;
+            continue;
+          }
+
+          int error = 0;
+          socklen_t len = sizeof(error);
+          if (::getsockopt(attempts[i], SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &len) < 0)
+            error = socket_errno();
+          if (error == 0)
+          {
+            winner = std::move(attempts[i]);
+            break;
+          }
+
+          last_error = error;
+          attempts.erase(attempts.begin() + i);
+          fds.erase(fds.begin() + i);
+          // the failed address does not wait for the stagger, the next one starts at once
+          next_start = clock_t::now();
+        }
+      }
+
+      if (winner.socket() == INVALID_SOCKET_HANDLE)
+      {
+        set_error(last_error);
+        return false;
+      }
+
+      // the socket takes the winner's handle
+      return attach(winner.detach()) && set_unblocking(false);
+    }
+
     // accept a connection on a socket
     bool socket_t::accept(socket_t& socket, sockaddr* addr, size_t* len) const
     {
@@ -26,6 +26,7 @@ namespace csnet
     class socket_t
     {
       static constexpr size_t _MAX_LEN = (size_t)-1;
+      static constexpr int _CONNECT_STAGGER = 250; // time in ms to start the next address if the previous one does not answer
 
     public:
 #ifdef _WIN32
@@ -54,11 +55,17 @@ namespace csnet
       void close();
       // set or clear blocking socket
       bool set_unblocking(bool unblocking) const;
+      // set integer socket option
+      bool set_option(int level, int name, int value) const;
 
     public:
       // initiate a connection on a socket
       bool connect(const sockaddr* addr, size_t len) const;
       bool connect(const std::string& host, uint16_t port) const;
+      // connect to the first answering address of the host in 'timeout' ms (-1 w/o timeout)
+      // the addresses are raced, the next one starts after 'stagger' ms or when the previous one fails,
+      // the socket is created by the winner's family and stays blocking
+      bool connect(const std::string& host, uint16_t port, int timeout, int stagger = _CONNECT_STAGGER);
       // accept a connection on a socket
       bool accept(socket_t& socket, sockaddr* addr = nullptr, size_t* len = nullptr) const;
       // bind a name to a socket